@@ -6,6 +6,18 @@
                 'src/node-libcurl.cc',
                 'src/Curl.cc',
                 'src/CurlHttpPost.cc',
+                'src/CurlBuffer.cc',
+                'src/CurlMulti.cc',
+                'src/CurlMessageQueue.cc',
+                'src/CurlWorker.cc',
+                'src/CurlShare.cc',
+                'src/CurlPool.cc',
+                'src/CurlRegistry.cc',
+                'src/CurlTemplate.cc',
+                'src/CurlStats.cc',
+                'src/CurlMetrics.cc',
+                'src/CurlTrace.cc',
+                'src/CurlScheduler.cc',
                 'src/strndup.cc',
                 'src/string_format.cc'
             ],
@@ -0,0 +1,141 @@
+/**
+ * Compares the amount of native -> js calls, and the time taken,
+ * with and without the BATCH_CALLBACKS feature.
+ *
+ * A local server sends responses in many small chunks, so that a single socket event
+ * usually has more than one chunk to deliver.
+ */
+var Curl = require( '../lib/Curl' ),
+    http = require( 'http' );
+
+var port = 3001,
+    concurrency = 50,
+    requests = 2000,
+    chunksPerResponse = 256,
+    chunk = new Buffer( 512 ),
+    modes = [
+        { name : 'default', features : 0 },
+        { name : 'BATCH_CALLBACKS', features : Curl.feature.BATCH_CALLBACKS }
+    ];
+
+chunk.fill( 'a' );
+
+//count only calls made by the native side, not the ones a batch makes to _onData/_onHeader
+var jsEntries = 0,
+    depth = 0;
+
+[ '_onData', '_onHeader', '_onDataBatch', '_onHeaderBatch' ].forEach( function( method ) {
+
+    var original = Curl.prototype[method];
+
+    Curl.prototype[method] = function() {
+
+        var ret;
+
+        if ( depth++ === 0 )
+            ++jsEntries;
+
+        ret = original.apply( this, arguments );
+
+        --depth;
+
+        return ret;
+    };
+});
+
+var server = http.createServer( function( req, res ) {
+
+    res.writeHead( 200, { 'Content-Type' : 'application/octet-stream' } );
+
+    for ( var i = 0; i < chunksPerResponse; i++ )
+        res.write( chunk );
+
+    res.end();
+});
+
+function runMode( mode, cb ) {
+
+    var started = 0,
+        finished = 0,
+        errors = 0,
+        startTime = process.hrtime();
+
+    jsEntries = 0;
+
+    function doRequest() {
+
+        var curl = new Curl();
+
+        ++started;
+
+        curl.setOpt( 'URL', 'http://127.0.0.1:' + port + '/' );
+        curl.enable( mode.features | Curl.feature.NO_STORAGE );
+
+        curl.on( 'end', onFinish );
+        curl.on( 'error', function() {
+
+            ++errors;
+            onFinish.call( this );
+        });
+
+        curl.perform();
+    }
+
+    function onFinish() {
+
+        var time;
+
+        this.close();
+
+        if ( ++finished === requests ) {
+
+            time = process.hrtime( startTime );
+
+            cb({
+                name : mode.name,
+                time : time[0] * 1e3 + time[1] / 1e6,
+                jsEntries : jsEntries,
+                errors : errors
+            });
+
+        } else if ( started < requests ) {
+
+            doRequest();
+        }
+    }
+
+    for ( var i = 0; i < concurrency; i++ )
+        doRequest();
+}
+
+server.listen( port, '127.0.0.1', function() {
+
+    var results = [];
+
+    (function next( i ) {
+
+        if ( i === modes.length ) {
+
+            results.forEach( function( result ) {
+
+                console.info(
+                    result.name, '->',
+                    'time:', result.time.toFixed( 2 ), 'ms',
+                    '| js entries:', result.jsEntries,
+                    '| js entries per request:', ( result.jsEntries / requests ).toFixed( 2 ),
+                    '| errors:', result.errors
+                );
+            });
+
+            server.close();
+            return;
+        }
+
+        runMode( modes[i], function( result ) {
+
+            results.push( result );
+            next( i + 1 );
+        });
+
+    })( 0 );
+});
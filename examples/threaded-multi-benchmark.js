@@ -0,0 +1,172 @@
+/**
+ * Compares throughput and event loop lag of transfers running on the main thread
+ * against transfers running on Curl.Multi worker threads.
+ *
+ * The lag is measured with a timer that should fire every 10ms,
+ * the amount it's late is the time the loop was busy with something else.
+ *
+ * No reference numbers are published, run it with a built addon on the machine being tuned.
+ */
+var Curl = require( '../lib/Curl' ),
+    http = require( 'http' );
+
+var port = 3001,
+    concurrency = 50,
+    requests = 2000,
+    chunksPerResponse = 256,
+    lagInterval = 10,
+    chunk = new Buffer( 4096 ),
+    modes = [
+        { name : 'main thread', threads : 0 },
+        { name : '1 worker thread', threads : 1 },
+        { name : '2 worker threads', threads : 2 }
+    ];
+
+chunk.fill( 'a' );
+
+var server = http.createServer( function( req, res ) {
+
+    res.writeHead( 200, { 'Content-Type' : 'application/octet-stream' } );
+
+    for ( var i = 0; i < chunksPerResponse; i++ )
+        res.write( chunk );
+
+    res.end();
+});
+
+function measureLag() {
+
+    var samples = [],
+        last = process.hrtime(),
+        timer;
+
+    timer = setInterval( function() {
+
+        var diff = process.hrtime( last );
+
+        samples.push( Math.max( 0, diff[0] * 1e3 + diff[1] / 1e6 - lagInterval ) );
+
+        last = process.hrtime();
+
+    }, lagInterval );
+
+    return function stop() {
+
+        var max = 0, sum = 0;
+
+        clearInterval( timer );
+
+        samples.forEach( function( sample ) {
+
+            sum += sample;
+            max = Math.max( max, sample );
+        });
+
+        return {
+            avg : samples.length ? sum / samples.length : 0,
+            max : max
+        };
+    };
+}
+
+function runMode( mode, cb ) {
+
+    var started = 0,
+        finished = 0,
+        errors = 0,
+        bytes = 0,
+        multi = mode.threads ? new Curl.Multi( { threads : mode.threads } ) : Curl.Multi.getDefault(),
+        stopLag = measureLag(),
+        startTime = process.hrtime();
+
+    function doRequest() {
+
+        var curl = new Curl();
+
+        ++started;
+
+        curl.setMulti( multi );
+        curl.setOpt( 'URL', 'http://127.0.0.1:' + port + '/' );
+        curl.enable( Curl.feature.NO_STORAGE );
+
+        curl.onData = function( data ) {
+
+            bytes += data.length;
+            return data.length;
+        };
+
+        curl.on( 'end', onFinish );
+        curl.on( 'error', function() {
+
+            ++errors;
+            onFinish.call( this );
+        });
+
+        curl.perform();
+    }
+
+    function onFinish() {
+
+        var time, lag;
+
+        this.close();
+
+        if ( ++finished === requests ) {
+
+            time = process.hrtime( startTime );
+            time = time[0] * 1e3 + time[1] / 1e6;
+            lag = stopLag();
+
+            if ( mode.threads )
+                multi.close();
+
+            cb({
+                name : mode.name,
+                time : time,
+                throughput : bytes / 1024 / 1024 / ( time / 1e3 ),
+                lag : lag,
+                errors : errors
+            });
+
+        } else if ( started < requests ) {
+
+            doRequest();
+        }
+    }
+
+    for ( var i = 0; i < concurrency; i++ )
+        doRequest();
+}
+
+server.listen( port, '127.0.0.1', function() {
+
+    var results = [];
+
+    (function next( i ) {
+
+        if ( i === modes.length ) {
+
+            results.forEach( function( result ) {
+
+                console.info(
+                    result.name, '->',
+                    'time:', result.time.toFixed( 2 ), 'ms',
+                    '| throughput:', result.throughput.toFixed( 2 ), 'MB/s',
+                    '| loop lag avg:', result.lag.avg.toFixed( 2 ), 'ms',
+                    'max:', result.lag.max.toFixed( 2 ), 'ms',
+                    '| errors:', result.errors
+                );
+            });
+
+            server.close();
+            return;
+        }
+
+        runMode( modes[i], function( result ) {
+
+            results.push( result );
+            next( i + 1 );
+        });
+
+    })( 0 );
+});
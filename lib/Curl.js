@@ -45,13 +45,47 @@ Curl.feature = {
     NO_DATA_PARSING : 1 << 0,
     NO_HEADER_PARSING : 1 << 1,
     NO_DATA_STORAGE   : 1 << 2,
-    NO_HEADER_STORAGE : 1 << 3
+    NO_HEADER_STORAGE : 1 << 3,
+    NATIVE_DATA_STORAGE : 1 << 4,
+    NATIVE_HEADER_PARSING : 1 << 5,
+    BATCH_CALLBACKS : 1 << 6
 };
 
 Curl.feature.RAW = Curl.feature.NO_DATA_PARSING | Curl.feature.NO_HEADER_PARSING;
 Curl.feature.NO_STORAGE = Curl.feature.NO_DATA_STORAGE | Curl.feature.NO_HEADER_STORAGE;
 
+/**
+ * Indexes of the values on the Float64Array given to setTimings.
+ * Must be kept in sync with the TIMING_* enum on src/Curl.h
+ * @type {Object}
+ * @readonly
+ */
+Curl.timing = {
+    TOTAL_TIME : 0,
+    NAMELOOKUP_TIME : 1,
+    CONNECT_TIME : 2,
+    APPCONNECT_TIME : 3,
+    PRETRANSFER_TIME : 4,
+    STARTTRANSFER_TIME : 5,
+    REDIRECT_TIME : 6,
+    SIZE_UPLOAD : 7,
+    SIZE_DOWNLOAD : 8,
+    SPEED_UPLOAD : 9,
+    SPEED_DOWNLOAD : 10,
+    RESPONSE_CODE : 11,
+    REDIRECT_COUNT : 12,
+    COUNT : 13
+};
+
 var util = require( 'util' ),
+    fs = require( 'fs' ),
+    stream = require( 'stream' ),
+    CurlHeaders = require( './CurlHeaders' ),
+    Multi = require( './Multi' ),
+    Share = require( './Share' ),
+    Pool = require( './Pool' ),
+    Template = require( './Template' ),
+    Metrics = require( './Metrics' ),
     StringDecoder = require( 'string_decoder' ).StringDecoder,
     decoder = new StringDecoder( 'utf8' ),
     EventEmitter = require( 'events' ).EventEmitter,
@@ -125,6 +159,67 @@ function _parseHeaders( headersString ) {
 
 }
 
+function _deliverBatch( curl, deliver, data, ends ) {
+
+    var chunk, ret,
+        consumed = 0,
+        start = 0,
+        i, len;
+
+    for ( i = 0, len = ends.length; i < len; i++ ) {
+
+        //slices share the memory of data, so no copy is made here
+        chunk = data.slice( start, ends[i] );
+        start = ends[i];
+
+        ret = deliver.call( curl, chunk );
+
+        if ( ret !== chunk.length )
+            return consumed;
+
+        consumed += ret;
+    }
+
+    return consumed;
+}
+
+//Remove the sink of curl, files opened by setSink are closed. Sinks with a fd given by the user are kept after a request, unless isForced.
+function _releaseSink( curl, isForced ) {
+
+    if ( curl._sinkFd === null || !( curl._isSinkOwned || isForced ) )
+        return;
+
+    curl._setSink( -1 );
+
+    if ( curl._isSinkOwned )
+        fs.closeSync( curl._sinkFd );
+
+    curl._sinkFd = null;
+    curl._isSinkOwned = false;
+}
+
+//The stream of curl has more data than its high water mark, receiving is paused until it's read.
+// Chunks given directly by the write callback are refused with WRITEFUNC_PAUSE by _onData,
+// the ones delivered in batches were already received, so receiving is paused explicitly.
+function _onReadableFull( curl ) {
+
+    curl._isReadableFull = true;
+
+    if ( curl._isDeliveringBatch && !curl._isRecvPaused ) {
+
+        curl._isRecvPaused = true;
+        curl.pause( curl._pauseState | Curl.pause.RECV );
+    }
+}
+
+//Stop passing the body to the stream of curl, it's not ended.
+function _releaseReadable( curl ) {
+
+    curl._readable = null;
+    curl._isReadableFull = false;
+    curl._isRecvPaused = false;
+}
+
 //Node utils.inherits replaces the child prototype, so it cannot be used with native modules
 var inherits = function( ctor, superCtor, copyStaticMembers ) {
 
@@ -165,6 +260,20 @@ var defaultOnData   = function( chunk ) { return chunk.length; },
 Curl.prototype._onCreated = function() {
 
     this._id = ++id;
+
+    this._resetState();
+
+    this._multi = Multi.getDefault();
+
+    curls[this._id] = this;
+};
+
+/**
+ * Set the js state back to the one of a new instance, used also when it's released to a pool.
+ * @private
+ */
+Curl.prototype._resetState = function() {
+
     this._chunks = [];
     this._headerChunks = [];
 
@@ -177,7 +286,17 @@ Curl.prototype._onCreated = function() {
 
     this.features = 0;
 
-    curls[this._id] = this;
+    this._share = null;
+    this._uploadStream = null;
+    this._sinkFd = null;
+    this._isSinkOwned = false;
+    this._timings = null;
+    this._isTraceEnabled = false;
+    this._pauseState = Curl.pause.CONT;
+    this._readable = null;
+    this._isReadableFull = false;
+    this._isRecvPaused = false;
+    this._isDeliveringBatch = false;
 };
 
 /**
@@ -189,12 +308,27 @@ Curl.prototype._onData    = function( chunk ) {
 
     var ret;
 
+    //libcurl keeps the chunk and gives it again when the stream is read
+    if ( this._isReadableFull && !this._isDeliveringBatch ) {
+
+        this._isRecvPaused = true;
+        this._pauseState |= Curl.pause.RECV;
+
+        return Curl.WRITEFUNC_PAUSE;
+    }
+
     if ( typeof this.onData == 'function' )
         ret = this.onData( chunk );
     else
         throw Error( 'onData must be a function.' );
 
-    if ( !( this.features & features.NO_DATA_STORAGE ) ) {
+    if ( this._readable ) {
+
+        if ( !this._readable.push( chunk ) )
+            _onReadableFull( this );
+
+    } else if ( !( this.features & features.NO_DATA_STORAGE ) ) {
+
         this._chunks.push( chunk );
         this._chunksLength += chunk.length;
     }
@@ -229,6 +363,36 @@ Curl.prototype._onHeader  = function( chunk ) {
     return ret;
 };
 
+/**
+ * Called once after each socket action with all the chunks received on it, when BATCH_CALLBACKS is enabled.
+ * @param {Buffer} data All chunks, one after another.
+ * @param {Array.<Number>} ends Offset where each chunk ends.
+ * @returns {Number} Amount of data consumed, anything different than data.length aborts the request.
+ * @private
+ */
+Curl.prototype._onDataBatch = function( data, ends ) {
+
+    var consumed;
+
+    this._isDeliveringBatch = true;
+    consumed = _deliverBatch( this, this._onData, data, ends );
+    this._isDeliveringBatch = false;
+
+    return consumed;
+};
+
+/**
+ * Same than {@link _onDataBatch} but for the headers.
+ * @param {Buffer} data
+ * @param {Array.<Number>} ends
+ * @returns {Number}
+ * @private
+ */
+Curl.prototype._onHeaderBatch = function( data, ends ) {
+
+    return _deliverBatch( this, this._onHeader, data, ends );
+};
+
 /**
  * Event called when a error is thrown on this handler.
  * @param {Error} err Exception obj
@@ -237,18 +401,36 @@ Curl.prototype._onHeader  = function( chunk ) {
  */
 Curl.prototype._onError = function( err, errCode ) {
 
-    var self = this;
+    var self = this,
+        readable = self._readable;
 
     self._isRunning = false;
+    self._uploadStream = null;
+
+    _releaseSink( self );
+    _releaseReadable( self );
+
+    //what happened before the error
+    if ( self._isTraceEnabled )
+        err.trace = self._getTrace();
+
+    if ( readable )
+        readable.emit( 'error', err );
 
-    self.emit( 'error', err, errCode );
+    //with a stream, the error can be handled on it only
+    if ( !readable || self.listeners( 'error' ).length )
+        self.emit( 'error', err, errCode );
 };
 
 /**
  * Called when this handler has finished the connection.
+ * @param {Buffer} [nativeData] Body stored by the native side, when NATIVE_DATA_STORAGE is enabled.
+ * @param {Buffer} [nativeHeader] Headers stored by the native side, when NATIVE_HEADER_PARSING is enabled.
+ * @param {Buffer} [nativeHeaderIndex] Index of the header fields, when NATIVE_HEADER_PARSING is enabled.
+ * @param {Number} [sinkBytes] Bytes of the body written to the sink, when one is set.
  * @private
  */
-Curl.prototype._onEnd = function() {
+Curl.prototype._onEnd = function( nativeData, nativeHeader, nativeHeaderIndex, sinkBytes ) {
 
     var data, header,
         argBody, argHeader, status,
@@ -258,10 +440,34 @@ Curl.prototype._onEnd = function() {
         isHeaderParsingEnabled = !(this.features & features.NO_HEADER_PARSING) && isHeaderStorageEnabled,
         isDataParsingEnabled   = !(this.features & features.NO_DATA_PARSING) && isDataStorageEnabled;
 
+    var readable = this._readable;
+
     this._isRunning = false;
+    this._uploadStream = null;
+
+    _releaseSink( this );
+    _releaseReadable( this );
+
+    if ( readable )
+        readable.push( null );
+
+    if ( nativeData ) {
+
+        data = nativeData;
+
+    } else {
 
-    data = isDataStorageEnabled ? _mergeChunks( this._chunks, this._chunksLength ) : new Buffer(0);
-    header = isHeaderStorageEnabled ? _mergeChunks( this._headerChunks, this._headerChunksLength ) : new Buffer(0);
+        data = isDataStorageEnabled ? _mergeChunks( this._chunks, this._chunksLength ) : new Buffer(0);
+    }
+
+    if ( nativeHeader ) {
+
+        header = nativeHeader;
+
+    } else {
+
+        header = isHeaderStorageEnabled ? _mergeChunks( this._headerChunks, this._headerChunksLength ) : new Buffer(0);
+    }
 
     this._chunks = [];
     this._headerChunks = [];
@@ -269,9 +475,22 @@ Curl.prototype._onEnd = function() {
     this._headerChunksLength = 0;
 
     argBody = isDataParsingEnabled ? decoder.write( data ) : data;
-    argHeader = isHeaderParsingEnabled ? _parseHeaders( decoder.write( header ) ) : header;
 
-    status = this._getInfo( Curl.info.RESPONSE_CODE );
+    if ( nativeHeaderIndex ) {
+
+        argHeader = CurlHeaders.fromIndex( header, nativeHeaderIndex );
+
+    } else {
+
+        argHeader = isHeaderParsingEnabled ? _parseHeaders( decoder.write( header ) ) : header;
+    }
+
+    //already copied by the native side when there is a snapshot
+    status = this._timings ? this._timings[Curl.timing.RESPONSE_CODE] : this._getInfo( Curl.info.RESPONSE_CODE );
+
+    //the body is on the sink, only the amount written is given
+    if ( sinkBytes !== undefined )
+        argBody = sinkBytes;
 
     self.emit( 'end', status, argBody, argHeader );
 };
@@ -300,6 +519,8 @@ Curl.prototype.enable = function( bitmask ) {
         throw Error( 'You should not change the features while a request is running.' );
 
     this.features |= bitmask;
+
+    this._setFeatures( this.features );
 };
 
 /**
@@ -313,6 +534,8 @@ Curl.prototype.disable = function( bitmask ) {
         throw Error( 'You should not change the features while a request is running.' );
 
     this.features &= ~bitmask;
+
+    this._setFeatures( this.features );
 };
 
 /**
@@ -326,6 +549,20 @@ Curl.prototype.setOpt = function( optionIdOrName, optionValue ) {
     return this._setOpt( optionIdOrName, optionValue );
 }
 
+/**
+ * Sets many options with a single native call.
+ * All values are validated before any option is set, if one is invalid an Error is thrown,
+ *  with the option that failed on its option property, and no option is changed.
+ * If libcurl refuses a valid value when it's set, the Error also has the libcurl code on its code property,
+ *  and the options before it stay set: only the validation is done for all of them at once.
+ * @param {Object|Array} options Object with option names as keys, or an array of [optionIdOrName, optionValue] pairs.
+ * @returns {Number} Amount of options set.
+ */
+Curl.prototype.setOpts = function( options ) {
+
+    return this._setOpts( options );
+};
+
 /**
  * @param {String|Number} infoNameOrId Info id or name. See {@link Curl.info} for predefined constants.
  * @returns {*} Return type is based on the info requested.
@@ -336,13 +573,105 @@ Curl.prototype.getInfo = function ( infoNameOrId ) {
 };
 
 /**
+ * Get many infos with a single call.
+ * @param {Array.<String|Number>} infoNamesOrIds
+ * @returns {Array} Values of the infos, in the same order.
+ */
+Curl.prototype.getInfos = function ( infoNamesOrIds ) {
+
+    return this._getInfos( infoNamesOrIds );
+};
+
+/**
+ * Copy the timing and transfer infos to the given array when each request finishes, before end or error are emitted.
+ * The values are at the indexes on Curl.timing, infos that could not be retrieved are set to -1.
+ * @param {Float64Array|null} timings Must have at least Curl.timing.COUNT elements, null removes it.
+ * @returns {Curl}
+ */
+Curl.prototype.setTimings = function ( timings ) {
+
+    this._setTimings( timings || null );
+    this._timings = timings || null;
+
+    return this;
+};
+
+/**
+ * Record the libcurl debug events of this handler natively, they are read with {@link Curl#getTrace}.
+ * When there is an error, the events recorded are also set on the trace property of the error.
+ * VERBOSE is enabled while tracing.
+ * @param {Object|null} options null stops tracing.
+ * @param {Number} [options.events=256] Amount of events kept, the oldest ones are dropped.
+ * @param {Number} [options.payloadSize=256] Bytes kept from the data of each event.
+ * @returns {Curl}
+ */
+Curl.prototype.setTrace = function ( options ) {
+
+    if ( !options ) {
+
+        this._setTrace( null );
+        this._isTraceEnabled = false;
+
+        return this;
+    }
+
+    this._setTrace( options.events || 256, options.payloadSize === undefined ? 256 : options.payloadSize );
+    this._isTraceEnabled = true;
+
+    return this;
+};
+
+/**
+ * Get the debug events recorded since the last call, see {@link Curl#setTrace}.
+ * Events have the time (ms, same clock used by process.hrtime), type (Curl.info.debug), size, and data,
+ *  a string for text and headers, a Buffer for the rest.
+ * @returns {{events: Array.<{time: Number, type: Number, size: Number, data: String|Buffer}>, dropped: Number}|null}
+ */
+Curl.prototype.getTrace = function () {
+
+    return this._getTrace();
+};
+
+/**
+ * Write the progress of this handler to a Float64Array, without calling js.
+ * dltotal, dlnow, ultotal and ulnow are written at slot * 4, so many handlers can share the same array.
+ * NOPROGRESS is set to false, the progress callback, if any, is still called.
+ * @param {Float64Array|null} array null stops writing to it.
+ * @param {Number} [slot=0]
+ * @returns {Curl}
+ */
+Curl.prototype.setProgressArray = function ( array, slot ) {
+
+    return this._setProgressArray( array || null, slot || 0 );
+};
+
+/**
+ * Set the label the transfers of this handler are recorded with on {@link Metrics}.
+ * @param {String|null} label null removes it.
+ * @returns {Curl}
+ */
+Curl.prototype.setMetricsLabel = function ( label ) {
+
+    return this._setMetricsLabel( label );
+};
+
+/**
+ * The callback receives dltotal, dlnow, ultotal and ulnow, and must return 0 to continue the transfer.
+ * NOPROGRESS must be set to false for it to be called.
  * @param {Function} cb
+ * @param {Object} [throttle] Call cb only when one of the limits is reached, and once when the transfer is complete.
+ * @param {Number} [throttle.interval=0] Minimum ms between the calls.
+ * @param {Number} [throttle.bytes=0] Minimum bytes transferred between the calls.
  * @returns {Number} cURL code.
  */
-Curl.prototype.setProgressCallback = function ( cb ) {
+Curl.prototype.setProgressCallback = function ( cb, throttle ) {
 
     var ret;
 
+    throttle = throttle || {};
+
+    this._setProgressThrottle( throttle.interval || 0, throttle.bytes || 0 );
+
     if ( Curl.VERSION_NUM >= 0x072000 ) {
 
         ret = this._setOpt( Curl.option.XFERINFOFUNCTION, cb );
@@ -355,6 +684,39 @@ Curl.prototype.setProgressCallback = function ( cb ) {
     return ret;
 };
 
+/**
+ * Set the multi handle this instance is going to be added to when performing.
+ * The multi is kept alive while it's set in this instance.
+ * @param {Multi} multi
+ * @returns {Curl}
+ */
+Curl.prototype.setMulti = function( multi ) {
+
+    this._setMulti( multi );
+
+    this._multi = multi;
+
+    return this;
+};
+
+/**
+ * @returns {Multi}
+ */
+Curl.prototype.getMulti = function() {
+
+    return this._multi;
+};
+
+/**
+ * Set the priority of the next requests, used when the multi has a scheduler, see {@link Multi#setScheduler}.
+ * @param {Number} priority One of Curl.Multi.priority.
+ * @returns {Curl}
+ */
+Curl.prototype.setPriority = function( priority ) {
+
+    return this._setPriority( priority );
+};
+
 /**
  * Add this instance to the processing queue.
  * @returns {Curl}
@@ -367,6 +729,7 @@ Curl.prototype.perform = function () {
     }
 
     this._isRunning = true;
+    this._pauseState &= ~Curl.pause.RECV;
 
     this._perform();
 
@@ -391,16 +754,179 @@ Curl.prototype.perform = function () {
  */
 Curl.prototype.pause = function( bitmask ) {
 
-    return this._pause( bitmask );
+    this._pause( bitmask );
+    this._pauseState = bitmask;
+
+    return this;
+};
+
+/**
+ * Set the body to be uploaded, read while the request is running, so it does not need to be fully in memory.
+ * The method is not changed, set UPLOAD (PUT) or POST. Without INFILESIZE / POSTFIELDSIZE,
+ *  the body is sent using chunked transfer encoding.
+ * The body is consumed by the request, it must be set again before performing another one.
+ * @param {stream.Readable|Buffer} source Readable stream, paused while the data was not sent yet, or a Buffer.
+ * @param {Number} [highWaterMark=1048576] Amount of bytes buffered natively before pausing the stream.
+ * @returns {Curl}
+ */
+Curl.prototype.setUploadStream = function( source, highWaterMark ) {
+
+    var self = this;
+
+    this._enableUpload( highWaterMark || 1024 * 1024 );
+
+    if ( Buffer.isBuffer( source ) ) {
+
+        this._writeUpload( source );
+        this._endUpload( false );
+
+        return this;
+    }
+
+    this._uploadStream = source;
+
+    source.on( 'data', function( chunk ) {
+
+        if ( self._uploadStream !== source )
+            return;
+
+        if ( !Buffer.isBuffer( chunk ) )
+            chunk = new Buffer( chunk );
+
+        if ( !self._writeUpload( chunk ) )
+            source.pause();
+    });
+
+    source.on( 'end', function() {
+
+        if ( self._uploadStream === source )
+            self._endUpload( false );
+    });
+
+    //aborts the transfer, that then fails with an error
+    source.on( 'error', function() {
+
+        if ( self._uploadStream === source )
+            self._endUpload( true );
+    });
+
+    return this;
+};
+
+/**
+ * Write the body received directly to a file, without passing it to js.
+ * The 'end' event is then emitted with the amount of bytes written in place of the body.
+ * @param {Object|null} options Pass null to remove the sink.
+ * @param {Number} [options.fd] File descriptor to write to, it's not closed.
+ * @param {String} [options.path] File to open, it's closed when the request ends.
+ * @param {String} [options.flags='w'] Used to open options.path.
+ * @param {Number} [options.mode=0666] Used to open options.path.
+ * @param {Number} [options.bufferSize=1048576] Amount of data buffered before writing, the writes do not block the event loop.
+ * @param {Boolean} [options.preallocate=false] Reserve the space on disk using the Content-Length, when known.
+ * @returns {Curl}
+ */
+Curl.prototype.setSink = function( options ) {
+
+    if ( this._isRunning )
+        throw Error( 'Cannot change the sink of a running Curl session.' );
+
+    _releaseSink( this, true );
+
+    if ( !options )
+        return this;
+
+    if ( typeof options.fd === 'number' ) {
+
+        this._sinkFd = options.fd;
+
+    } else if ( typeof options.path === 'string' ) {
+
+        this._sinkFd = fs.openSync( options.path, options.flags || 'w', options.mode );
+        this._isSinkOwned = true;
+
+    } else {
+
+        throw TypeError( 'The sink must have a fd or a path.' );
+    }
+
+    this._setSink( this._sinkFd, options.bufferSize || 1024 * 1024, !!options.preallocate );
+
+    return this;
+};
+
+/**
+ * Get the body of the next request as a Readable stream, instead of storing it.
+ * Receiving is paused while the stream is over its high water mark, so a slow consumer
+ *  does not make the body pile up in memory. The 'end' event is emitted with an empty body.
+ * Errors are emitted on the stream, and on this handler only if it has listeners for them.
+ * @param {Object} [options] Options of the stream.Readable.
+ * @param {Number} [options.highWaterMark=16384] Bytes buffered on the stream before pausing.
+ * @returns {stream.Readable}
+ */
+Curl.prototype.stream = function( options ) {
+
+    var self = this,
+        readable;
+
+    if ( this._isRunning )
+        throw Error( 'Cannot stream the body of a running Curl session.' );
+
+    if ( this._sinkFd !== null || ( this.features & features.NATIVE_DATA_STORAGE ) )
+        throw Error( 'The body is not passed to js, it cannot be streamed.' );
+
+    readable = new stream.Readable( options );
+
+    readable._read = function() {
+
+        if ( self._readable !== readable )
+            return;
+
+        self._isReadableFull = false;
+
+        if ( self._isRecvPaused ) {
+
+            self._isRecvPaused = false;
+            self.pause( self._pauseState & ~Curl.pause.RECV );
+        }
+    };
+
+    _releaseReadable( this );
+
+    this._readable = readable;
+
+    return readable;
+};
+
+/**
+ * Called when the upload buffered natively is below the high water mark again.
+ * @private
+ */
+Curl.prototype._onUploadDrain = function() {
+
+    if ( this._uploadStream )
+        this._uploadStream.resume();
 };
 
 /**
  * Reset this handler options to their defaults.
+ * Throws if a request is running.
  * @returns {Curl}
  */
 Curl.prototype.reset = function() {
 
-    return this._reset();
+    //throws while running, before anything is changed
+    this._reset();
+
+    this._share = null;
+    this._uploadStream = null;
+    this._timings = null;
+    this._isTraceEnabled = false;
+    this._pauseState = Curl.pause.CONT;
+
+    _releaseSink( this, true );
+    _releaseReadable( this );
+
+    return this;
 };
 
 /**
@@ -413,6 +939,8 @@ Curl.prototype.close = function() {
 
     this.removeAllListeners();
 
+    _releaseSink( this, true );
+
     this._close();
 };
 
@@ -424,4 +952,11 @@ process.on( 'exit', function() {
 
 });
 
+Curl.Headers = CurlHeaders;
+Curl.Multi = Multi;
+Curl.Share = Share;
+Curl.Pool = Pool;
+Curl.Template = Template;
+Curl.Metrics = Metrics;
+
 module.exports = Curl;
@@ -0,0 +1,252 @@
+/**
+ * Headers of a single response, parsed by the native side.
+ * Names and values are only decoded from the raw headers when they are read.
+ * @param {Buffer} arena Raw headers, as received.
+ * @param {Array} entries Flat list of [nameOffset, nameLength, valueOffset, valueLength, ...] for the fields of this response.
+ * @param {Array} [status] [offset, length] of the status line.
+ * @class
+ */
+function CurlHeaders( arena, entries, status ) {
+
+    this._arena = arena;
+    this._entries = entries;
+    this._status = status;
+
+    this._result = null;
+    this._names  = [];
+    this._values = [];
+
+    /**
+     * Amount of header fields.
+     * @type {Number}
+     */
+    this.length = entries.length / 4;
+}
+
+var readInt32 = require( 'os' ).endianness() === 'LE' ? Buffer.prototype.readInt32LE : Buffer.prototype.readInt32BE,
+    entrySize = 16; //4 int32 per entry, see Curl::CurlHeaderEntry
+
+/**
+ * Split the raw headers into one CurlHeaders for each response received (redirects, 100-continue, etc).
+ * @param {Buffer} arena Raw headers, as received.
+ * @param {Buffer} index Native index of the header fields.
+ * @returns {Array.<CurlHeaders>}
+ */
+CurlHeaders.fromIndex = function( arena, index ) {
+
+    var result = [],
+        entries = [],
+        status = null,
+        nameOffset, nameLength, valueOffset, valueLength,
+        pos, len;
+
+    for ( pos = 0, len = index.length; pos < len; pos += entrySize ) {
+
+        nameOffset  = readInt32.call( index, pos, true );
+        nameLength  = readInt32.call( index, pos + 4, true );
+        valueOffset = readInt32.call( index, pos + 8, true );
+        valueLength = readInt32.call( index, pos + 12, true );
+
+        //status line, a new response starts here
+        if ( nameLength === 0 ) {
+
+            if ( status || entries.length )
+                result.push( new CurlHeaders( arena, entries, status ) );
+
+            entries = [];
+            status = [valueOffset, valueLength];
+
+            continue;
+        }
+
+        entries.push( nameOffset, nameLength, valueOffset, valueLength );
+    }
+
+    if ( status || entries.length )
+        result.push( new CurlHeaders( arena, entries, status ) );
+
+    return result;
+};
+
+/**
+ * Status line, same format used by the js header parsing.
+ * @name CurlHeaders#result
+ * @type {{version: String, code: Number, reason: String}|undefined}
+ */
+Object.defineProperty( CurlHeaders.prototype, 'result', {
+    get : function() {
+
+        var line, first, second;
+
+        if ( !this._status )
+            return undefined;
+
+        if ( !this._result ) {
+
+            line = this._decode( this._status[0], this._status[1] );
+            first = line.indexOf( ' ' );
+            second = first === -1 ? -1 : line.indexOf( ' ', first + 1 );
+
+            this._result = {
+                'version' : first === -1 ? line : line.slice( 0, first ),
+                'code'    : first === -1 ? NaN : parseInt( line.slice( first + 1, second === -1 ? undefined : second ), 10 ),
+                'reason'  : second === -1 ? '' : line.slice( second + 1 )
+            };
+        }
+
+        return this._result;
+    }
+});
+
+/**
+ * @param {Number} start
+ * @param {Number} length
+ * @returns {String}
+ * @private
+ */
+CurlHeaders.prototype._decode = function( start, length ) {
+
+    return this._arena.toString( 'utf8', start, start + length );
+};
+
+/**
+ * Name of the field at the given position, as received.
+ * @param {Number} i
+ * @returns {String}
+ */
+CurlHeaders.prototype.nameAt = function( i ) {
+
+    var name = this._names[i];
+
+    if ( name === undefined ) {
+
+        name = this._names[i] = this._decode( this._entries[i * 4], this._entries[i * 4 + 1] );
+    }
+
+    return name;
+};
+
+/**
+ * Value of the field at the given position.
+ * @param {Number} i
+ * @returns {String}
+ */
+CurlHeaders.prototype.valueAt = function( i ) {
+
+    var value = this._values[i];
+
+    if ( value === undefined ) {
+
+        value = this._decode( this._entries[i * 4 + 2], this._entries[i * 4 + 3] );
+
+        //obsolete line folding
+        if ( value.indexOf( '\n' ) !== -1 )
+            value = value.replace( /\r?\n[ \t]+/g, ' ' );
+
+        this._values[i] = value;
+    }
+
+    return value;
+};
+
+/**
+ * Position of the next field with the given name, case-insensitive.
+ * @param {String} name Lower case name.
+ * @param {Number} from
+ * @returns {Number} -1 if not found.
+ * @private
+ */
+CurlHeaders.prototype._indexOf = function( name, from ) {
+
+    var i, len,
+        entries = this._entries,
+        nameLength = Buffer.byteLength( name );
+
+    for ( i = from, len = this.length; i < len; i++ ) {
+
+        //only decode names that can match
+        if ( entries[i * 4 + 1] === nameLength && this.nameAt( i ).toLowerCase() === name )
+            return i;
+    }
+
+    return -1;
+};
+
+/**
+ * Value of the first field with the given name, case-insensitive.
+ * @param {String} name
+ * @returns {String|undefined}
+ */
+CurlHeaders.prototype.get = function( name ) {
+
+    var i = this._indexOf( String( name ).toLowerCase(), 0 );
+
+    return i === -1 ? undefined : this.valueAt( i );
+};
+
+/**
+ * Values of all fields with the given name, case-insensitive, in the order they were received.
+ * @param {String} name
+ * @returns {Array.<String>}
+ */
+CurlHeaders.prototype.getAll = function( name ) {
+
+    var result = [],
+        i = -1;
+
+    name = String( name ).toLowerCase();
+
+    while ( ( i = this._indexOf( name, i + 1 ) ) !== -1 )
+        result.push( this.valueAt( i ) );
+
+    return result;
+};
+
+/**
+ * @param {String} name
+ * @returns {Boolean}
+ */
+CurlHeaders.prototype.has = function( name ) {
+
+    return this._indexOf( String( name ).toLowerCase(), 0 ) !== -1;
+};
+
+/**
+ * Names of all fields, as received.
+ * @returns {Array.<String>}
+ */
+CurlHeaders.prototype.names = function() {
+
+    var result = [],
+        i, len;
+
+    for ( i = 0, len = this.length; i < len; i++ )
+        result.push( this.nameAt( i ) );
+
+    return result;
+};
+
+/**
+ * Materialize all fields in the same format used by the js header parsing.
+ * Fields received more than once have their values joined by a comma.
+ * @returns {Object}
+ */
+CurlHeaders.prototype.toObject = function() {
+
+    var result = {},
+        i, len, name;
+
+    if ( this._status )
+        result.result = this.result;
+
+    for ( i = 0, len = this.length; i < len; i++ ) {
+
+        name = this.nameAt( i );
+
+        result[name] = result.hasOwnProperty( name ) ? result[name] + ', ' + this.valueAt( i ) : this.valueAt( i );
+    }
+
+    return result;
+};
+
+module.exports = CurlHeaders;
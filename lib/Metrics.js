@@ -0,0 +1,64 @@
+/**
+ * Latency histograms of the phases of the completed transfers, recorded natively, without any js call per request.
+ * The phases are dns, connect, tls, ttfb (time to the first byte) and total, each transfer is recorded
+ *  with the label set on its handle with {@link Curl#setMetricsLabel}.
+ * @namespace
+ */
+var Metrics = require( 'bindings' )( 'node-libcurl' ).Metrics;
+
+/**
+ * Start or stop recording the completed transfers. Disabled by default.
+ * @param {Boolean} [isEnabled=true]
+ * @returns {Metrics}
+ */
+Metrics.enable = function( isEnabled ) {
+
+    this._enable( isEnabled === undefined ? true : !!isEnabled );
+
+    return this;
+};
+
+/**
+ * Clear the recorded values.
+ * @returns {Metrics}
+ */
+Metrics.reset = function() {
+
+    this._reset();
+
+    return this;
+};
+
+/**
+ * Export the histograms on the Prometheus text format, with the phase and the label as labels.
+ * Only the buckets with values are written.
+ * @param {String} [name='curl_phase_duration_seconds'] Name of the metric.
+ * @returns {String}
+ */
+Metrics.toPrometheus = function( name ) {
+
+    return this._toPrometheus( name );
+};
+
+/**
+ * Compact binary copy of all the histograms, in the host byte order, see src/CurlMetrics.cc for the layout.
+ * @returns {Buffer}
+ */
+Metrics.getSnapshot = function() {
+
+    return this._getSnapshot();
+};
+
+/**
+ * Get a quantile of a phase, the value returned is the upper bound of its bucket.
+ * @param {String} phase dns, connect, tls, ttfb or total.
+ * @param {Number} quantile Between 0 and 1, 0.99 for the p99.
+ * @param {String} [label]
+ * @returns {Number} Seconds, 0 if nothing was recorded.
+ */
+Metrics.quantile = function( phase, quantile, label ) {
+
+    return this._quantile( phase, quantile, label );
+};
+
+module.exports = Metrics;
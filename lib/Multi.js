@@ -0,0 +1,115 @@
+/**
+ * Independent curl_multi handle, with its own connection cache, sockets and timer.
+ * Curl instances use the default one, see {@link Multi.getDefault}, unless another one is set with {@link Curl#setMulti}.
+ *
+ * With options.threads set, the transfers run on that amount of native threads instead of the main one,
+ * each one with its own curl_multi handle. Chunks received are delivered to js after each socket event, the same way
+ * than with Curl.feature.BATCH_CALLBACKS, and the progress and debug callbacks cannot be used.
+ * @param {Object} [options]
+ * @param {Number} [options.threads=0] Amount of worker threads, 0 runs the transfers on the main thread.
+ * @class
+ */
+var Multi = require( 'bindings' )( 'node-libcurl' ).Multi;
+
+/**
+ * @param {String|Number} optionIdOrName Option id or name. See {@link Multi.option} for predefined constants.
+ * @param {Number|Boolean} optionValue
+ * @returns {Number} cURL multi code for given call.
+ */
+Multi.prototype.setOpt = function( optionIdOrName, optionValue ) {
+
+    return this._setOpt( optionIdOrName, optionValue );
+};
+
+/**
+ * Amount of Curl instances currently running on this multi, including the ones waiting on the scheduler.
+ * @returns {Number}
+ */
+Multi.prototype.getCount = function() {
+
+    return this._getCount();
+};
+
+/**
+ * Limit the amount of transfers running on this multi. Curl instances performed over the limits wait natively,
+ * and are started as the running ones finish, by priority (see {@link Curl#setPriority}), and in the order
+ * they were performed within the same priority. Only the transfers performed after this is called are counted.
+ * @param {Object|null} options Pass null to start the ones waiting, and stop limiting.
+ * @param {Number} [options.maxTotal=0] Transfers running at the same time, 0 is unlimited.
+ * @param {Number} [options.maxPerHost=0] Transfers running at the same time against each host (and port), 0 is unlimited.
+ * @param {Boolean|Object} [options.adaptive] Adjust the limit of each host to its latency instead of using maxPerHost:
+ *  the limit grows while the time to the first byte stays near the lowest one seen, and shrinks when it goes up,
+ *  the transfer times out, cannot connect, or gets a 429 or 503 response. Pass true to use the defaults.
+ * @param {Number} [options.adaptive.initialLimit=4] Limit of the hosts without samples yet.
+ * @param {Number} [options.adaptive.minLimit=1]
+ * @param {Number} [options.adaptive.maxLimit=options.maxPerHost||1000]
+ * @param {Number} [options.adaptive.smoothing=0.2] Weight of each new limit, between 0 and 1.
+ * @param {Number} [options.adaptive.tolerance=1.5] Times the lowest latency accepted before the limit shrinks.
+ * @param {Number} [options.adaptive.backoff=0.9] The limit is multiplied by it on each failed transfer.
+ * @returns {Multi}
+ */
+Multi.prototype.setScheduler = function( options ) {
+
+    var adaptive;
+
+    if ( !options )
+        return this._setScheduler( null );
+
+    if ( options.adaptive ) {
+
+        adaptive = options.adaptive === true ? {} : options.adaptive;
+
+        adaptive = {
+            initialLimit : adaptive.initialLimit || 4,
+            minLimit     : adaptive.minLimit || 1,
+            maxLimit     : adaptive.maxLimit || options.maxPerHost || 1000,
+            smoothing    : adaptive.smoothing || 0.2,
+            tolerance    : adaptive.tolerance || 1.5,
+            backoff      : adaptive.backoff || 0.9
+        };
+
+        adaptive.initialLimit = Math.min( Math.max( adaptive.initialLimit, adaptive.minLimit ), adaptive.maxLimit );
+    }
+
+    return this._setScheduler( options.maxTotal || 0, options.maxPerHost || 0, adaptive );
+};
+
+/**
+ * Amount of transfers waiting and running on the scheduler, and how long they waited.
+ * With the adaptive limit, limits has the current limit of each host (by host:port), and the latencies it's based on.
+ * @returns {{queued: Number, queuedByPriority: Array.<Number>, running: Number, hosts: Number, started: Number, waitTimeMs: Number, maxWaitTimeMs: Number, limits: Object.<String, {limit: Number, running: Number, rttMs: Number, baselineRttMs: Number, totalTimeMs: Number, samples: Number}>}}
+ */
+Multi.prototype.getSchedulerStats = function() {
+
+    return this._getSchedulerStats();
+};
+
+/**
+ * Limit the finished transfers delivered to js (the end and error events) on each event loop iteration,
+ * the remaining ones are delivered on the next iterations, so many transfers finishing at once don't stall the loop.
+ * The time spent delivering them is on {@link Curl.getStats}: completionTimeNs, maxCompletionTimeNs and deferredCompletions.
+ * @param {Object|null} options Pass null to deliver all of them right away, the default.
+ * @param {Number} [options.maxCompletions=0] Finished transfers delivered on each iteration, 0 is unlimited.
+ * @param {Number} [options.maxTimeUs=0] Microseconds after which no more are delivered on the same iteration, 0 is unlimited.
+ *  It's checked between the transfers, the one that goes over is still delivered.
+ * @returns {Multi}
+ */
+Multi.prototype.setCompletionBudget = function( options ) {
+
+    options = options || {};
+
+    return this._setCompletionBudget( options.maxCompletions || 0, options.maxTimeUs || 0 );
+};
+
+/**
+ * Release the curl_multi handle, the connections it keeps open are closed.
+ * Throws if there are Curl instances still running on it.
+ * <strong>NOTE:</strong> After closing the multi, it should not be used anymore!
+ * @returns {Multi}
+ */
+Multi.prototype.close = function() {
+
+    return this._close();
+};
+
+module.exports = Multi;
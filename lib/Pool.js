@@ -0,0 +1,65 @@
+/**
+ * Keeps Curl instances alive between requests, so they, and their connections, can be reused.
+ * Released instances are reset and have the baseline options set again.
+ * @param {Object} [options]
+ * @param {Number} [options.max=64] Max amount of instances, leased and idle.
+ * @param {Number} [options.min=0] Instances created upfront, and never evicted.
+ * @param {Number} [options.maxIdle=max] Max amount of idle instances, the ones released after that are closed.
+ * @param {Number} [options.idleTimeout=30000] Time in ms after which an idle instance is closed, 0 to never close them.
+ * @param {Multi} [options.multi] Multi used by the instances, the default one if not given.
+ * @param {Object} [options.options] Curl options set on each instance, { optionName : value }.
+ * @class
+ */
+var Pool = require( 'bindings' )( 'node-libcurl' ).Pool;
+
+/**
+ * Get an idle instance, or a new one if there is none.
+ * @returns {Curl|null} null if the max amount of instances is leased.
+ */
+Pool.prototype.lease = function() {
+
+    return this._lease();
+};
+
+/**
+ * Give back a leased instance, it must not be running.
+ * <strong>NOTE:</strong> The instance should not be used after being released.
+ * @param {Curl} curl
+ * @returns {Boolean} true if the instance was kept, false if it was closed.
+ */
+Pool.prototype.release = function( curl ) {
+
+    var isKept;
+
+    //files opened for a sink that was never used are closed here
+    curl.setSink( null );
+
+    isKept = this._release( curl );
+
+    if ( isKept ) {
+
+        curl.removeAllListeners();
+        curl._resetState();
+    }
+
+    return isKept;
+};
+
+/**
+ * @returns {{leased: Number, idle: Number, created: Number, leases: Number, releases: Number, reuses: Number, evictions: Number}}
+ */
+Pool.prototype.getStats = function() {
+
+    return this._getStats();
+};
+
+/**
+ * Close the idle instances, the leased ones are closed when released.
+ * @returns {Pool}
+ */
+Pool.prototype.close = function() {
+
+    return this._close();
+};
+
+module.exports = Pool;
@@ -0,0 +1,28 @@
+/**
+ * Data shared between the Curl instances using it, set with the SHARE option.
+ * Which data is shared is set with the SHARE option, using the {@link Share.lock} constants.
+ * @class
+ */
+var Share = require( 'bindings' )( 'node-libcurl' ).Share;
+
+/**
+ * @param {String|Number} optionIdOrName SHARE or UNSHARE. See {@link Share.option} for predefined constants.
+ * @param {Number} lockData Data to start/stop sharing. See {@link Share.lock} for predefined constants.
+ * @returns {Number} cURL share code for given call.
+ */
+Share.prototype.setOpt = function( optionIdOrName, lockData ) {
+
+    return this._setOpt( optionIdOrName, lockData );
+};
+
+/**
+ * Release the curl_share handle. Throws if there are Curl instances still using it.
+ * <strong>NOTE:</strong> After closing the share, it should not be used anymore!
+ * @returns {Share}
+ */
+Share.prototype.close = function() {
+
+    return this._close();
+};
+
+module.exports = Share;
@@ -0,0 +1,42 @@
+/**
+ * Options of a configured Curl instance, used to create new instances that start with the same options.
+ * The instances are created with curl_easy_duphandle, and reference the strings, lists and httppost
+ *  of the template, instead of copying them.
+ * The features, the multi and the share of the given instance are also used by the new ones.
+ * @param {Curl} curl Instance with the options already set, it must not be running.
+ * @class
+ */
+var Template = require( 'bindings' )( 'node-libcurl' ).Template,
+    Curl = require( 'bindings' )( 'node-libcurl' ).Curl;
+
+/**
+ * Create a new Curl instance with the options of this template.
+ * @returns {Curl}
+ */
+Template.prototype.create = function() {
+
+    var curl = new Curl( this );
+
+    //the native side already uses the share, this keeps it alive
+    curl._share = this._share;
+
+    if ( this.features )
+        curl.enable( this.features );
+
+    if ( this._multi && this._multi !== curl.getMulti() )
+        curl.setMulti( this._multi );
+
+    return curl;
+};
+
+/**
+ * Release the template handle, instances can't be created from it anymore.
+ * The ones already created keep working.
+ * @returns {Template}
+ */
+Template.prototype.close = function() {
+
+    return this._close();
+};
+
+module.exports = Template;
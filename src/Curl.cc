@@ -1,15 +1,26 @@
 #include "Curl.h"
+#include "CurlStats.h"
+#include "CurlMetrics.h"
+#include "CurlTrace.h"
 
 #include <node_buffer.h>
 #include <curl/curl.h>
 #include <iostream>
 #include <stdlib.h>
 #include <string.h> //cstring?
+#include <ctype.h>
+#include <algorithm>
+
+#if defined( __linux__ )
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 // Set curl constants
 #include "generated-stubs/curlOptionsString.h"
 #include "generated-stubs/curlOptionsInteger.h"
 #include "generated-stubs/curlOptionsFunction.h"
+#include "generated-stubs/curlOptionsOfft.h"
 #include "generated-stubs/curlInfosString.h"
 #include "generated-stubs/curlInfosInteger.h"
 #include "generated-stubs/curlInfosDouble.h"
@@ -20,6 +31,7 @@
 #include "generated-stubs/curlHttp.h"
 
 
+//Lists implemented manually, keep in sync with the registry types on tools/generate-stubs.js
 #define X(name) {#name, CURLOPT_##name}
 Curl::CurlOption curlOptionsLinkedList[] = {
 #if LIBCURL_VERSION_NUM >= 0x070a03
@@ -42,6 +54,11 @@ Curl::CurlOption curlOptionsLinkedList[] = {
     X(PREQUOTE),
     X(TELNETOPTIONS)
 };
+
+//Options that receive another wrapped object
+Curl::CurlOption curlOptionsShare[] = {
+    X(SHARE)
+};
 #undef X
 
 #define X(name) {#name, CURLINFO_##name}
@@ -56,7 +73,8 @@ Curl::CurlOption curlHttpPostOptions[] = {
     X(NAME),
     X(FILE),
     X(CONTENTS),
-    X(TYPE)
+    X(TYPE),
+    X(FILENAME)
 };
 #undef X
 
@@ -67,8 +85,6 @@ void stringToUpper( std::string &s )
         s[i] = toupper( s[i] );
 }
 
-//Function that checks if given option is inside the given Curl::CurlOption struct, if it is, returns the optionId
-#define isInsideOption( options, option ) isInsideCurlOption( options, sizeof( options ), option )
 int isInsideCurlOption( const Curl::CurlOption *curlOptions, const int lenOfOption, const v8::Handle<v8::Value> &option ) {
 
     v8::HandleScope scope;
@@ -117,14 +133,17 @@ curlMapName infosMapName;
 
 //Initialize static properties
 v8::Persistent<v8::Function> Curl::constructor;
-CURLM  *Curl::curlMulti      = NULL;
-int     Curl::runningHandles = 0;
+v8::Persistent<v8::FunctionTemplate> Curl::constructorTemplate;
 int     Curl::count          = 0;
-std::map< CURL*, Curl* > Curl::curls;
-uv_timer_t Curl::curlTimeout;
+std::vector<Curl*> Curl::pendingFlush;
+Curl *Curl::flushing = NULL;
 
 int v8AllocatedMemoryAmount = 4*4096;
 
+//Biggest amount of memory that is going to be allocated upfront based on the Content-Length header.
+// Bigger bodies still work, the buffer just grows as the data arrives.
+const double maxDataBufferPresize = 64 * 1024 * 1024;
+
 // Add Curl constructor to the module exports
 void Curl::Initialize( v8::Handle<v8::Object> exports ) {
 
@@ -137,20 +156,6 @@ void Curl::Initialize( v8::Handle<v8::Object> exports ) {
         return;
     }
 
-    Curl::curlMulti = curl_multi_init();
-    if ( Curl::curlMulti == NULL ) {
-        Curl::Raise( "curl_multi_init failed!" );
-        return;
-    }
-
-    //init uv timer to be used with HandleTimeout
-    int timerStatus = uv_timer_init( uv_default_loop(), &Curl::curlTimeout );
-    assert( timerStatus == 0 );
-
-    //set curl_multi callbacks to use libuv
-    curl_multi_setopt( Curl::curlMulti, CURLMOPT_SOCKETFUNCTION, Curl::HandleSocket );
-    curl_multi_setopt( Curl::curlMulti, CURLMOPT_TIMERFUNCTION, Curl::HandleTimeout );
-
     //** Construct Curl js "class"
     v8::Handle<v8::FunctionTemplate> tpl = v8::FunctionTemplate::New( Curl::New );
 
@@ -159,14 +164,30 @@ void Curl::Initialize( v8::Handle<v8::Object> exports ) {
 
     // Prototype Methods
     NODE_SET_PROTOTYPE_METHOD( tpl, "_setOpt", Curl::SetOpt );
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_setOpts", Curl::SetOpts );
     NODE_SET_PROTOTYPE_METHOD( tpl, "_getInfo", Curl::GetInfo );
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_getInfos", Curl::GetInfos );
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_setTimings", Curl::SetTimings );
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_setMetricsLabel", Curl::SetMetricsLabel );
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_setTrace", Curl::SetTrace );
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_setProgressArray", Curl::SetProgressArray );
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_setProgressThrottle", Curl::SetProgressThrottle );
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_setPriority", Curl::SetPriority );
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_getTrace", Curl::GetTrace );
     NODE_SET_PROTOTYPE_METHOD( tpl, "_perform", Curl::Perform );
     NODE_SET_PROTOTYPE_METHOD( tpl, "_pause", Curl::Pause );
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_enableUpload", Curl::EnableUpload );
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_writeUpload", Curl::WriteUpload );
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_endUpload", Curl::EndUpload );
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_setSink", Curl::SetSink );
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_setFeatures", Curl::SetFeatures );
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_setMulti", Curl::SetMulti );
     NODE_SET_PROTOTYPE_METHOD( tpl, "_reset", Curl::Reset );
     NODE_SET_PROTOTYPE_METHOD( tpl, "_close", Curl::Close );
 
     // Static Methods
     NODE_SET_METHOD( tpl , "getCount" , GetCount );
+    NODE_SET_METHOD( tpl , "getStats" , GetStats );
     NODE_SET_METHOD( tpl , "getVersion" , GetVersion );
 
     // Export cURL Constants
@@ -182,7 +203,9 @@ void Curl::Initialize( v8::Handle<v8::Object> exports ) {
     Curl::ExportConstants( &optionsObj, curlOptionsString, sizeof( curlOptionsString ), &optionsMapId, &optionsMapName );
     Curl::ExportConstants( &optionsObj, curlOptionsInteger, sizeof( curlOptionsInteger ), &optionsMapId, &optionsMapName );
     Curl::ExportConstants( &optionsObj, curlOptionsFunction, sizeof( curlOptionsFunction ), &optionsMapId, &optionsMapName );
+    Curl::ExportConstants( &optionsObj, curlOptionsOfft, sizeof( curlOptionsOfft ), &optionsMapId, &optionsMapName );
     Curl::ExportConstants( &optionsObj, curlOptionsLinkedList, sizeof( curlOptionsLinkedList ), &optionsMapId, &optionsMapName );
+    Curl::ExportConstants( &optionsObj, curlOptionsShare, sizeof( curlOptionsShare ), &optionsMapId, &optionsMapName );
 
     Curl::ExportConstants( &infosObj, curlInfosString, sizeof( curlInfosString ), &infosMapId, &infosMapName );
     Curl::ExportConstants( &infosObj, curlInfosInteger, sizeof( curlInfosInteger ), &infosMapId, &infosMapName );
@@ -206,15 +229,18 @@ void Curl::Initialize( v8::Handle<v8::Object> exports ) {
 
     //Static members
     tplFunction->Set( v8::String::NewSymbol( "VERSION_NUM" ), v8::Integer::New( LIBCURL_VERSION_NUM ), static_cast<v8::PropertyAttribute>( v8::ReadOnly|v8::DontDelete ) );
+    tplFunction->Set( v8::String::NewSymbol( "WRITEFUNC_PAUSE" ), v8::Integer::New( CURL_WRITEFUNC_PAUSE ), static_cast<v8::PropertyAttribute>( v8::ReadOnly|v8::DontDelete ) );
     tplFunction->Set( v8::String::NewSymbol( "_v8m" ), v8::Integer::New( v8AllocatedMemoryAmount ), static_cast<v8::PropertyAttribute>( v8::ReadOnly|v8::DontDelete ) );
 
     //Creates the Constructor from the template and assign it to the static constructor property for future use.
+    Curl::constructorTemplate = v8::Persistent<v8::FunctionTemplate>::New( tpl );
     Curl::constructor = v8::Persistent<v8::Function>::New( tplFunction );
 
     exports->Set( v8::String::NewSymbol( "Curl" ), Curl::constructor );
 }
 
-Curl::Curl( v8::Handle<v8::Object> obj ) : isInsideMultiCurl( false )
+Curl::Curl( v8::Handle<v8::Object> obj, CurlTemplate *curlTemplate ) : isInsideMultiCurl( false ), multi( CurlMulti::GetDefault() ), isQueued( false ), priority( CurlScheduler::PRIORITY_NORMAL ), schedulerHost( NULL ), worker( NULL ), requestId( 0 ), detachResult( CURLE_OK ), isDisposed( false ), share( NULL ), pool( NULL ), curlTemplate( NULL ), features( 0 ), headerArena( 1024 ), headerIndex( 256 ), isQueuedForFlush( false ), uploadBuffer( 65536 ), uploadOffset( 0 ), uploadHighWaterMark( 0 ), isUploadEnabled( false ), isUploadEnded( false ), isUploadAborted( false ), isUploadPaused( false ), isUploadDrainNeeded( false ), pauseState( CURLPAUSE_CONT ), sinkFd( -1 ), sinkBufferSize( 0 ), sinkBytes( 0 ), isSinkPreallocateEnabled( false ), sinkWriteOffset( 0 ), isSinkWriting( false ), isSinkFailed( false ), isSinkPaused( false ), isSinkEndPending( false ), sinkEndResult( CURLE_OK ), timings( NULL ), metricsLabel( 0 ), trace( NULL ),
+    progressSlot( NULL ), progressInterval( 0 ), progressBytes( 0 ), lastProgressCall( 0 ), lastProgressAmount( 0 )
 {
     ++Curl::count;
 
@@ -223,11 +249,12 @@ Curl::Curl( v8::Handle<v8::Object> obj ) : isInsideMultiCurl( false )
     this->handle = v8::Persistent<v8::Object>::New( obj );
     handle.MakeWeak( this, Curl::Destructor );
 
-    this->curl = curl_easy_init();
+    //instances created from a template start with its options, and reference its storage instead of copying it
+    this->curl = curlTemplate ? curl_easy_duphandle( curlTemplate->curl ) : curl_easy_init();
 
     if ( !this->curl ) {
 
-        Curl::Raise( "curl_easy_init Failed!" );
+        Curl::Raise( curlTemplate ? "curl_easy_duphandle Failed!" : "curl_easy_init Failed!" );
         return;
     }
 
@@ -239,7 +266,11 @@ Curl::Curl( v8::Handle<v8::Object> obj ) : isInsideMultiCurl( false )
     curl_easy_setopt( this->curl, CURLOPT_HEADERFUNCTION, Curl::HeaderFunction );
     curl_easy_setopt( this->curl, CURLOPT_HEADERDATA, this );
 
-    Curl::curls[curl] = this;
+    //used by the multi to find the instance of a finished transfer
+    curl_easy_setopt( this->curl, CURLOPT_PRIVATE, this );
+
+    if ( curlTemplate )
+        curlTemplate->Apply( this );
 }
 
 Curl::~Curl(void)
@@ -254,14 +285,31 @@ Curl::~Curl(void)
 
         if ( this->isInsideMultiCurl ) {
 
-            curl_multi_remove_handle( this->curlMulti, this->curl );
+            this->multi->RemoveHandle( this );
         }
 
-        Curl::curls.erase( this->curl );
         curl_easy_cleanup( this->curl );
 
     }
 
+    //only after the cleanup, so the share is not in use anymore
+    if ( this->share )
+        this->share->Unref();
+
+    if ( this->curlTemplate )
+        this->curlTemplate->Unref();
+
+    //closed while leased
+    if ( this->pool )
+        this->pool->OnCurlClosed( this );
+
+    if ( this->isQueuedForFlush )
+        Curl::pendingFlush.erase( std::remove( Curl::pendingFlush.begin(), Curl::pendingFlush.end(), this ), Curl::pendingFlush.end() );
+
+    //closed while its staged chunks were being delivered
+    if ( Curl::flushing == this )
+        Curl::flushing = NULL;
+
     for ( std::vector<curl_slist*>::iterator it = this->curlLinkedLists.begin(), end = this->curlLinkedLists.end(); it != end; ++it ) {
 
         curl_slist *linkedList = *it;
@@ -274,6 +322,12 @@ Curl::~Curl(void)
 
     //dispose persistent callbacks
     this->DisposeCallbacks();
+
+    this->SetPostFieldsBuffer( v8::Handle<v8::Object>() );
+    this->SetTimingsArray( v8::Handle<v8::Object>() );
+    this->SetProgressArray( v8::Handle<v8::Object>(), 0 );
+
+    delete this->trace;
 }
 
 //Dispose persistent handler, and delete itself
@@ -284,189 +338,284 @@ void Curl::Dispose()
     this->handle.Dispose();
     this->handle.Clear();
 
+    //the callbacks can still be running on the worker thread, the multi deletes it when the worker lets the handle go
+    if ( this->worker ) {
+
+        this->isDisposed = true;
+        this->multi->RemoveHandle( this );
+
+        return;
+    }
+
+    //the thread pool is writing the sink buffer, deleted when the write finishes
+    if ( this->isSinkWriting ) {
+
+        this->isDisposed = true;
+
+        if ( this->isInsideMultiCurl )
+            this->multi->RemoveHandle( this );
+
+        return;
+    }
+
     delete this;
 }
 
-//The curl_multi_socket_action(3) function informs the application about updates
-//  in the socket (file descriptor) status by doing none, one, or multiple calls to this function
-int Curl::HandleSocket( CURL *easy, curl_socket_t s, int action, void *userp, void *socketp )
+//Delivers the chunks staged on the last socket action, one js call for each handle.
+void Curl::FlushPending()
 {
-    CurlSocketContext *ctx;
-    uv_err_s error;
+    while ( !Curl::pendingFlush.empty() ) {
 
-    if ( action == CURL_POLL_IN || action == CURL_POLL_OUT || action == CURL_POLL_INOUT || action == CURL_POLL_NONE ) {
+        Curl *obj = Curl::pendingFlush.back();
+        Curl::pendingFlush.pop_back();
 
-        //create ctx if it doesn't exists and assign it to the current socket,
-        ctx = ( socketp ) ? static_cast<Curl::CurlSocketContext*>(socketp) : Curl::CreateCurlSocketContext( s );
-        curl_multi_assign( Curl::curlMulti, s, static_cast<void*>( ctx ) );
+        obj->isQueuedForFlush = false;
 
-        //set event based on the current action
-        int events = 0;
+        if ( Curl::FlushStaged( obj ) == FLUSH_ABORTED && obj->isInsideMultiCurl ) {
 
-        switch ( action ) {
+            //same behavior than returning a wrong length from the write callback
+            obj->multi->RemoveHandle( obj );
 
-        case CURL_POLL_IN:
-            events |= UV_READABLE;
-            break;
-        case CURL_POLL_OUT:
-            events |= UV_WRITABLE;
-            break;
-        case CURL_POLL_INOUT:
-            events |= UV_READABLE | UV_WRITABLE;
-            break;
+            obj->OnError( CURLE_WRITE_ERROR );
         }
-
-        //call process when possible
-        return uv_poll_start( &ctx->pollHandle, events, Curl::Process );
     }
+}
 
-    //action == CURL_POLL_REMOVE
-    if ( action == CURL_POLL_REMOVE && socketp ) {
+//Delivers the staged headers, and then the staged data, of the given handle.
+int Curl::FlushStaged( Curl *obj )
+{
+    int result = FLUSH_OK;
 
-        ctx = static_cast<CurlSocketContext*>( socketp );
+    Curl::flushing = obj;
 
-        uv_poll_stop( &ctx->pollHandle );
-        curl_multi_assign( Curl::curlMulti, s, NULL );
+    if ( !obj->stagedHeaderEnds.empty() )
+        result = Curl::DeliverStaged( obj, obj->stagedHeader, obj->stagedHeaderEnds, "_onHeaderBatch" );
 
-        Curl::DestroyCurlSocketContext( ctx );
+    if ( result == FLUSH_OK && !obj->stagedDataEnds.empty() )
+        result = Curl::DeliverStaged( obj, obj->stagedData, obj->stagedDataEnds, "_onDataBatch" );
 
-        return 0;
+    if ( result == FLUSH_CLOSED )
+        return result;
+
+    Curl::flushing = NULL;
+
+    if ( result == FLUSH_ABORTED ) {
+
+        obj->stagedData.reset();
+        obj->stagedDataEnds.clear();
     }
 
-    //this should NEVER happen, I don't even know why this is here.
-    error = uv_last_error( uv_default_loop() );
-    std::cerr << uv_err_name( error ) << " " << uv_strerror( error );
-    abort();
+    return result;
 }
 
-//Creates a Context to be used to store data between events
-Curl::CurlSocketContext* Curl::CreateCurlSocketContext( curl_socket_t sockfd )
+//Calls the given js method with a single Buffer holding all the staged chunks and the offset where each one ends.
+int Curl::DeliverStaged( Curl *obj, CurlBuffer &staged, std::vector<size_t> &ends, const char *method )
 {
-    int r;
-    uv_err_s error;
-    Curl::CurlSocketContext *ctx = NULL;
-
-    ctx = static_cast<Curl::CurlSocketContext*>( malloc( sizeof( *ctx ) ) );
+    v8::HandleScope scope;
 
-    ctx->sockfd = sockfd;
+    double total = static_cast<double>( staged.length );
 
-    //uv_poll simply watches file descriptors using the operating system notification mechanism
-    //Whenever the OS notices a change of state in file descriptors being polled, libuv will invoke the associated callback.
-    r = uv_poll_init_socket( uv_default_loop(), &ctx->pollHandle, sockfd );
+    v8::Handle<v8::Array> chunkEnds = v8::Array::New( static_cast<int>( ends.size() ) );
 
-    if ( r == -1 ) {
+    for ( uint32_t i = 0, len = static_cast<uint32_t>( ends.size() ); i < len; ++i )
+        chunkEnds->Set( i, v8::Number::New( static_cast<double>( ends[i] ) ) );
 
-        error = uv_last_error( uv_default_loop() );
-        std::cerr << uv_err_name( error ) << uv_strerror( error );
-        abort();
+    ends.clear();
 
-    } else {
+    v8::Handle<v8::Value> argv[] = { staged.release(), chunkEnds };
+    v8::Handle<v8::Value> retVal;
 
-        ctx->pollHandle.data = ctx;
+    {
+        CurlStats::JsScope jsScope( CurlStats::BATCH_CALLBACKS );
+        retVal = node::MakeCallback( obj->handle, method, 2, argv );
     }
 
-    return ctx;
+    if ( Curl::flushing != obj )
+        return FLUSH_CLOSED;
+
+    if ( retVal.IsEmpty() || retVal->NumberValue() != total )
+        return FLUSH_ABORTED;
+
+    return FLUSH_OK;
 }
 
-//This function will be called when the timeout value changes from LibCurl.
-//The timeout value is at what latest time the application should call one of
-//the "performing" functions of the multi interface (curl_multi_socket_action(3) and curl_multi_perform(3)) - to allow libcurl to keep timeouts and retries etc to work.
-int Curl::HandleTimeout( CURLM *multi /* multi handle */ , long timeoutMs /* timeout in milliseconds */ , void *userp /* TIMERDATA */ )
+//Keeps a reference to the share being used, releasing the previous one.
+void Curl::SetShare( CurlShare *share )
 {
-    //A timeout value of -1 means that there is no timeout at all, and 0 means that the timeout is already reached.
-    if ( timeoutMs <= 0 )
-        timeoutMs = 1; //but we are going to wait a little
+    if ( share )
+        share->Ref();
 
-    return uv_timer_start( &Curl::curlTimeout, Curl::OnTimeout, timeoutMs, 0 );
+    if ( this->share )
+        this->share->Unref();
+
+    this->share = share;
 }
 
-//Function called when the previous timeout set reaches 0
-void Curl::OnTimeout( uv_timer_t *req, int status )
+//Keep the Buffer used by POSTFIELDS alive, an empty handle releases the current one.
+void Curl::SetPostFieldsBuffer( v8::Handle<v8::Object> buffer )
 {
-    //timeout expired, let libcurl update handlers and timeouts
-    curl_multi_socket_action( Curl::curlMulti, CURL_SOCKET_TIMEOUT, 0, &Curl::runningHandles );
+    if ( !this->postFieldsBuffer.IsEmpty() ) {
+        this->postFieldsBuffer.Dispose();
+        this->postFieldsBuffer.Clear();
+    }
 
-    Curl::ProcessMessages();
+    if ( !buffer.IsEmpty() )
+        this->postFieldsBuffer = v8::Persistent<v8::Object>::New( buffer );
 }
 
-//Called when libcurl thinks there is something to process
-void Curl::Process( uv_poll_t* handle, int status, int events )
+//Host and port of the URL set, the scheduler of the multi limits the transfers running against each one.
+std::string Curl::GetHostKey() const
 {
-    //stop the timer, so curl_multi_socket_action is fired without a socket by the timeout cb
-    uv_timer_stop( &Curl::curlTimeout );
+    const std::string *url = NULL;
 
-    int flags = 0;
+    std::map<int, std::string>::const_iterator it = this->curlStrings.find( CURLOPT_URL );
 
-    CURLMcode code;
+    if ( it != this->curlStrings.end() )
+        url = &it->second;
+    else if ( this->curlTemplate )
+        url = this->curlTemplate->GetString( CURLOPT_URL );
 
-    if ( events & UV_READABLE ) flags |= CURL_CSELECT_IN;
-    if ( events & UV_WRITABLE ) flags |= CURL_CSELECT_OUT;
+    if ( !url )
+        return std::string();
 
-    CurlSocketContext *ctx;
+    size_t start = url->find( "://" );
+    start = ( start == std::string::npos ) ? 0 : start + 3;
 
-    ctx = static_cast<CurlSocketContext*>( handle->data );
+    size_t end = url->find_first_of( "/?#", start );
 
-    do {
+    if ( end == std::string::npos )
+        end = url->length();
 
-        code = curl_multi_socket_action( Curl::curlMulti, ctx->sockfd, flags, &Curl::runningHandles );
+    //without the user info
+    size_t at = url->find( '@', start );
 
-    } while ( code == CURLM_CALL_MULTI_PERFORM ); //@todo is that loop really needed?
+    if ( at != std::string::npos && at < end )
+        start = at + 1;
 
-    if ( code != CURLM_OK ) {
+    std::string key = url->substr( start, end - start );
 
-        Curl::Raise( "curl_multi_socket_actioon Failed", curl_multi_strerror( code ) );
-        return;
+    for ( std::string::iterator c = key.begin(), keyEnd = key.end(); c != keyEnd; ++c )
+        *c = static_cast<char>( tolower( *c ) );
+
+    return key;
+}
+
+//Keep the Float64Array filled by SnapshotTimings alive, an empty handle releases the current one.
+void Curl::SetTimingsArray( v8::Handle<v8::Object> array )
+{
+    if ( !this->timingsArray.IsEmpty() ) {
+        this->timingsArray.Dispose();
+        this->timingsArray.Clear();
     }
 
-    Curl::ProcessMessages();
+    this->timings = NULL;
+
+    if ( !array.IsEmpty() ) {
+        this->timingsArray = v8::Persistent<v8::Object>::New( array );
+        this->timings = static_cast<double*>( array->GetIndexedPropertiesExternalArrayData() );
+    }
 }
 
-void Curl::ProcessMessages()
+//Infos copied to the timings array, in the order of the TIMING_* indexes
+static const CURLINFO timingsInfos[] = {
+    CURLINFO_TOTAL_TIME,
+    CURLINFO_NAMELOOKUP_TIME,
+    CURLINFO_CONNECT_TIME,
+    CURLINFO_APPCONNECT_TIME,
+    CURLINFO_PRETRANSFER_TIME,
+    CURLINFO_STARTTRANSFER_TIME,
+    CURLINFO_REDIRECT_TIME,
+    CURLINFO_SIZE_UPLOAD,
+    CURLINFO_SIZE_DOWNLOAD,
+    CURLINFO_SPEED_UPLOAD,
+    CURLINFO_SPEED_DOWNLOAD,
+    CURLINFO_RESPONSE_CODE,
+    CURLINFO_REDIRECT_COUNT
+};
+
+//Copy the timing and transfer infos to the timings array, if there is one. Infos that fail are set to -1.
+// Also counts the bytes sent by the request, libcurl has no callback for all of them,
+// and records the completed transfers on the metrics, when they are enabled.
+void Curl::SnapshotTimings( bool isCompleted )
 {
-    CURLMcode code;
-    CURLMsg *msg = NULL;
-    int pending = 0;
+    double uploaded = 0;
+    long requestSize = 0;
 
-    while( ( msg = curl_multi_info_read( Curl::curlMulti, &pending ) ) ) {
+    curl_easy_getinfo( this->curl, CURLINFO_SIZE_UPLOAD, &uploaded );
+    curl_easy_getinfo( this->curl, CURLINFO_REQUEST_SIZE, &requestSize );
 
-        if ( msg->msg == CURLMSG_DONE ) {
+    CurlStats::Add( CurlStats::BYTES_OUT, static_cast<int64_t>( uploaded ) + requestSize );
 
-            Curl *curl = Curl::curls[msg->easy_handle];
+    bool isRecorded = isCompleted && CurlMetrics::IsEnabled();
 
-            CURLcode statusCode = msg->data.result;
+    if ( !this->timings && !isRecorded )
+        return;
 
-            code = curl_multi_remove_handle( Curl::curlMulti, msg->easy_handle );
+    double values[TIMING_COUNT];
 
-            curl->isInsideMultiCurl = false;
+    for ( int i = 0; i < TIMING_COUNT; i++ ) {
 
-            if ( code != CURLM_OK ) {
-                Curl::Raise( "curl_multi_remove_handle Failed", curl_multi_strerror( code ) );
-                return;
-            }
+        CURLINFO info = timingsInfos[i];
+        CURLcode code;
 
-            if ( statusCode == CURLE_OK ) {
+        if ( ( info & CURLINFO_TYPEMASK ) == CURLINFO_DOUBLE ) {
 
-                curl->OnEnd();
+            double value;
+            code = curl_easy_getinfo( this->curl, info, &value );
+            values[i] = value;
 
-            } else {
+        } else {
 
-                curl->OnError( statusCode );
-            }
+            long value;
+            code = curl_easy_getinfo( this->curl, info, &value );
+            values[i] = static_cast<double>( value );
         }
+
+        if ( code != CURLE_OK )
+            values[i] = -1;
+    }
+
+    if ( this->timings )
+        memcpy( this->timings, values, sizeof( values ) );
+
+    if ( isRecorded )
+        CurlMetrics::Record( this->metricsLabel, values[TIMING_TOTAL_TIME], values[TIMING_NAMELOOKUP_TIME], values[TIMING_CONNECT_TIME], values[TIMING_APPCONNECT_TIME], values[TIMING_STARTTRANSFER_TIME] );
+}
+
+//Keep the Float64Array the progress is written to alive, an empty handle releases the current one.
+void Curl::SetProgressArray( v8::Handle<v8::Object> array, uint32_t slot )
+{
+    if ( !this->progressArray.IsEmpty() ) {
+        this->progressArray.Dispose();
+        this->progressArray.Clear();
+    }
+
+    this->progressSlot = NULL;
+
+    if ( !array.IsEmpty() ) {
+        this->progressArray = v8::Persistent<v8::Object>::New( array );
+        this->progressSlot = static_cast<double*>( array->GetIndexedPropertiesExternalArrayData() ) + slot * 4;
     }
 }
 
-//Called when libcurl thinks the socket can be destroyed
-void Curl::DestroyCurlSocketContext( Curl::CurlSocketContext* ctx )
+void Curl::SetTemplate( CurlTemplate *curlTemplate )
 {
-    uv_handle_t *handle = (uv_handle_t*) &ctx->pollHandle;
+    if ( curlTemplate )
+        curlTemplate->Ref();
 
-    uv_close( handle, Curl::OnCurlSocketClose );
+    if ( this->curlTemplate )
+        this->curlTemplate->Unref();
+
+    this->curlTemplate = curlTemplate;
 }
-void Curl::OnCurlSocketClose( uv_handle_t *handle )
+
+void Curl::QueueFlush()
 {
-    CurlSocketContext *ctx = static_cast<CurlSocketContext*>( handle->data );
-    free( ctx );
+    if ( this->isQueuedForFlush )
+        return;
+
+    this->isQueuedForFlush = true;
+    Curl::pendingFlush.push_back( this );
 }
 
 //Called by libcurl when some chunk of data (from body) is available
@@ -483,18 +632,114 @@ size_t Curl::HeaderFunction( char *ptr, size_t size, size_t nmemb, void *userdat
     return obj->OnHeader( ptr, size, nmemb );
 }
 
+//Called by libcurl when it wants more data to upload
+size_t Curl::ReadFunction( char *ptr, size_t size, size_t nmemb, void *userdata )
+{
+    Curl *obj = static_cast<Curl*>( userdata );
+    return obj->OnRead( ptr, size, nmemb );
+}
+
+size_t Curl::OnRead( char *data, size_t size, size_t nmemb )
+{
+    //the read function can be copied from a template, without the upload being enabled on this instance
+    if ( this->isUploadAborted || !this->isUploadEnabled )
+        return CURL_READFUNC_ABORT;
+
+    size_t available = this->uploadBuffer.length - this->uploadOffset;
+
+    if ( !available ) {
+
+        if ( this->isUploadEnded )
+            return 0;
+
+        //resumed when more data is written
+        this->isUploadPaused = true;
+        return CURL_READFUNC_PAUSE;
+    }
+
+    size_t n = std::min( size * nmemb, available );
+
+    memcpy( data, this->uploadBuffer.data + this->uploadOffset, n );
+    this->uploadOffset += n;
+
+    //the stream was paused because the buffer was full, ask for more when half of it was sent
+    if ( this->isUploadDrainNeeded && ( available - n ) <= this->uploadHighWaterMark / 2 ) {
+
+        this->isUploadDrainNeeded = false;
+
+        v8::HandleScope scope;
+        CurlStats::JsScope jsScope( CurlStats::UPLOAD_CALLBACKS );
+        node::MakeCallback( this->handle, "_onUploadDrain", 0, NULL );
+    }
+
+    return n;
+}
+
 size_t Curl::OnData( char *data, size_t size, size_t nmemb )
 {
     //@TODO If the callback close the connection, an error will be throw!
-    //@TODO Implement: From 7.18.0, the function can return CURL_WRITEFUNC_PAUSE which then will cause writing to this connection to become paused. See curl_easy_pause(3) for further details.
-    v8::HandleScope scope;
-
     size_t n = size * nmemb;
 
+    CurlStats::Add( CurlStats::BYTES_IN, n );
+
+    //body goes straight to the file, js only gets the amount of bytes written, on end.
+    if ( this->sinkFd >= 0 )
+        return this->WriteSink( data, n );
+
+    //body is kept on the native side and passed to js only on end, no js call per chunk.
+    if ( this->features & NATIVE_DATA_STORAGE ) {
+
+        if ( this->features & NO_DATA_STORAGE )
+            return n;
+
+        if ( !this->dataBuffer.length ) {
+
+            //first chunk, headers are already known, so we can presize the buffer with the Content-Length
+            double contentLength = -1;
+            curl_easy_getinfo( this->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD, &contentLength );
+
+            if ( contentLength > 0 && contentLength <= maxDataBufferPresize )
+                this->dataBuffer.reserve( static_cast<size_t>( contentLength ) );
+        }
+
+        //a write error ends the transfer when there is no memory for the body
+        return this->dataBuffer.append( data, n ) ? n : 0;
+    }
+
+    //running on a worker thread, delivered to js by the main thread, after the current socket action.
+    if ( this->worker ) {
+
+        if ( !this->stagedData.append( data, n ) )
+            return 0;
+
+        this->stagedDataEnds.push_back( this->stagedData.length );
+        this->worker->QueueStaged( this );
+
+        return n;
+    }
+
+    //delivered to js after the current socket action, together with the other chunks received on it.
+    if ( this->features & BATCH_CALLBACKS ) {
+
+        if ( !this->stagedData.append( data, n ) )
+            return 0;
+
+        this->stagedDataEnds.push_back( this->stagedData.length );
+        this->QueueFlush();
+
+        return n;
+    }
+
+    v8::HandleScope scope;
+
     node::Buffer *buffer = node::Buffer::New( data, n );
     v8::Handle<v8::Value> argv[] = { buffer->handle_ };
+    v8::Handle<v8::Value> retVal;
 
-    v8::Handle<v8::Value> retVal = node::MakeCallback( this->handle, "_onData", 1, argv );
+    {
+        CurlStats::JsScope jsScope( CurlStats::DATA_CALLBACKS );
+        retVal = node::MakeCallback( this->handle, "_onData", 1, argv );
+    }
 
     size_t ret = n;
 
@@ -504,19 +749,69 @@ size_t Curl::OnData( char *data, size_t size, size_t nmemb )
             ret = retVal->Int32Value();
     }
 
+    //js could not take the chunk, libcurl keeps it and gives it again once receiving is unpaused
+    if ( ret == CURL_WRITEFUNC_PAUSE )
+        this->pauseState |= CURLPAUSE_RECV;
+
     return ret;
 }
 
 
 size_t Curl::OnHeader( char *data, size_t size, size_t nmemb )
 {
-    v8::HandleScope scope;
-
     size_t n = size * nmemb;
 
+    CurlStats::Add( CurlStats::BYTES_IN, n );
+
+    //headers are stored and indexed on the native side, no js call per header line.
+    if ( this->features & NATIVE_HEADER_PARSING ) {
+
+        if ( this->features & NO_HEADER_STORAGE )
+            return n;
+
+        size_t offset = this->headerArena.length;
+
+        if ( !this->headerArena.append( data, n ) )
+            return 0;
+
+        if ( !( this->features & NO_HEADER_PARSING ) && !this->IndexHeaderLine( offset, n ) )
+            return 0;
+
+        return n;
+    }
+
+    if ( this->worker ) {
+
+        if ( !this->stagedHeader.append( data, n ) )
+            return 0;
+
+        this->stagedHeaderEnds.push_back( this->stagedHeader.length );
+        this->worker->QueueStaged( this );
+
+        return n;
+    }
+
+    if ( this->features & BATCH_CALLBACKS ) {
+
+        if ( !this->stagedHeader.append( data, n ) )
+            return 0;
+
+        this->stagedHeaderEnds.push_back( this->stagedHeader.length );
+        this->QueueFlush();
+
+        return n;
+    }
+
+    v8::HandleScope scope;
+
     node::Buffer * buffer = node::Buffer::New( data, n );
     v8::Handle<v8::Value> argv[] = { buffer->handle_ };
-    v8::Handle<v8::Value> retVal = node::MakeCallback( this->handle, "_onHeader", 1, argv );
+    v8::Handle<v8::Value> retVal;
+
+    {
+        CurlStats::JsScope jsScope( CurlStats::HEADER_CALLBACKS );
+        retVal = node::MakeCallback( this->handle, "_onHeader", 1, argv );
+    }
 
     size_t ret = n;
 
@@ -528,184 +823,525 @@ size_t Curl::OnHeader( char *data, size_t size, size_t nmemb )
     return ret;
 }
 
-void Curl::OnEnd()
+//libcurl calls the header callback once for each complete header line, so each call can be indexed on its own.
+// Returns false only when there was no memory to index it.
+bool Curl::IndexHeaderLine( size_t offset, size_t length )
 {
-    v8::HandleScope scope;
-
-    node::MakeCallback( this->handle, "_onEnd", 0, NULL );
-}
+    const char *line = this->headerArena.data + offset;
 
-void Curl::OnError( CURLcode errorCode )
-{
-    v8::HandleScope scope;
+    //strip the line terminator
+    while ( length && ( line[length - 1] == '\r' || line[length - 1] == '\n' ) )
+        --length;
 
-    v8::Handle<v8::Value> argv[] = { v8::Exception::Error( v8::String::New( curl_easy_strerror( errorCode ) ) ), v8::Integer::New( errorCode )  };
-    node::MakeCallback( this->handle, "_onError", 2, argv );
-}
+    //empty line, end of the current header group
+    if ( !length )
+        return true;
 
-void Curl::DisposeCallbacks()
-{
-    if ( !this->callbacks.progress.IsEmpty() ) {
-        this->callbacks.progress.Dispose();
-        this->callbacks.progress.Clear();
-    }
+    CurlHeaderEntry entry;
 
-    if ( !this->callbacks.xferinfo.IsEmpty() ) {
-        this->callbacks.xferinfo.Dispose();
-        this->callbacks.xferinfo.Clear();
-    }
+    if ( line[0] == ' ' || line[0] == '\t' ) {
 
-    if ( !this->callbacks.debug.IsEmpty() ) {
-        this->callbacks.debug.Dispose();
-        this->callbacks.debug.Clear();
-    }
-}
+        //obsolete line folding, the previous field value continues on this line.
+        if ( this->headerIndex.length ) {
 
-//Export Options/Infos to constants in the given Object, and add their mapping to the respective maps.
-template<typename T>
-void Curl::ExportConstants( T *obj, Curl::CurlOption *optionGroup, uint32_t len, curlMapId *mapId, curlMapName *mapName )
-{
-    v8::HandleScope scope;
+            CurlHeaderEntry *last = reinterpret_cast<CurlHeaderEntry*>( this->headerIndex.data + this->headerIndex.length ) - 1;
 
-    len = len / sizeof( Curl::CurlOption );
+            if ( last->nameLength )
+                last->valueLength = static_cast<int32_t>( offset + length ) - last->valueOffset;
+        }
 
-    if ( !obj ) { //Null pointer, just stop
-        return; //
+        return true;
     }
 
-    for ( uint32_t i = 0; i < len; ++i ) {
-
-        const Curl::CurlOption &option = optionGroup[i];
+    if ( length > 5 && strncmp( line, "HTTP/", 5 ) == 0 ) {
 
-        const int32_t *optionId = &option.value;
+        entry.nameOffset  = static_cast<int32_t>( offset );
+        entry.nameLength  = 0;
+        entry.valueOffset = static_cast<int32_t>( offset );
+        entry.valueLength = static_cast<int32_t>( length );
 
-        //I don't like to mess with memory
-        std::string sOptionName( option.name );
+    } else {
 
+        //only the first colon separates the name, values can have any number of them.
+        const char *colon = static_cast<const char*>( memchr( line, ':', length ) );
 
-        (*obj)->Set(
-            v8::String::New( ( sOptionName ).c_str() ),
-            v8::Integer::New( option.value ),
-            static_cast<v8::PropertyAttribute>( v8::ReadOnly | v8::DontDelete )
-        );
+        //not a header field
+        if ( !colon || colon == line )
+            return true;
 
-        //add to vector, and add pointer to respective map
-        //using insert because of http://stackoverflow.com/a/16436560/710693
-        if ( mapId && mapName ) {
-            mapName->insert( std::make_pair( sOptionName, optionId ) );
-            mapId->insert( std::make_pair( optionId, sOptionName ) );
-        }
-    }
-}
+        size_t nameLength = colon - line;
+        size_t valueStart = nameLength + 1;
+        size_t valueEnd   = length;
 
-// traits class to determine whether to do the check
-template <typename> struct ResultCanBeNull : std::false_type {};
-template <> struct ResultCanBeNull<char*> : std::true_type {};
+        while ( nameLength && ( line[nameLength - 1] == ' ' || line[nameLength - 1] == '\t' ) )
+            --nameLength;
 
-template<typename TResultType, typename Tv8MappingType>
-v8::Handle<v8::Value> Curl::GetInfoTmpl( const Curl &obj, int infoId )
-{
-    v8::HandleScope scope;
+        while ( valueStart < valueEnd && ( line[valueStart] == ' ' || line[valueStart] == '\t' ) )
+            ++valueStart;
 
-    TResultType result;
+        while ( valueEnd > valueStart && ( line[valueEnd - 1] == ' ' || line[valueEnd - 1] == '\t' ) )
+            --valueEnd;
 
-    CURLINFO info = (CURLINFO) infoId;
-    CURLcode code = curl_easy_getinfo( obj.curl, info, &result );
+        if ( !nameLength )
+            return true;
 
-    if ( code != CURLE_OK ) {
-        Curl::Raise( "curl_easy_getinfo failed!", curl_easy_strerror( code ) );
-        return v8::Undefined();
+        entry.nameOffset  = static_cast<int32_t>( offset );
+        entry.nameLength  = static_cast<int32_t>( nameLength );
+        entry.valueOffset = static_cast<int32_t>( offset + valueStart );
+        entry.valueLength = static_cast<int32_t>( valueEnd - valueStart );
     }
 
-    if ( ResultCanBeNull<TResultType>::value && !result ) //null pointer
-        return scope.Close( v8::String::New( "" ) );
-
-    return scope.Close( Tv8MappingType::New( result ) );
+    return this->headerIndex.append( reinterpret_cast<const char*>( &entry ), sizeof( entry ) );
 }
 
-Curl* Curl::Unwrap( v8::Handle<v8::Object> value )
+//Discard everything stored natively for the current request.
+void Curl::ResetStorage()
 {
-    return static_cast<Curl*>( value->GetPointerFromInternalField( 0 ) );
+    this->dataBuffer.reset();
+    this->headerArena.reset();
+    this->headerIndex.reset();
+    this->stagedData.reset();
+    this->stagedHeader.reset();
+    this->stagedDataEnds.clear();
+    this->stagedHeaderEnds.clear();
+    this->sinkBuffer.reset();
+    this->sinkBytes = 0;
+    this->isSinkFailed = false;
+    this->isSinkPaused = false;
 }
 
-//Create a Exception with the given message and reason
-v8::Handle<v8::Value> Curl::Raise( const char *message, const char *reason )
+//Buffer a chunk for the sink. Returns size, 0 if the data could not be written,
+// or CURL_WRITEFUNC_PAUSE when both buffers are full, libcurl gives the same chunk again after the write finishes.
+size_t Curl::WriteSink( const char *data, size_t size )
 {
-    const char *what = message;
-    std::string msg;
-
-    if ( reason ) {
+    if ( this->isSinkFailed )
+        return 0;
 
-        msg = string_format( "%s: %s", message, reason );
-        what = msg.c_str();
+    if ( this->isSinkWriting && this->sinkBuffer.length >= this->sinkBufferSize ) {
 
+        this->isSinkPaused = true;
+        return CURL_WRITEFUNC_PAUSE;
     }
 
-    return v8::ThrowException( v8::Exception::Error( v8::String::New( what ) ) );
+    if ( this->isSinkPreallocateEnabled && !this->sinkBytes && !this->sinkBuffer.length && !this->isSinkWriting )
+        this->PreallocateSink();
+
+    if ( !this->sinkBuffer.append( data, size ) )
+        return 0;
+
+    if ( this->sinkBuffer.length < this->sinkBufferSize || this->isSinkWriting )
+        return size;
+
+    return this->FlushSink( false ) ? size : 0;
 }
 
-//Callbacks
-int Curl::CbProgress( void *clientp, double dltotal, double dlnow, double ultotal, double ulnow )
+//Write the buffered data to the sink, only whole blocks, unless it's the last flush.
+// On a threaded multi the writes are synchronous, on the worker thread. Otherwise the block is moved to sinkWriteBuffer
+// and written on the thread pool, the main thread does not wait for the disk. Returns false if the sink failed.
+bool Curl::FlushSink( bool isFinal )
 {
-    Curl *obj = static_cast<Curl *>( clientp );
+    CurlBuffer &buffer = this->sinkBuffer;
 
-    assert( obj );
+    size_t toWrite = isFinal ? buffer.length : ( buffer.length / sinkBlockSize ) * sinkBlockSize;
+    size_t written = 0;
 
-    if ( obj->callbacks.isProgressCbAlreadyAborted )
-        return 1;
+    if ( this->isSinkFailed )
+        return false;
 
-    v8::HandleScope scope;
+    if ( !this->worker ) {
 
-    int32_t retvalInt32;
+        if ( !toWrite || this->isSinkWriting )
+            return true;
 
-    v8::Handle<v8::Value> argv[] = {
-        v8::Number::New( (double) dltotal ),
-        v8::Number::New( (double) dlnow ),
-        v8::Number::New( (double) ultotal ),
-        v8::Number::New( (double) ulnow )
-    };
+        //the rest, less than a block, stays to be written with the next one
+        buffer.swap( this->sinkWriteBuffer );
 
-    //Should handle possible exceptions here?
-    v8::Handle<v8::Value> retval = obj->callbacks.progress->Call( obj->handle, 4, argv );
+        if ( !buffer.append( this->sinkWriteBuffer.data + toWrite, this->sinkWriteBuffer.length - toWrite ) ) {
 
-    if ( !retval->IsInt32() ) {
+            this->isSinkFailed = true;
+            return false;
+        }
 
-        Curl::Raise( "Return value from the progress callback must be an integer." ) ;
+        this->sinkWriteBuffer.length = toWrite;
+        this->sinkWriteOffset = 0;
+        this->isSinkWriting = true;
 
-        retvalInt32 = 1;
+        return this->WriteSinkBlock();
+    }
 
-    } else {
+    while ( written < toWrite ) {
 
-        retvalInt32 = retval->Int32Value();
+        uv_fs_t req;
+        int result = uv_fs_write( this->worker->GetLoop(), &req, this->sinkFd, buffer.data + written, toWrite - written, -1, NULL );
+        uv_fs_req_cleanup( &req );
+
+        if ( result <= 0 )
+            return false;
+
+        written += result;
     }
 
-    if ( retvalInt32 )
-        obj->callbacks.isProgressCbAlreadyAborted = true;
+    memmove( buffer.data, buffer.data + written, buffer.length - written );
+    buffer.length -= written;
 
-    return retvalInt32;
+    this->sinkBytes += written;
+
+    return true;
 }
 
-int Curl::CbXferinfo( void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow )
+//Start writing what is left of sinkWriteBuffer, OnSinkWritten is called when it's done.
+bool Curl::WriteSinkBlock()
 {
-    Curl *obj = static_cast<Curl *>( clientp );
+    CurlBuffer &block = this->sinkWriteBuffer;
 
-    assert( obj );
+    this->sinkRequest.data = this;
 
-    if ( obj->callbacks.isProgressCbAlreadyAborted )
+    if ( uv_fs_write( uv_default_loop(), &this->sinkRequest, this->sinkFd, block.data + this->sinkWriteOffset, block.length - this->sinkWriteOffset, -1, Curl::OnSinkWritten ) < 0 ) {
+
+        this->isSinkWriting = false;
+        this->isSinkFailed = true;
+
+        return false;
+    }
+
+    return true;
+}
+
+void Curl::OnSinkWritten( uv_fs_t *req )
+{
+    Curl *obj = static_cast<Curl*>( req->data );
+    ssize_t result = req->result;
+
+    uv_fs_req_cleanup( req );
+
+    if ( result > 0 ) {
+
+        obj->sinkWriteOffset += result;
+        obj->sinkBytes += result;
+
+        //partial write, the rest of the block
+        if ( obj->sinkWriteOffset < obj->sinkWriteBuffer.length && obj->WriteSinkBlock() )
+            return;
+    }
+
+    //the memory is kept for the next block
+    obj->isSinkWriting = false;
+    obj->isSinkFailed = obj->isSinkFailed || result <= 0;
+    obj->sinkWriteBuffer.length = 0;
+
+    if ( obj->isDisposed ) {
+
+        delete obj;
+        return;
+    }
+
+    //the transfer is over, the event was waiting for the write
+    if ( obj->isSinkEndPending ) {
+
+        obj->isSinkEndPending = false;
+
+        if ( obj->sinkEndResult == CURLE_OK ) {
+
+            obj->OnEnd();
+
+        } else {
+
+            obj->OnError( obj->sinkEndResult );
+        }
+
+        return;
+    }
+
+    //the next block filled up meanwhile
+    if ( obj->sinkBuffer.length >= obj->sinkBufferSize )
+        obj->FlushSink( false );
+
+    //libcurl gives the chunk it was holding again, and fails the transfer with it if the sink failed
+    if ( obj->isSinkPaused ) {
+
+        obj->isSinkPaused = false;
+
+        if ( obj->isInsideMultiCurl && !obj->isQueued )
+            curl_easy_pause( obj->curl, obj->pauseState );
+    }
+}
+
+//Reserve the space for the body on disk, using the Content-Length, when it's known.
+void Curl::PreallocateSink()
+{
+#if defined( __linux__ )
+    double contentLength = -1;
+    curl_easy_getinfo( this->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD, &contentLength );
+
+    if ( contentLength <= 0 )
+        return;
+
+    off_t offset = lseek( this->sinkFd, 0, SEEK_CUR );
+
+    //only an optimization, the writes work without it
+    if ( offset >= 0 )
+        posix_fallocate( this->sinkFd, offset, static_cast<off_t>( contentLength ) );
+#endif
+}
+
+void Curl::ResetUpload()
+{
+    this->uploadBuffer.reset();
+    this->uploadOffset = 0;
+    this->isUploadEnabled = false;
+    this->isUploadEnded = false;
+    this->isUploadAborted = false;
+    this->isUploadPaused = false;
+    this->isUploadDrainNeeded = false;
+}
+
+//Unpause the sending side, paused by OnRead when there was nothing to send.
+void Curl::ResumeUpload()
+{
+    if ( !this->isUploadPaused )
+        return;
+
+    this->isUploadPaused = false;
+
+    //the handle may have been added to the multi already, but not be running yet
+    if ( this->isInsideMultiCurl && !this->isQueued )
+        curl_easy_pause( this->curl, this->pauseState );
+}
+
+void Curl::OnEnd()
+{
+    v8::HandleScope scope;
+
+    v8::Handle<v8::Value> argv[] = { v8::Undefined(), v8::Undefined(), v8::Undefined(), v8::Undefined() };
+
+    if ( this->sinkFd >= 0 ) {
+
+        if ( !this->FlushSink( true ) ) {
+
+            this->OnError( CURLE_WRITE_ERROR );
+            return;
+        }
+
+        //the last blocks are still being written, js closes the file on the event
+        if ( this->isSinkWriting ) {
+
+            this->isSinkEndPending = true;
+            this->sinkEndResult = CURLE_OK;
+
+            return;
+        }
+
+        argv[3] = v8::Number::New( static_cast<double>( this->sinkBytes ) );
+    }
+
+    this->SnapshotTimings( true );
+
+    if ( ( this->features & NATIVE_DATA_STORAGE ) && !( this->features & NO_DATA_STORAGE ) ) {
+
+        //the whole body in a single Buffer, which now owns the memory
+        argv[0] = this->dataBuffer.release();
+    }
+
+    if ( ( this->features & NATIVE_HEADER_PARSING ) && !( this->features & NO_HEADER_STORAGE ) ) {
+
+        argv[1] = this->headerArena.release();
+
+        if ( !( this->features & NO_HEADER_PARSING ) )
+            argv[2] = this->headerIndex.release();
+    }
+
+    this->ResetStorage();
+
+    CurlStats::JsScope jsScope( CurlStats::END_CALLBACKS );
+    node::MakeCallback( this->handle, "_onEnd", 4, argv );
+}
+
+void Curl::OnError( CURLcode errorCode )
+{
+    v8::HandleScope scope;
+
+    //js closes the file on the event, after the write running on the thread pool
+    if ( this->isSinkWriting ) {
+
+        this->isSinkEndPending = true;
+        this->sinkEndResult = errorCode;
+
+        return;
+    }
+
+    this->SnapshotTimings( false );
+    this->ResetStorage();
+
+    v8::Handle<v8::Value> argv[] = { v8::Exception::Error( v8::String::New( curl_easy_strerror( errorCode ) ) ), v8::Integer::New( errorCode )  };
+
+    CurlStats::JsScope jsScope( CurlStats::ERROR_CALLBACKS );
+    node::MakeCallback( this->handle, "_onError", 2, argv );
+}
+
+void Curl::DisposeCallbacks()
+{
+    if ( !this->callbacks.progress.IsEmpty() ) {
+        this->callbacks.progress.Dispose();
+        this->callbacks.progress.Clear();
+    }
+
+    if ( !this->callbacks.xferinfo.IsEmpty() ) {
+        this->callbacks.xferinfo.Dispose();
+        this->callbacks.xferinfo.Clear();
+    }
+
+    if ( !this->callbacks.debug.IsEmpty() ) {
+        this->callbacks.debug.Dispose();
+        this->callbacks.debug.Clear();
+    }
+}
+
+//Export Options/Infos to constants in the given Object, and add their mapping to the respective maps.
+template<typename T>
+void Curl::ExportConstants( T *obj, Curl::CurlOption *optionGroup, uint32_t len, curlMapId *mapId, curlMapName *mapName )
+{
+    v8::HandleScope scope;
+
+    len = len / sizeof( Curl::CurlOption );
+
+    if ( !obj ) { //Null pointer, just stop
+        return; //
+    }
+
+    for ( uint32_t i = 0; i < len; ++i ) {
+
+        const Curl::CurlOption &option = optionGroup[i];
+
+        const int32_t *optionId = &option.value;
+
+        //I don't like to mess with memory
+        std::string sOptionName( option.name );
+
+
+        (*obj)->Set(
+            v8::String::New( ( sOptionName ).c_str() ),
+            v8::Integer::New( option.value ),
+            static_cast<v8::PropertyAttribute>( v8::ReadOnly | v8::DontDelete )
+        );
+
+        //add to vector, and add pointer to respective map
+        //using insert because of http://stackoverflow.com/a/16436560/710693
+        if ( mapId && mapName ) {
+            mapName->insert( std::make_pair( sOptionName, optionId ) );
+            mapId->insert( std::make_pair( optionId, sOptionName ) );
+        }
+    }
+}
+
+//also used by CurlMulti
+template void Curl::ExportConstants( v8::Handle<v8::Object> *obj, Curl::CurlOption *optionGroup, uint32_t len, curlMapId *mapId, curlMapName *mapName );
+
+// traits class to determine whether to do the check
+template <typename> struct ResultCanBeNull : std::false_type {};
+template <> struct ResultCanBeNull<char*> : std::true_type {};
+
+template<typename TResultType, typename Tv8MappingType>
+v8::Handle<v8::Value> Curl::GetInfoTmpl( const Curl &obj, int infoId )
+{
+    v8::HandleScope scope;
+
+    TResultType result;
+
+    CURLINFO info = (CURLINFO) infoId;
+    CURLcode code = curl_easy_getinfo( obj.curl, info, &result );
+
+    if ( code != CURLE_OK ) {
+        Curl::Raise( "curl_easy_getinfo failed!", curl_easy_strerror( code ) );
+        return v8::Undefined();
+    }
+
+    if ( ResultCanBeNull<TResultType>::value && !result ) //null pointer
+        return scope.Close( v8::String::New( "" ) );
+
+    return scope.Close( Tv8MappingType::New( result ) );
+}
+
+Curl* Curl::Unwrap( v8::Handle<v8::Object> value )
+{
+    return static_cast<Curl*>( value->GetPointerFromInternalField( 0 ) );
+}
+
+bool Curl::HasInstance( v8::Handle<v8::Value> value )
+{
+    return value->IsObject() && Curl::constructorTemplate->HasInstance( value );
+}
+
+//Create a Exception with the given message and reason
+v8::Handle<v8::Value> Curl::Raise( const char *message, const char *reason )
+{
+    const char *what = message;
+    std::string msg;
+
+    if ( reason ) {
+
+        msg = string_format( "%s: %s", message, reason );
+        what = msg.c_str();
+
+    }
+
+    return v8::ThrowException( v8::Exception::Error( v8::String::New( what ) ) );
+}
+
+//Callbacks
+int Curl::CbProgress( void *clientp, double dltotal, double dlnow, double ultotal, double ulnow )
+{
+    Curl *obj = static_cast<Curl *>( clientp );
+
+    assert( obj );
+
+    return obj->OnProgress( obj->callbacks.progress, dltotal, dlnow, ultotal, ulnow );
+}
+
+int Curl::CbXferinfo( void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow )
+{
+    Curl *obj = static_cast<Curl *>( clientp );
+
+    assert( obj );
+
+    return obj->OnProgress( obj->callbacks.xferinfo, (double) dltotal, (double) dlnow, (double) ultotal, (double) ulnow );
+}
+
+//Common part of the progress callbacks. The values are written to the progress array, if there is one,
+// and the js callback is called only when the throttle allows it.
+int Curl::OnProgress( v8::Persistent<v8::Function> &callback, double dltotal, double dlnow, double ultotal, double ulnow )
+{
+    if ( this->callbacks.isProgressCbAlreadyAborted )
         return 1;
 
+    if ( this->progressSlot ) {
+
+        this->progressSlot[0] = dltotal;
+        this->progressSlot[1] = dlnow;
+        this->progressSlot[2] = ultotal;
+        this->progressSlot[3] = ulnow;
+    }
+
+    if ( callback.IsEmpty() || !this->IsProgressCallDue( dltotal, dlnow, ultotal, ulnow ) )
+        return 0;
+
     v8::HandleScope scope;
 
     int32_t retvalInt32;
 
     v8::Handle<v8::Value> argv[] = {
-        v8::Number::New( (double) dltotal ),
-        v8::Number::New( (double) dlnow ),
-        v8::Number::New( (double) ultotal ),
-        v8::Number::New( (double) ulnow )
+        v8::Number::New( dltotal ),
+        v8::Number::New( dlnow ),
+        v8::Number::New( ultotal ),
+        v8::Number::New( ulnow )
     };
 
-    v8::Handle<v8::Value> retval = obj->callbacks.xferinfo->Call( obj->handle, 4, argv );
+    //Should handle possible exceptions here?
+    v8::Handle<v8::Value> retval;
+
+    {
+        CurlStats::JsScope jsScope( CurlStats::PROGRESS_CALLBACKS );
+        retval = callback->Call( this->handle, 4, argv );
+    }
 
     if ( !retval->IsInt32() ) {
 
@@ -719,17 +1355,48 @@ int Curl::CbXferinfo( void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_
     }
 
     if ( retvalInt32 )
-        obj->callbacks.isProgressCbAlreadyAborted = true;
+        this->callbacks.isProgressCbAlreadyAborted = true;
 
     return retvalInt32;
 }
 
+//If enough time passed, or enough bytes were transferred, since js was last called. Also true once when the transfer is complete.
+bool Curl::IsProgressCallDue( double dltotal, double dlnow, double ultotal, double ulnow )
+{
+    if ( !this->progressInterval && !this->progressBytes )
+        return true;
+
+    double amount = dlnow + ulnow;
+    uint64_t now = this->progressInterval ? uv_hrtime() : 0;
+
+    bool isComplete = ( dltotal > 0 && dlnow >= dltotal ) || ( ultotal > 0 && ulnow >= ultotal );
+
+    bool isDue = ( this->progressBytes && amount - this->lastProgressAmount >= this->progressBytes )
+        || ( this->progressInterval && now - this->lastProgressCall >= this->progressInterval )
+        || ( isComplete && amount != this->lastProgressAmount );
+
+    if ( isDue ) {
+
+        this->lastProgressCall = now;
+        this->lastProgressAmount = amount;
+    }
+
+    return isDue;
+}
+
 int Curl::CbDebug( CURL *handle, curl_infotype type, char *data, size_t size, void *userptr )
 {
-    Curl *obj = Curl::curls[handle];
+    Curl *obj = static_cast<Curl*>( userptr );
 
     assert( obj );
 
+    //recorded natively, there may be no js callback at all
+    if ( obj->trace )
+        obj->trace->Record( type, data, size );
+
+    if ( obj->callbacks.debug.IsEmpty() )
+        return 0;
+
     v8::HandleScope scope;
 
     v8::Handle<v8::Value> argv[] = {
@@ -737,7 +1404,12 @@ int Curl::CbDebug( CURL *handle, curl_infotype type, char *data, size_t size, vo
         v8::String::New( data, static_cast<int>(size) )
     };
 
-    v8::Handle<v8::Value> retval = obj->callbacks.debug->Call( obj->handle, 2, argv );
+    v8::Handle<v8::Value> retval;
+
+    {
+        CurlStats::JsScope jsScope( CurlStats::DEBUG_CALLBACKS );
+        retval = obj->callbacks.debug->Call( obj->handle, 2, argv );
+    }
 
     int32_t retvalInt = 0;
 
@@ -763,7 +1435,19 @@ v8::Handle<v8::Value> Curl::New( const v8::Arguments &args ) {
     if ( args.IsConstructCall() ) {
         // Invoked as constructor: `new Curl(...)`
 
-        Curl *obj = new Curl( args.This() );
+        CurlTemplate *curlTemplate = NULL;
+
+        if ( CurlTemplate::HasInstance( args[0] ) ) {
+
+            curlTemplate = CurlTemplate::Unwrap( args[0]->ToObject() );
+
+            if ( !curlTemplate || curlTemplate->IsClosed() ) {
+                Curl::Raise( "Template is closed." );
+                return v8::Undefined();
+            }
+        }
+
+        Curl *obj = new Curl( args.This(), curlTemplate );
 
         static v8::Persistent<v8::String> SYM_ON_CREATED = v8::Persistent<v8::String>::New( v8::String::NewSymbol( "_onCreated" ) );
         v8::Handle<v8::Value> cb = obj->handle->Get( SYM_ON_CREATED );
@@ -799,28 +1483,197 @@ v8::Handle<v8::Value> Curl::SetOpt( const v8::Arguments &args ) {
 
     Curl *obj = Curl::Unwrap( args.This() );
 
-    v8::Handle<v8::Value> opt   = args[0];
-    v8::Handle<v8::Value> value = args[1];
+    return scope.Close( Curl::SetOptInternal( obj, args[0], args[1] ) );
+}
 
-    v8::Handle<v8::Integer> optCallResult = v8::Integer::New( CURLE_FAILED_INIT );
+//Check if the value can be used with the given option, without changing anything.
+// Returns the exception that should be thrown, or an empty handle if the value is valid.
+v8::Handle<v8::Value> Curl::ValidateOpt( Curl *obj, const CurlRegistry::Entry *option, v8::Handle<v8::Value> value )
+{
+    v8::HandleScope scope;
 
-    int optionId;
+    if ( !option ) {
+        return scope.Close( v8::Exception::Error( v8::String::New(
+            "Unknown option given. First argument must be the option internal id or the option name. You can use the Curl.option constants."
+        ) ) );
+    }
 
-    //check if option is linked list, and the value is correct
-    if ( ( optionId = isInsideOption( curlOptionsLinkedList, opt ) ) ) {
+    switch ( option->type ) {
 
-        //special case, array of objects
-        if ( optionId == CURLOPT_HTTPPOST ) {
+        case CurlRegistry::LINKED_LIST:
 
-            std::string invalidArrayMsg = "Option value should be an Array of Objects.";
+            //special case, array of objects
+            if ( option->id == CURLOPT_HTTPPOST ) {
 
-            if ( !value->IsArray() ) {
-                v8::ThrowException(v8::Exception::TypeError(
-                    v8::String::New( invalidArrayMsg.c_str() )
-                ));
-                return v8::Undefined();
+                const char *invalidArrayMsg = "Option value should be an Array of Objects.";
+
+                if ( !value->IsArray() )
+                    return scope.Close( v8::Exception::TypeError( v8::String::New( invalidArrayMsg ) ) );
+
+                v8::Handle<v8::Array> rows = v8::Handle<v8::Array>::Cast( value );
+
+                // [{ key : val }]
+                for ( uint32_t i = 0, len = rows->Length(); i < len; ++i ) {
+
+                    // not an array of objects
+                    if ( !rows->Get( i )->IsObject() )
+                        return scope.Close( v8::Exception::TypeError( v8::String::New( invalidArrayMsg ) ) );
+
+                    v8::Handle<v8::Object> postData = v8::Handle<v8::Object>::Cast( rows->Get( i ) );
+
+                    const v8::Handle<v8::Array> props = postData->GetPropertyNames();
+
+                    for ( uint32_t j = 0, postDataLength = props->Length(); j < postDataLength; ++j ) {
+
+                        const v8::Handle<v8::Value> postDataKey = props->Get( j );
+
+                        v8::String::Utf8Value fieldName( postDataKey );
+
+                        int httpPostId = Curl::GetHttpPostFieldId( fieldName );
+
+                        //Property not found
+                        if ( httpPostId == -1 ) {
+
+                            std::string errorMsg = string_format( "Invalid property \"%s\" given.", *fieldName );
+                            return scope.Close( v8::Exception::Error( v8::String::New( errorMsg.c_str() ) ) );
+                        }
+
+                        const v8::Handle<v8::Value> postDataValue = postData->Get( postDataKey );
+
+                        //Contents can also be binary
+                        if ( httpPostId == CurlHttpPost::CONTENTS && node::Buffer::HasInstance( postDataValue ) )
+                            continue;
+
+                        //Check if value is a string.
+                        if ( !postDataValue->IsString() ) {
+
+                            std::string errorMsg = string_format( "Value for property \"%s\" should be a string.", *fieldName );
+                            return scope.Close( v8::Exception::Error( v8::String::New( errorMsg.c_str() ) ) );
+                        }
+                    }
+                }
+
+            } else if ( !value->IsNull() && !value->IsArray() ) {
+
+                return scope.Close( v8::Exception::TypeError( v8::String::New( "Option value should be an array." ) ) );
+            }
+
+            break;
+
+        case CurlRegistry::STRING:
+
+            //binary bodies are passed to libcurl without being copied
+            if ( option->id == CURLOPT_POSTFIELDS ) {
+
+                if ( !value->IsString() && !node::Buffer::HasInstance( value ) )
+                    return scope.Close( v8::Exception::TypeError( v8::String::New( "Option value should be a string or a Buffer." ) ) );
+
+            } else if ( !value->IsString() ) {
+
+                return scope.Close( v8::Exception::TypeError( v8::String::New( "Option value should be a string." ) ) );
+            }
+
+            break;
+
+        case CurlRegistry::OFFT:
+
+            if ( !value->IsNumber() )
+                return scope.Close( v8::Exception::TypeError( v8::String::New( "Option value should be a number." ) ) );
+
+            break;
+
+        case CurlRegistry::FUNCTION:
+
+            if ( !value->IsFunction() )
+                return scope.Close( v8::Exception::Error( v8::String::New( "Option value must be a function." ) ) );
+
+            break;
+
+        case CurlRegistry::SHARE:
+
+            if ( obj->isInsideMultiCurl )
+                return scope.Close( v8::Exception::Error( v8::String::New( "Cannot change the share of a running Curl session." ) ) );
+
+            if ( !value->IsNull() ) {
+
+                if ( !CurlShare::HasInstance( value ) ) {
+                    return scope.Close( v8::Exception::TypeError(
+                        v8::String::New( "Option value should be a Curl.Share instance or null." )
+                    ) );
+                }
+
+                CurlShare *share = CurlShare::Unwrap( value->ToObject() );
+
+                if ( !share || share->IsClosed() )
+                    return scope.Close( v8::Exception::Error( v8::String::New( "Share is closed." ) ) );
             }
 
+            break;
+
+        default:
+            //any value can be converted to integer
+            break;
+    }
+
+    return v8::Handle<v8::Value>();
+}
+
+//Returns the CurlHttpPost field with the given name, or -1 if there is none.
+int Curl::GetHttpPostFieldId( const v8::String::Utf8Value &fieldName )
+{
+    std::string optionName = std::string( *fieldName );
+    stringToUpper( optionName );
+
+    for ( uint32_t k = 0, kLen = sizeof( curlHttpPostOptions ) / sizeof( Curl::CurlOption ); k < kLen; ++k ) {
+
+        if ( curlHttpPostOptions[k].name == optionName )
+            return curlHttpPostOptions[k].value;
+    }
+
+    return -1;
+}
+
+//Set an option from a js value, also used to set options not given directly by js, like the baseline options of a pool.
+// On error an exception is thrown, and undefined returned.
+v8::Handle<v8::Value> Curl::SetOptInternal( Curl *obj, v8::Handle<v8::Value> opt, v8::Handle<v8::Value> value ) {
+
+    v8::HandleScope scope;
+
+    const CurlRegistry::Entry *option = CurlRegistry::FindOption( opt );
+
+    v8::Handle<v8::Value> error = Curl::ValidateOpt( obj, option, value );
+
+    if ( !error.IsEmpty() ) {
+        v8::ThrowException( error );
+        return v8::Undefined();
+    }
+
+    CURLcode code = Curl::ApplyOpt( obj, option, value );
+
+    if ( code != CURLE_OK ) {
+
+        Curl::Raise( curl_easy_strerror( code ) );
+        return v8::Undefined();
+    }
+
+    return scope.Close( v8::Integer::New( code ) );
+}
+
+//Set an option already checked with ValidateOpt.
+// Only errors returned by curl_easy_setopt can happen here, the code is returned and nothing is thrown.
+CURLcode Curl::ApplyOpt( Curl *obj, const CurlRegistry::Entry *option, v8::Handle<v8::Value> value ) {
+
+    v8::HandleScope scope;
+
+    v8::Handle<v8::Integer> optCallResult = v8::Integer::New( CURLE_FAILED_INIT );
+
+    int optionId = option->id;
+
+    if ( option->type == CurlRegistry::LINKED_LIST ) {
+
+        //special case, array of objects
+        if ( optionId == CURLOPT_HTTPPOST ) {
+
             CurlHttpPost &httpPost = obj->httpPost;
 
             v8::Handle<v8::Array> rows = v8::Handle<v8::Array>::Cast( value );
@@ -831,14 +1684,6 @@ v8::Handle<v8::Value> Curl::SetOpt( const v8::Arguments &args ) {
             // [{ key : val }]
             for ( uint32_t i = 0, len = rows->Length(); i < len; ++i ) {
 
-                // not an array of objects
-                if ( !rows->Get( i )->IsObject() ) {
-                    v8::ThrowException(v8::Exception::TypeError(
-                        v8::String::New( invalidArrayMsg.c_str() )
-                    ));
-                    return v8::Undefined();
-                }
-
                 v8::Handle<v8::Object> postData = v8::Handle<v8::Object>::Cast( rows->Get( i ) );
 
                 httpPost.append();
@@ -848,254 +1693,823 @@ v8::Handle<v8::Value> Curl::SetOpt( const v8::Arguments &args ) {
 
                 for ( uint32_t j = 0 ; j < postDataLength ; ++j ) {
 
-                    int httpPostId = -1;
-
                     const v8::Handle<v8::Value> postDataKey = props->Get( j );
                     const v8::Handle<v8::Value> postDataValue = postData->Get( postDataKey );
 
                     //convert postDataKey to field id
                     v8::String::Utf8Value fieldName( postDataKey );
-                    std::string optionName = std::string( *fieldName );
-                    stringToUpper( optionName );
+                    int httpPostId = Curl::GetHttpPostFieldId( fieldName );
 
-                    for ( uint32_t k = 0, kLen = sizeof( curlHttpPostOptions ) / sizeof( Curl::CurlOption ); k < kLen; ++k ) {
-
-                        if ( curlHttpPostOptions[k].name == optionName )
-                            httpPostId = curlHttpPostOptions[k].value;
+                    //sent from the Buffer memory, without copying it
+                    if ( node::Buffer::HasInstance( postDataValue ) ) {
 
+                        httpPost.setBuffer( postDataValue->ToObject() );
+                        continue;
                     }
 
-                    //Property not found
-                    if ( httpPostId == -1 ) {
+                    v8::String::Utf8Value postDataValueAsString( postDataValue );
 
-                        std::string errorMsg = string_format( "Invalid property \"%s\" given.", *fieldName );
-                        Curl::Raise( errorMsg.c_str() );
-                        return v8::Undefined();
-                    }
+                    httpPost.set( httpPostId, *postDataValueAsString, postDataValueAsString.length() );
+                }
+            }
 
+            optCallResult = v8::Integer::New( curl_easy_setopt( obj->curl, CURLOPT_HTTPPOST, obj->httpPost.first ) );
 
-                    //Check if value is a string.
-                    if ( !postDataValue->IsString() ) {
 
-                        std::string errorMsg = string_format( "Value for property \"%s\" should be a string.", *fieldName );
-                        Curl::Raise( errorMsg.c_str() );
-                        return v8::Undefined();
+        } else {
 
-                    }
+            if ( value->IsNull() ) {
+                optCallResult = v8::Integer::New(
+                    curl_easy_setopt(
+                        obj->curl, (CURLoption) optionId, NULL
+                    )
+                );
 
-                    v8::String::Utf8Value postDataValueAsString( postDataValue );
+            } else {
 
-                    httpPost.set( httpPostId, *postDataValueAsString, postDataValueAsString.length() );
+                //convert value to curl linked list (curl_slist)
+                curl_slist *slist = NULL;
+                v8::Handle<v8::Array> array = v8::Handle<v8::Array>::Cast( value );
+
+                for ( uint32_t i = 0, len = array->Length(); i < len; ++i )
+                {
+                    slist = curl_slist_append( slist, *v8::String::Utf8Value( array->Get( i ) ) );
                 }
+
+                obj->curlLinkedLists.push_back( slist );
+
+                optCallResult = v8::Integer::New(
+                    curl_easy_setopt(
+                        obj->curl, (CURLoption) optionId, slist
+                    )
+                );
             }
+        }
 
-            optCallResult = v8::Integer::New( curl_easy_setopt( obj->curl, CURLOPT_HTTPPOST, obj->httpPost.first ) );
+    } else if ( option->type == CurlRegistry::STRING && node::Buffer::HasInstance( value ) ) {
+
+        //POSTFIELDS is not copied by libcurl, the Buffer is kept alive until it's replaced
+        v8::Handle<v8::Object> buffer = value->ToObject();
+
+        obj->SetPostFieldsBuffer( buffer );
+        obj->curlStrings.erase( optionId );
+
+        //the data is not null terminated, so the size must be given
+        curl_easy_setopt( obj->curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t) node::Buffer::Length( buffer ) );
+
+        optCallResult = v8::Integer::New(
+            curl_easy_setopt(
+                obj->curl, CURLOPT_POSTFIELDS, node::Buffer::Data( buffer )
+            )
+        );
+
+    } else if ( option->type == CurlRegistry::STRING ) {
+
+        //Curl don't copies the string before version 7.17
+        v8::String::Utf8Value valueString( value );
+        int length = valueString.length();
+        obj->curlStrings[optionId] = std::string( *valueString, length );
+
+        //the size set for the Buffer does not apply to the string
+        if ( optionId == CURLOPT_POSTFIELDS && !obj->postFieldsBuffer.IsEmpty() ) {
+
+            obj->SetPostFieldsBuffer( v8::Handle<v8::Object>() );
+            curl_easy_setopt( obj->curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t) -1 );
+        }
+
+        optCallResult = v8::Integer::New(
+            curl_easy_setopt(
+                obj->curl, (CURLoption) optionId, obj->curlStrings[optionId].c_str()
+            )
+        );
+
+    } else if ( option->type == CurlRegistry::OFFT ) {
+
+        optCallResult = v8::Integer::New(
+            curl_easy_setopt(
+                obj->curl, (CURLoption) optionId, (curl_off_t) value->IntegerValue()
+            )
+        );
+
+    } else if ( option->type == CurlRegistry::INTEGER ) {
+
+        int32_t val = value->Int32Value();
+
+        //If not integer, but a not falsy value, val = 1
+        if ( !value->IsInt32() ) {
+            val = value->BooleanValue();
+        }
+
+        optCallResult = v8::Integer::New(
+            curl_easy_setopt(
+                obj->curl, (CURLoption) optionId, val
+            )
+        );
+
+    } else if ( option->type == CurlRegistry::FUNCTION ) {
+
+        v8::Handle<v8::Function> callback = value.As<v8::Function>();
+
+        switch ( optionId ) {
+
+#if LIBCURL_VERSION_NUM >= 0x072000
+            /* xferinfo was introduced in 7.32.0, no earlier libcurl versions will compile as they won't have the symbols around.
+                New libcurls will prefer the new callback and instead use that one even if both callbacks are set. */
+            case CURLOPT_XFERINFOFUNCTION:
+
+                obj->callbacks.xferinfo = v8::Persistent<v8::Function>::New( callback );
+                curl_easy_setopt( obj->curl, CURLOPT_XFERINFODATA, obj );
+                optCallResult = v8::Integer::New( curl_easy_setopt( obj->curl, CURLOPT_XFERINFOFUNCTION, Curl::CbXferinfo ) );
+
+                break;
+#endif
+
+            case CURLOPT_PROGRESSFUNCTION:
+
+                obj->callbacks.progress = v8::Persistent<v8::Function>::New( callback );
+                curl_easy_setopt( obj->curl, CURLOPT_PROGRESSDATA, obj );
+                optCallResult = v8::Integer::New( curl_easy_setopt( obj->curl, CURLOPT_PROGRESSFUNCTION, Curl::CbProgress ) );
+
+                break;
+
+            case CURLOPT_DEBUGFUNCTION:
+
+                obj->callbacks.debug = v8::Persistent<v8::Function>::New( callback );
+                curl_easy_setopt( obj->curl, CURLOPT_DEBUGDATA, obj );
+                optCallResult = v8::Integer::New( curl_easy_setopt( obj->curl, CURLOPT_DEBUGFUNCTION, Curl::CbDebug ) );
+
+                break;
+        }
+
+    } else if ( option->type == CurlRegistry::SHARE ) {
+
+        CurlShare *share = value->IsNull() ? NULL : CurlShare::Unwrap( value->ToObject() );
+
+        optCallResult = v8::Integer::New( curl_easy_setopt( obj->curl, CURLOPT_SHARE, share ? share->share : NULL ) );
+
+        if ( optCallResult->Int32Value() == CURLE_OK ) {
+
+            obj->SetShare( share );
+
+            //keep the share alive while it's being used
+            obj->handle->Set( v8::String::NewSymbol( "_share" ), value );
+        }
+    }
+
+    return (CURLcode) optCallResult->Int32Value();
+}
+
+//Set many options at once, given as an object, or as an array of [option, value] pairs.
+// All of them are validated before any is set, so an invalid value leaves the handle untouched.
+// libcurl can still refuse a valid value, in that case the options before it are kept, there is no way to read them back.
+// Errors have an option property, with the option that failed, and a code property when libcurl refused it.
+v8::Handle<v8::Value> Curl::SetOpts( const v8::Arguments &args ) {
+
+    v8::HandleScope scope;
+
+    Curl *obj = Curl::Unwrap( args.This() );
+
+    if ( !obj ) {
+        Curl::Raise( "Curl is closed." );
+        return v8::Undefined();
+    }
+
+    v8::Handle<v8::Value> opts = args[0];
+
+    if ( !opts->IsObject() ) {
+        v8::ThrowException(v8::Exception::TypeError(
+            v8::String::New( "Options should be an object, or an array of [option, value] pairs." )
+        ));
+        return v8::Undefined();
+    }
+
+    bool isPairs = opts->IsArray();
+
+    v8::Handle<v8::Object> optsObj = opts->ToObject();
+    v8::Handle<v8::Array> keys = isPairs ? v8::Handle<v8::Array>::Cast( opts ) : optsObj->GetPropertyNames();
+
+    uint32_t len = keys->Length();
+
+    std::vector< v8::Handle<v8::Value> > names( len );
+    std::vector< v8::Handle<v8::Value> > values( len );
+    std::vector< const CurlRegistry::Entry* > options( len );
+
+    //validate everything first
+    for ( uint32_t i = 0; i < len; ++i ) {
+
+        if ( isPairs ) {
+
+            v8::Handle<v8::Value> pair = keys->Get( i );
+
+            if ( !pair->IsArray() ) {
+                v8::ThrowException(v8::Exception::TypeError(
+                    v8::String::New( "Options should be an object, or an array of [option, value] pairs." )
+                ));
+                return v8::Undefined();
+            }
+
+            names[i] = pair->ToObject()->Get( 0 );
+            values[i] = pair->ToObject()->Get( 1 );
+
+        } else {
+
+            names[i] = keys->Get( i );
+            values[i] = optsObj->Get( names[i] );
+        }
+
+        //object keys are always strings, allow numeric ids there too
+        options[i] = CurlRegistry::FindOption( names[i] );
+
+        if ( !options[i] && !isPairs )
+            options[i] = CurlRegistry::FindOption( names[i]->ToInteger() );
+
+        v8::Handle<v8::Value> error = Curl::ValidateOpt( obj, options[i], values[i] );
 
+        if ( !error.IsEmpty() ) {
+
+            error->ToObject()->Set( v8::String::NewSymbol( "option" ), names[i] );
+            v8::ThrowException( error );
+            return v8::Undefined();
+        }
+    }
+
+    for ( uint32_t i = 0; i < len; ++i ) {
+
+        CURLcode code = Curl::ApplyOpt( obj, options[i], values[i] );
+
+        if ( code != CURLE_OK ) {
+
+            v8::Handle<v8::Object> error = v8::Exception::Error( v8::String::New( curl_easy_strerror( code ) ) )->ToObject();
+
+            error->Set( v8::String::NewSymbol( "option" ), names[i] );
+            error->Set( v8::String::NewSymbol( "code" ), v8::Integer::New( code ) );
+
+            v8::ThrowException( error );
+            return v8::Undefined();
+        }
+    }
+
+    return scope.Close( v8::Integer::New( len ) );
+}
+
+
+//Value of the given info, undefined if the info is unknown.
+v8::Handle<v8::Value> Curl::GetInfoValue( Curl *obj, const CurlRegistry::Entry *infoEntry )
+{
+    v8::HandleScope scope;
+
+    v8::Handle<v8::Value> retVal = v8::Undefined();
+
+    int infoId = infoEntry ? infoEntry->id : 0;
+    CurlRegistry::Type infoType = infoEntry ? infoEntry->type : CurlRegistry::NONE;
+
+    CURLINFO info;
+    CURLcode code;
+
+    //String
+    if ( infoType == CurlRegistry::STRING ) {
+
+        retVal = Curl::GetInfoTmpl<char*, v8::String>( *(obj), infoId );
+
+    //Integer
+    } else if ( infoType == CurlRegistry::INTEGER ) {
+
+        retVal = Curl::GetInfoTmpl<long, v8::Integer>(  *(obj), infoId );
+
+    //Double
+    } else if ( infoType == CurlRegistry::DOUBLE ) {
+
+        retVal = Curl::GetInfoTmpl<double, v8::Number>( *(obj), infoId );
+
+    //Linked list
+    } else if ( infoType == CurlRegistry::LINKED_LIST ) {
+
+        curl_slist *linkedList;
+        curl_slist *curr;
+
+        info = (CURLINFO) infoId;
+        code = curl_easy_getinfo( obj->curl, info, &linkedList );
+
+        if ( code != CURLE_OK )
+            return scope.Close( Curl::Raise( "curl_easy_getinfo failed!", curl_easy_strerror( code ) ) );
+
+        v8::Handle<v8::Array> arr = v8::Array::New();
+
+        if ( linkedList ) {
+
+            curr = linkedList;
+
+            while ( curr ) {
+
+                arr->Set( arr->Length(), v8::String::New( curr->data ) );
+                curr = curr->next;
+            }
+
+            curl_slist_free_all( linkedList );
+        }
+
+        retVal = arr;
+    }
+
+    return scope.Close( retVal );
+}
+
+v8::Handle<v8::Value> Curl::GetInfo( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    Curl *obj = Curl::Unwrap( args.This() );
+
+    return scope.Close( Curl::GetInfoValue( obj, CurlRegistry::FindInfo( args[0] ) ) );
+}
+
+//Get many infos with a single call, returns an Array with their values, in the same order.
+v8::Handle<v8::Value> Curl::GetInfos( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    Curl *obj = Curl::Unwrap( args.This() );
+
+    if ( !obj ) {
+        Curl::Raise( "Curl is closed." );
+        return v8::Undefined();
+    }
+
+    if ( !args[0]->IsArray() ) {
+        Curl::Raise( "Infos must be an Array." );
+        return v8::Undefined();
+    }
+
+    v8::Handle<v8::Array> infos = v8::Handle<v8::Array>::Cast( args[0] );
+    uint32_t len = infos->Length();
+
+    v8::Handle<v8::Array> values = v8::Array::New( len );
+
+    v8::TryCatch tryCatch;
+
+    for ( uint32_t i = 0; i < len; i++ ) {
+
+        v8::Handle<v8::Value> value = Curl::GetInfoValue( obj, CurlRegistry::FindInfo( infos->Get( i ) ) );
+
+        if ( tryCatch.HasCaught() )
+            return tryCatch.ReThrow();
+
+        values->Set( i, value );
+    }
+
+    return scope.Close( values );
+}
+
+//Set the Float64Array the timings are copied to when the request finishes, anything else removes it.
+v8::Handle<v8::Value> Curl::SetTimings( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    Curl *obj = Curl::Unwrap( args.This() );
+
+    if ( !obj ) {
+        Curl::Raise( "Curl is closed." );
+        return v8::Undefined();
+    }
+
+    if ( !args[0]->IsObject() ) {
+
+        obj->SetTimingsArray( v8::Handle<v8::Object>() );
+        return args.This();
+    }
+
+    v8::Handle<v8::Object> array = args[0]->ToObject();
+
+    if ( !array->HasIndexedPropertiesInExternalArrayData()
+        || array->GetIndexedPropertiesExternalArrayDataType() != v8::kExternalDoubleArray
+        || array->GetIndexedPropertiesExternalArrayDataLength() < TIMING_COUNT ) {
+
+        Curl::Raise( "Timings must be a Float64Array with at least Curl.timing.COUNT elements." );
+        return v8::Undefined();
+    }
+
+    obj->SetTimingsArray( array );
+
+    return args.This();
+}
+
+//Label the transfers of this handle are recorded with on the metrics, anything that is not a string removes it.
+v8::Handle<v8::Value> Curl::SetMetricsLabel( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    Curl *obj = Curl::Unwrap( args.This() );
+
+    if ( !obj ) {
+        Curl::Raise( "Curl is closed." );
+        return v8::Undefined();
+    }
+
+    if ( !args[0]->IsString() ) {
+
+        obj->metricsLabel = 0;
+        return args.This();
+    }
+
+    int32_t labelId = CurlMetrics::GetLabelId( *v8::String::Utf8Value( args[0] ) );
+
+    if ( labelId < 0 ) {
+        Curl::Raise( "Too many metrics labels." );
+        return v8::Undefined();
+    }
+
+    obj->metricsLabel = labelId;
+
+    return args.This();
+}
+
+//Write the progress of this handle to a Float64Array: _setProgressArray( array, slot ), or _setProgressArray( null ) to stop.
+// dltotal, dlnow, ultotal and ulnow are written at slot * 4, no js is called for that.
+v8::Handle<v8::Value> Curl::SetProgressArray( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    Curl *obj = Curl::Unwrap( args.This() );
+
+    if ( !obj ) {
+        Curl::Raise( "Curl is closed." );
+        return v8::Undefined();
+    }
+
+    if ( obj->isInsideMultiCurl ) {
+        Curl::Raise( "Cannot change the progress array of a running Curl session." );
+        return v8::Undefined();
+    }
+
+    bool hasCallback = !obj->callbacks.progress.IsEmpty() || !obj->callbacks.xferinfo.IsEmpty();
+
+    if ( !args[0]->IsObject() ) {
+
+        obj->SetProgressArray( v8::Handle<v8::Object>(), 0 );
+
+        if ( !hasCallback )
+            curl_easy_setopt( obj->curl, CURLOPT_NOPROGRESS, 1L );
+
+        return args.This();
+    }
+
+    v8::Handle<v8::Object> array = args[0]->ToObject();
+    uint32_t slot = args[1]->Uint32Value();
+
+    if ( !array->HasIndexedPropertiesInExternalArrayData()
+        || array->GetIndexedPropertiesExternalArrayDataType() != v8::kExternalDoubleArray
+        || static_cast<uint32_t>( array->GetIndexedPropertiesExternalArrayDataLength() ) / 4 <= slot ) {
+
+        Curl::Raise( "Progress array must be a Float64Array with room for 4 values at slot * 4." );
+        return v8::Undefined();
+    }
+
+    obj->SetProgressArray( array, slot );
+
+    if ( !hasCallback ) {
+
+#if LIBCURL_VERSION_NUM >= 0x072000
+        curl_easy_setopt( obj->curl, CURLOPT_XFERINFODATA, obj );
+        curl_easy_setopt( obj->curl, CURLOPT_XFERINFOFUNCTION, Curl::CbXferinfo );
+#else
+        curl_easy_setopt( obj->curl, CURLOPT_PROGRESSDATA, obj );
+        curl_easy_setopt( obj->curl, CURLOPT_PROGRESSFUNCTION, Curl::CbProgress );
+#endif
+    }
+
+    curl_easy_setopt( obj->curl, CURLOPT_NOPROGRESS, 0L );
+
+    return args.This();
+}
+
+//Limit the calls to the js progress callback: _setProgressThrottle( intervalMs, bytes ). 0 for both calls it on every update.
+v8::Handle<v8::Value> Curl::SetProgressThrottle( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    Curl *obj = Curl::Unwrap( args.This() );
+
+    if ( !obj ) {
+        Curl::Raise( "Curl is closed." );
+        return v8::Undefined();
+    }
+
+    double interval = args[0]->NumberValue();
+    double bytes = args[1]->NumberValue();
+
+    obj->progressInterval = interval > 0 ? static_cast<uint64_t>( interval * 1e6 ) : 0;
+    obj->progressBytes = bytes > 0 ? bytes : 0;
+
+    return args.This();
+}
+
+//Priority of the next requests on the scheduler of the multi, one of Multi.priority.
+v8::Handle<v8::Value> Curl::SetPriority( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    Curl *obj = Curl::Unwrap( args.This() );
+
+    if ( !obj ) {
+        Curl::Raise( "Curl is closed." );
+        return v8::Undefined();
+    }
+
+    if ( obj->isInsideMultiCurl ) {
+        Curl::Raise( "Cannot change the priority of a running Curl session." );
+        return v8::Undefined();
+    }
+
+    if ( !args[0]->IsInt32() || args[0]->Int32Value() < 0 || args[0]->Int32Value() >= CurlScheduler::PRIORITY_COUNT ) {
+        Curl::Raise( "Priority must be one of the Curl.Multi.priority constants." );
+        return v8::Undefined();
+    }
+
+    obj->priority = args[0]->Int32Value();
+
+    return args.This();
+}
+
+//Record the debug events of this handle natively: _setTrace( capacity, payloadSize ), or _setTrace( null ) to stop.
+// VERBOSE is enabled while tracing.
+v8::Handle<v8::Value> Curl::SetTrace( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    Curl *obj = Curl::Unwrap( args.This() );
+
+    if ( !obj ) {
+        Curl::Raise( "Curl is closed." );
+        return v8::Undefined();
+    }
+
+    if ( obj->isInsideMultiCurl ) {
+        Curl::Raise( "Cannot change the trace of a running Curl session." );
+        return v8::Undefined();
+    }
+
+    delete obj->trace;
+    obj->trace = NULL;
+
+    if ( !args[0]->IsUint32() || !args[0]->Uint32Value() ) {
+
+        //nothing else is using the debug events
+        if ( obj->callbacks.debug.IsEmpty() ) {
+
+            curl_easy_setopt( obj->curl, CURLOPT_DEBUGFUNCTION, NULL );
+            curl_easy_setopt( obj->curl, CURLOPT_VERBOSE, 0L );
+        }
+
+        return args.This();
+    }
 
-        } else {
+    obj->trace = new CurlTrace( args[0]->Uint32Value(), args[1]->Uint32Value() );
 
-            if ( value->IsNull() ) {
-                optCallResult = v8::Integer::New(
-                    curl_easy_setopt(
-                        obj->curl, (CURLoption) optionId, NULL
-                    )
-                );
+    curl_easy_setopt( obj->curl, CURLOPT_DEBUGDATA, obj );
+    curl_easy_setopt( obj->curl, CURLOPT_DEBUGFUNCTION, Curl::CbDebug );
+    curl_easy_setopt( obj->curl, CURLOPT_VERBOSE, 1L );
 
-            } else {
+    return args.This();
+}
 
-                if ( !value->IsArray() ) {
-                    v8::ThrowException(v8::Exception::TypeError(
-                        v8::String::New( "Option value should be an array." )
-                    ));
-                    return v8::Undefined();
-                }
+//Returns the events recorded since the last call, and clears them.
+v8::Handle<v8::Value> Curl::GetTrace( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
 
-                //convert value to curl linked list (curl_slist)
-                curl_slist *slist = NULL;
-                v8::Handle<v8::Array> array = v8::Handle<v8::Array>::Cast( value );
+    Curl *obj = Curl::Unwrap( args.This() );
 
-                for ( uint32_t i = 0, len = array->Length(); i < len; ++i )
-                {
-                    slist = curl_slist_append( slist, *v8::String::Utf8Value( array->Get( i ) ) );
-                }
+    if ( !obj ) {
+        Curl::Raise( "Curl is closed." );
+        return v8::Undefined();
+    }
 
-                obj->curlLinkedLists.push_back( slist );
+    if ( !obj->trace )
+        return v8::Null();
 
-                optCallResult = v8::Integer::New(
-                    curl_easy_setopt(
-                        obj->curl, (CURLoption) optionId, slist
-                    )
-                );
-            }
-        }
+    //the worker thread is writing to it
+    if ( obj->worker ) {
+        Curl::Raise( "Cannot read the trace of a Curl session running on a threaded Multi." );
+        return v8::Undefined();
+    }
 
-        //check if option is string, and the value is correct
-    } else if ( ( optionId = isInsideOption( curlOptionsString, opt ) ) ) {
+    return scope.Close( obj->trace->Drain() );
+}
 
-        if ( !value->IsString() ) {
-            v8::ThrowException(v8::Exception::TypeError(
-                v8::String::New( "Option value should be a string." )
-            ));
-            return v8::Undefined();
-        }
+//Add this handle for processing on the curl_multi handler.
+v8::Handle<v8::Value> Curl::Perform( const v8::Arguments &args ) {
 
-        // Create a string copy
-        bool isNull = value->IsNull();
+    v8::HandleScope scope;
 
-        if ( !isNull ) {
+    Curl *obj = Curl::Unwrap( args.This() );
 
-            //Curl don't copies the string before version 7.17
-            v8::String::Utf8Value value( args[1] );
-            int length = value.length();
-            obj->curlStrings[optionId] = std::string( *value, length );
-        }
+    if ( !obj ) {
+        Curl::Raise( "Curl is closed." );
+        return v8::Undefined();
+    }
 
-        optCallResult = v8::Integer::New(
-            curl_easy_setopt(
-                obj->curl, (CURLoption) optionId, ( !isNull ) ? obj->curlStrings[optionId].c_str() : NULL
-            )
-        );
+    //client should not call this method more than one time by request, the end of the last one can be waiting for the sink too
+    if ( obj->isInsideMultiCurl || obj->isSinkWriting ) {
+        Curl::Raise( "Curl session is already running." );
+        return v8::Undefined();
+    }
 
+    //discard anything left from a previous request
+    obj->ResetStorage();
 
-        //check if option is a integer, and the value is correct
-    } else if ( ( optionId = isInsideOption( curlOptionsInteger, opt ) )  ) {
+    obj->lastProgressCall = 0;
+    obj->lastProgressAmount = 0;
 
-        int32_t val = value->Int32Value();
+    //a pause asked by the write callback ends with the transfer
+    obj->pauseState &= ~CURLPAUSE_RECV;
 
-        //If not integer, but a not falsy value, val = 1
-        if ( !value->IsInt32() ) {
-            val = value->BooleanValue();
-        }
+    if ( obj->multi->IsClosed() ) {
+        Curl::Raise( "Multi is closed." );
+        return v8::Undefined();
+    }
 
-        optCallResult = v8::Integer::New(
-            curl_easy_setopt(
-                obj->curl, (CURLoption) optionId, val
-            )
-        );
+    //those call js from the libcurl callbacks, which run outside the main thread on a threaded multi
+    if ( obj->multi->IsThreaded() && ( !obj->callbacks.progress.IsEmpty() || !obj->callbacks.xferinfo.IsEmpty() || !obj->callbacks.debug.IsEmpty() ) ) {
+        Curl::Raise( "Progress and debug callbacks cannot be used with a threaded Multi." );
+        return v8::Undefined();
+    }
 
-    } else if ( ( optionId = isInsideOption( curlOptionsFunction, opt ) ) ) {
+    //the upload queue is filled by js, and read by libcurl without any lock
+    if ( obj->multi->IsThreaded() && obj->isUploadEnabled ) {
+        Curl::Raise( "Upload streams cannot be used with a threaded Multi." );
+        return v8::Undefined();
+    }
 
-        if ( !value->IsFunction() ) {
-            Curl::Raise( "Option value must be a function." );
-            return v8::Undefined();
-        }
+    CURLMcode code = obj->multi->AddHandle( obj );
 
-        v8::Handle<v8::Function> callback = value.As<v8::Function>();
+    if ( code != CURLM_OK ) {
 
-        switch ( optionId ) {
+        Curl::Raise( "curl_multi_add_handle Failed", curl_multi_strerror( code ) );
+        return v8::Undefined();
+    }
 
-#if LIBCURL_VERSION_NUM >= 0x072000
-            /* xferinfo was introduced in 7.32.0, no earlier libcurl versions will compile as they won't have the symbols around.
-                New libcurls will prefer the new callback and instead use that one even if both callbacks are set. */
-            case CURLOPT_XFERINFOFUNCTION:
+    return args.This();
+}
 
-                obj->callbacks.xferinfo = v8::Persistent<v8::Function>::New( callback );
-                curl_easy_setopt( obj->curl, CURLOPT_XFERINFODATA, obj );
-                optCallResult = v8::Integer::New( curl_easy_setopt( obj->curl, CURLOPT_XFERINFOFUNCTION, Curl::CbXferinfo ) );
+v8::Handle<v8::Value> Curl::Pause( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
 
-                break;
-#endif
+    Curl *obj = Curl::Unwrap( args.This() );
 
-            case CURLOPT_PROGRESSFUNCTION:
+    if ( !obj ) {
+        Curl::Raise( "Curl is closed." );
+        return v8::Undefined();
+    }
 
-                obj->callbacks.progress = v8::Persistent<v8::Function>::New( callback );
-                curl_easy_setopt( obj->curl, CURLOPT_PROGRESSFUNCTION, obj );
-                optCallResult = v8::Integer::New( curl_easy_setopt( obj->curl, CURLOPT_PROGRESSFUNCTION, Curl::CbProgress ) );
+    if ( !args[0]->IsUint32() ) {
+        Curl::Raise( "Bitmask value must be an integer." );
+        return v8::Undefined();
+    }
 
-                break;
+    int32_t bitmask = args[0]->Int32Value();
 
-            case CURLOPT_DEBUGFUNCTION:
+    //the handle belongs to the worker thread while running
+    if ( obj->worker ) {
 
-                obj->callbacks.debug = v8::Persistent<v8::Function>::New( callback );
-                curl_easy_setopt( obj->curl, CURLOPT_DEBUGFUNCTION, obj );
-                optCallResult = v8::Integer::New( curl_easy_setopt( obj->curl, CURLOPT_DEBUGFUNCTION, Curl::CbDebug ) );
+        obj->worker->Pause( obj, bitmask );
+        return args.This();
+    }
 
-                break;
-        }
+    //the transfer already finished, js may still be receiving its last chunks, or it was not started yet by the scheduler
+    if ( !obj->isInsideMultiCurl || obj->isQueued ) {
 
+        obj->pauseState = bitmask;
+        return args.This();
     }
 
-    CURLcode code = (CURLcode) optCallResult->Int32Value();
+    //an upload waiting for data must stay paused
+    CURLcode code = curl_easy_pause( obj->curl, obj->isUploadPaused ? ( bitmask | CURLPAUSE_SEND ) : bitmask );
 
     if ( code != CURLE_OK ) {
-
-        Curl::Raise(
-            code == CURLE_FAILED_INIT ? "Unknown option given. First argument must be the option internal id or the option name. You can use the Curl.option constants." : curl_easy_strerror( code )
-        );
+        Curl::Raise( curl_easy_strerror( code ) );
         return v8::Undefined();
     }
 
-    return scope.Close( optCallResult );
-}
+    obj->pauseState = bitmask;
 
+    return args.This();
+}
 
-v8::Handle<v8::Value> Curl::GetInfo( const v8::Arguments &args )
+//Use the data given with _writeUpload as the request body, sent as soon as it's available.
+v8::Handle<v8::Value> Curl::EnableUpload( const v8::Arguments &args )
 {
     v8::HandleScope scope;
 
     Curl *obj = Curl::Unwrap( args.This() );
 
-    v8::Handle<v8::Value> infoVal = args[0];
+    if ( !obj ) {
+        Curl::Raise( "Curl is closed." );
+        return v8::Undefined();
+    }
 
-    v8::Handle<v8::Value> retVal = v8::Undefined();
+    if ( obj->isInsideMultiCurl ) {
+        Curl::Raise( "Cannot change the upload of a running Curl session." );
+        return v8::Undefined();
+    }
 
-    int infoId;
+    if ( !args[0]->IsUint32() || !args[0]->Uint32Value() ) {
+        Curl::Raise( "High water mark must be a positive integer." );
+        return v8::Undefined();
+    }
 
-    CURLINFO info;
-    CURLcode code;
+    obj->ResetUpload();
 
-    //String
-    if ( (infoId = isInsideOption( curlInfosString, infoVal ) ) ) {
+    obj->isUploadEnabled = true;
+    obj->uploadHighWaterMark = args[0]->Uint32Value();
 
-        retVal = Curl::GetInfoTmpl<char*, v8::String>( *(obj), infoId );
+    curl_easy_setopt( obj->curl, CURLOPT_READFUNCTION, Curl::ReadFunction );
+    curl_easy_setopt( obj->curl, CURLOPT_READDATA, obj );
 
-    //Integer
-    } else if ( (infoId = isInsideOption( curlInfosInteger, infoVal ) ) ) {
+    return args.This();
+}
 
-        retVal = Curl::GetInfoTmpl<long, v8::Integer>(  *(obj), infoId );
+//Queue a chunk of the upload, returns false when the queue is over the high water mark,
+// _onUploadDrain is called after enough of it was sent.
+v8::Handle<v8::Value> Curl::WriteUpload( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
 
-    //Double
-    } else if ( (infoId = isInsideOption( curlInfosDouble, infoVal ) ) ) {
+    Curl *obj = Curl::Unwrap( args.This() );
 
-        retVal = Curl::GetInfoTmpl<double, v8::Number>( *(obj), infoId );
+    if ( !obj ) {
+        Curl::Raise( "Curl is closed." );
+        return v8::Undefined();
+    }
 
-    //Linked list
-    } else if ( (infoId = isInsideOption( curlInfosLinkedList, infoVal ) ) ) {
+    if ( !obj->isUploadEnabled || obj->isUploadEnded ) {
+        Curl::Raise( "Upload is not writable." );
+        return v8::Undefined();
+    }
 
-        curl_slist *linkedList;
-        curl_slist *curr;
+    if ( !node::Buffer::HasInstance( args[0] ) ) {
+        v8::ThrowException(v8::Exception::TypeError(
+            v8::String::New( "Upload chunk should be a Buffer." )
+        ));
+        return v8::Undefined();
+    }
 
-        info = (CURLINFO) infoId;
-        code = curl_easy_getinfo( obj->curl, info, &linkedList );
+    v8::Handle<v8::Object> chunk = args[0]->ToObject();
 
-        if ( code != CURLE_OK )
-            return scope.Close( Curl::Raise( "curl_easy_getinfo failed!", curl_easy_strerror( code ) ) );
+    CurlBuffer &buffer = obj->uploadBuffer;
 
-        v8::Handle<v8::Array> arr = v8::Array::New();
+    //drop what was already sent, instead of growing the buffer
+    if ( obj->uploadOffset ) {
 
-        if ( linkedList ) {
+        memmove( buffer.data, buffer.data + obj->uploadOffset, buffer.length - obj->uploadOffset );
+        buffer.length -= obj->uploadOffset;
+        obj->uploadOffset = 0;
+    }
 
-            curr = linkedList;
+    if ( !buffer.append( node::Buffer::Data( chunk ), node::Buffer::Length( chunk ) ) ) {
+        Curl::Raise( "Could not allocate memory for the upload chunk." );
+        return v8::Undefined();
+    }
 
-            while ( curr ) {
+    obj->ResumeUpload();
 
-                arr->Set( arr->Length(), v8::String::New( curr->data ) );
-                curr = curr->next;
-            }
+    bool isWritable = buffer.length < obj->uploadHighWaterMark;
 
-            curl_slist_free_all( linkedList );
-        }
+    if ( !isWritable )
+        obj->isUploadDrainNeeded = true;
 
-        retVal = arr;
+    return scope.Close( v8::Boolean::New( isWritable ) );
+}
+
+//No more data is going to be written, if the argument is true the transfer is aborted.
+v8::Handle<v8::Value> Curl::EndUpload( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    Curl *obj = Curl::Unwrap( args.This() );
+
+    if ( !obj ) {
+        Curl::Raise( "Curl is closed." );
+        return v8::Undefined();
     }
 
-    return scope.Close( retVal );
+    if ( !obj->isUploadEnabled ) {
+        Curl::Raise( "Upload is not enabled." );
+        return v8::Undefined();
+    }
 
-}
+    obj->isUploadEnded = true;
+    obj->isUploadAborted = args[0]->BooleanValue();
+    obj->isUploadDrainNeeded = false;
 
-//Add this handle for processing on the curl_multi handler.
-v8::Handle<v8::Value> Curl::Perform( const v8::Arguments &args ) {
+    obj->ResumeUpload();
+
+    return args.This();
+}
 
+//Write the body to the given file descriptor, instead of passing it to js. -1 removes the sink.
+v8::Handle<v8::Value> Curl::SetSink( const v8::Arguments &args )
+{
     v8::HandleScope scope;
 
     Curl *obj = Curl::Unwrap( args.This() );
@@ -1105,26 +2519,51 @@ v8::Handle<v8::Value> Curl::Perform( const v8::Arguments &args ) {
         return v8::Undefined();
     }
 
-    //client should not call this method more than one time by request
     if ( obj->isInsideMultiCurl ) {
-        Curl::Raise( "Curl session is already running." );
+        Curl::Raise( "Cannot change the sink of a running Curl session." );
         return v8::Undefined();
     }
 
-    CURLMcode code = curl_multi_add_handle( Curl::curlMulti, obj->curl );
+    if ( !args[0]->IsInt32() || ( obj->sinkFd = args[0]->Int32Value() ) < 0 ) {
 
-    if ( code != CURLM_OK ) {
+        obj->sinkFd = -1;
+        return args.This();
+    }
 
-        Curl::Raise( "curl_multi_add_handle Failed", curl_multi_strerror( code ) );
+    //whole blocks, at least one
+    size_t bufferSize = args[1]->IsUint32() ? args[1]->Uint32Value() : 0;
+    bufferSize = ( ( bufferSize + sinkBlockSize - 1 ) / sinkBlockSize ) * sinkBlockSize;
+
+    obj->sinkBufferSize = std::max( bufferSize, sinkBlockSize );
+    obj->isSinkPreallocateEnabled = args[2]->BooleanValue();
+
+    return args.This();
+}
+
+//Set the features bitmask, the features are defined on js, see Curl.feature.
+v8::Handle<v8::Value> Curl::SetFeatures( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    Curl *obj = Curl::Unwrap( args.This() );
+
+    if ( !obj ) {
+        Curl::Raise( "Curl is closed." );
+        return v8::Undefined();
+    }
+
+    if ( !args[0]->IsInt32() ) {
+        Curl::Raise( "Features bitmask must be an integer." );
         return v8::Undefined();
     }
 
-    obj->isInsideMultiCurl = true;
+    obj->features = args[0]->Int32Value();
 
     return args.This();
 }
 
-v8::Handle<v8::Value> Curl::Pause( const v8::Arguments &args )
+//Changes the multi this handle is added to when performing
+v8::Handle<v8::Value> Curl::SetMulti( const v8::Arguments &args )
 {
     v8::HandleScope scope;
 
@@ -1135,20 +2574,25 @@ v8::Handle<v8::Value> Curl::Pause( const v8::Arguments &args )
         return v8::Undefined();
     }
 
-    if ( !args[0]->IsUint32() ) {
-        Curl::Raise( "Bitmask value must be an integer." );
+    if ( obj->isInsideMultiCurl ) {
+        Curl::Raise( "Cannot change the multi of a running Curl session." );
         return v8::Undefined();
     }
 
-    int32_t bitmask = args[0]->Int32Value();
+    if ( !CurlMulti::HasInstance( args[0] ) ) {
+        Curl::Raise( "Argument must be a Curl.Multi instance." );
+        return v8::Undefined();
+    }
 
-    CURLcode code = curl_easy_pause( obj->curl, bitmask );
+    CurlMulti *multi = CurlMulti::Unwrap( args[0]->ToObject() );
 
-    if ( code != CURLE_OK ) {
-        Curl::Raise( curl_easy_strerror( code ) );
+    if ( !multi || multi->IsClosed() ) {
+        Curl::Raise( "Multi is closed." );
         return v8::Undefined();
     }
 
+    obj->multi = multi;
+
     return args.This();
 }
 
@@ -1176,16 +2620,73 @@ v8::Handle<v8::Value> Curl::Reset( const v8::Arguments &args )
 
     }
 
-    curl_easy_reset( obj->curl );
+    //the buffers and lists released by the reset are still being used by libcurl, or by a write to the sink
+    if ( obj->isInsideMultiCurl || obj->isSinkWriting ) {
 
-    // reset the URL, https://github.com/bagder/curl/commit/ac6da721a3740500cc0764947385eb1c22116b83
-    curl_easy_setopt( obj->curl, CURLOPT_URL, "" );
+        Curl::Raise( "Cannot reset a running Curl session." );
+        return v8::Undefined();
+    }
 
-    obj->DisposeCallbacks();
+    obj->ResetHandle();
 
     return args.This();
 }
 
+//Set all options back to their default values, the connection cache, and the multi, are kept.
+void Curl::ResetHandle()
+{
+    curl_easy_reset( this->curl );
+
+    //reset also removes the share
+    this->SetShare( NULL );
+
+    //and every option that could be using the template storage
+    this->SetTemplate( NULL );
+
+    this->SetTimingsArray( v8::Handle<v8::Object>() );
+    this->metricsLabel = 0;
+    this->priority = CurlScheduler::PRIORITY_NORMAL;
+
+    // reset the URL, https://github.com/bagder/curl/commit/ac6da721a3740500cc0764947385eb1c22116b83
+    curl_easy_setopt( this->curl, CURLOPT_URL, "" );
+
+    //callbacks set on the constructor are reset too
+    curl_easy_setopt( this->curl, CURLOPT_WRITEFUNCTION, Curl::WriteFunction );
+    curl_easy_setopt( this->curl, CURLOPT_WRITEDATA, this );
+    curl_easy_setopt( this->curl, CURLOPT_HEADERFUNCTION, Curl::HeaderFunction );
+    curl_easy_setopt( this->curl, CURLOPT_HEADERDATA, this );
+    curl_easy_setopt( this->curl, CURLOPT_PRIVATE, this );
+
+    //nothing references them anymore
+    for ( std::vector<curl_slist*>::iterator it = this->curlLinkedLists.begin(), end = this->curlLinkedLists.end(); it != end; ++it ) {
+
+        if ( *it )
+            curl_slist_free_all( *it );
+    }
+
+    this->curlLinkedLists.clear();
+    this->curlStrings.clear();
+    this->httpPost.reset();
+
+    this->DisposeCallbacks();
+    this->callbacks.isProgressCbAlreadyAborted = false;
+
+    this->SetProgressArray( v8::Handle<v8::Object>(), 0 );
+    this->progressInterval = 0;
+    this->progressBytes = 0;
+
+    //the debug function was removed by the reset
+    delete this->trace;
+    this->trace = NULL;
+
+    this->SetPostFieldsBuffer( v8::Handle<v8::Object>() );
+
+    this->ResetStorage();
+    this->ResetUpload();
+    this->pauseState = CURLPAUSE_CONT;
+    this->sinkFd = -1;
+}
+
 //returns the amount of curl instances
 v8::Handle<v8::Value> Curl::GetCount( const v8::Arguments &args )
 {
@@ -1193,6 +2694,14 @@ v8::Handle<v8::Value> Curl::GetCount( const v8::Arguments &args )
     return scope.Close( v8::Integer::New( Curl::count ) );
 }
 
+//returns the counters of the work done by the addon, and the amount of handles running
+v8::Handle<v8::Value> Curl::GetStats( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    return scope.Close( CurlStats::ToObject() );
+}
+
 //Returns a human readable string with the version number of libcurl and some of its important components (like OpenSSL version).
 v8::Handle<v8::Value> Curl::GetVersion( const v8::Arguments &args )
 {
@@ -8,6 +8,15 @@
 #include <string>
 
 #include "CurlHttpPost.h"
+#include "CurlBuffer.h"
+#include "CurlMulti.h"
+#include "CurlWorker.h"
+#include "CurlShare.h"
+#include "CurlPool.h"
+#include "CurlTemplate.h"
+#include "CurlRegistry.h"
+#include "CurlTrace.h"
+#include "CurlScheduler.h"
 #include "string_format.h"
 
 typedef std::map<const int*, std::string> curlMapId;
@@ -25,21 +34,60 @@ public:
         // Since atm this is the only place with such big value, we are veryfing for that in the setOpt method, and so using the correct value there.
     };
 
+    //Features bitmask, must be kept in sync with Curl.feature on lib/Curl.js
+    enum {
+        NO_DATA_PARSING     = 1 << 0,
+        NO_HEADER_PARSING   = 1 << 1,
+        NO_DATA_STORAGE     = 1 << 2,
+        NO_HEADER_STORAGE   = 1 << 3,
+        NATIVE_DATA_STORAGE = 1 << 4,
+        NATIVE_HEADER_PARSING = 1 << 5,
+        BATCH_CALLBACKS     = 1 << 6
+    };
+
+    //Indexes of the timings snapshot, must be kept in sync with Curl.timing on lib/Curl.js
+    enum {
+        TIMING_TOTAL_TIME,
+        TIMING_NAMELOOKUP_TIME,
+        TIMING_CONNECT_TIME,
+        TIMING_APPCONNECT_TIME,
+        TIMING_PRETRANSFER_TIME,
+        TIMING_STARTTRANSFER_TIME,
+        TIMING_REDIRECT_TIME,
+        TIMING_SIZE_UPLOAD,
+        TIMING_SIZE_DOWNLOAD,
+        TIMING_SPEED_UPLOAD,
+        TIMING_SPEED_DOWNLOAD,
+        TIMING_RESPONSE_CODE,
+        TIMING_REDIRECT_COUNT,
+        TIMING_COUNT
+    };
+
     //Export curl to js
     static void Initialize( v8::Handle<v8::Object> exports );
 
 private:
 
+    //classes that work directly with the easy handle and its state
+    friend class CurlMulti;
+    friend class CurlWorker;
+    friend class CurlShare;
+    friend class CurlPool;
+    friend class CurlTemplate;
+    friend class CurlScheduler;
+
     //Constructors/Destructors
-    Curl( v8::Handle<v8::Object> Object );
+    Curl( v8::Handle<v8::Object> Object, CurlTemplate *curlTemplate = NULL );
     ~Curl(void);
     void Dispose();
 
-    //Context used with curl_multi_assign to create a relationship between the socket being used and the poll handler.
-    struct CurlSocketContext {
-        uv_mutex_t mutex;
-        uv_poll_t pollHandle;
-        curl_socket_t sockfd;
+    //Entry of the headers index, offsets are relative to the start of the headers arena.
+    // Status lines have nameLength == 0 and the whole line as value.
+    struct CurlHeaderEntry {
+        int32_t nameOffset;
+        int32_t nameLength;
+        int32_t valueOffset;
+        int32_t valueLength;
     };
 
     //Function handlers
@@ -59,36 +107,156 @@ private:
 
     std::vector<curl_slist*> curlLinkedLists;
     std::map<int, std::string> curlStrings;
+
+    //Buffer given to POSTFIELDS, its memory is used directly by libcurl
+    v8::Persistent<v8::Object> postFieldsBuffer;
+
     v8::Persistent<v8::Object> handle;
     bool isInsideMultiCurl;
+    CurlMulti *multi;
+
+    //set while waiting on the scheduler of the multi, see CurlScheduler. isInsideMultiCurl is already true then.
+    bool isQueued;
+    int32_t priority;
+    CurlScheduler::Host *schedulerHost;
+
+    //set while running on a threaded multi, the callbacks run on the worker thread then
+    CurlWorker *worker;
+    uint32_t requestId;
+
+    //the worker keeps using the handle until it answers the removal, see CurlMulti::RemoveHandle.
+    // The error to report then, and if the instance was closed meanwhile and must be deleted instead.
+    CURLcode detachResult;
+    bool isDisposed;
+
+    CurlShare *share;
+
+    //pool that leased this instance
+    CurlPool *pool;
+
+    //template that owns the storage of some of the options set
+    CurlTemplate *curlTemplate;
+    int32_t features;
+
+    //body received, used when NATIVE_DATA_STORAGE is enabled
+    CurlBuffer dataBuffer;
+
+    //raw headers received and the index of their fields (CurlHeaderEntry), used when NATIVE_HEADER_PARSING is enabled
+    CurlBuffer headerArena;
+    CurlBuffer headerIndex;
+
+    //chunks waiting to be delivered to js, used when BATCH_CALLBACKS is enabled
+    CurlBuffer stagedData;
+    CurlBuffer stagedHeader;
+    std::vector<size_t> stagedDataEnds;
+    std::vector<size_t> stagedHeaderEnds;
+    bool isQueuedForFlush;
+
+    //data waiting to be sent, used when an upload stream is set. Bytes before uploadOffset were already sent.
+    CurlBuffer uploadBuffer;
+    size_t uploadOffset;
+    size_t uploadHighWaterMark;
+    bool isUploadEnabled;
+    bool isUploadEnded;
+    bool isUploadAborted;
+    bool isUploadPaused;
+    bool isUploadDrainNeeded;
+
+    //bitmask last given to pause, kept when the upload is resumed
+    int32_t pauseState;
+
+    //file the body is written to, when a sink is set. Data is buffered, and written in multiples of sinkBlockSize.
+    uv_file sinkFd;
+    CurlBuffer sinkBuffer;
+    size_t sinkBufferSize;
+    int64_t sinkBytes;
+    bool isSinkPreallocateEnabled;
+
+    //outside of the workers the writes run on the thread pool, see FlushSink. The block being written is kept on sinkWriteBuffer,
+    // the transfer is paused when sinkBuffer fills up before it's done, and the end, or error, event waits for it.
+    CurlBuffer sinkWriteBuffer;
+    size_t sinkWriteOffset;
+    uv_fs_t sinkRequest;
+    bool isSinkWriting;
+    bool isSinkFailed;
+    bool isSinkPaused;
+    bool isSinkEndPending;
+    CURLcode sinkEndResult;
+
+    static const size_t sinkBlockSize = 4096;
+
+    //Float64Array filled with the timings when the request finishes, before js is called
+    v8::Persistent<v8::Object> timingsArray;
+    double *timings;
+
+    //label the completed transfers are recorded with, see CurlMetrics
+    int32_t metricsLabel;
+
+    //debug events recorded natively, when enabled
+    CurlTrace *trace;
+
+    //Float64Array the progress is written to, progressSlot points to the 4 values of this handle
+    v8::Persistent<v8::Object> progressArray;
+    double *progressSlot;
+
+    //minimum ns and bytes between the calls to the js progress callback
+    uint64_t progressInterval;
+    double progressBytes;
+    uint64_t lastProgressCall;
+    double lastProgressAmount;
 
     //static members
-    static CURLM *curlMulti;
-    static int runningHandles;
     static int count;
-    static std::map< CURL*, Curl* > curls;
-    static uv_timer_t curlTimeout;
     static v8::Persistent<v8::Function> constructor;
+    static v8::Persistent<v8::FunctionTemplate> constructorTemplate;
+
+    //handles with staged chunks, and the one currently being flushed
+    static std::vector<Curl*> pendingFlush;
+    static Curl *flushing;
+
+    enum {
+        FLUSH_OK,
+        FLUSH_ABORTED, //js did not consume all the data
+        FLUSH_CLOSED   //handle was closed by js
+    };
 
-    //LibUV Socket polling
-    static CurlSocketContext *CreateCurlSocketContext( curl_socket_t sockfd );
-    static int HandleSocket( CURL *easy, curl_socket_t s, int action, void *userp, void *socketp );
-    static int HandleTimeout( CURLM *multi, long timeoutMs, void *userp );
-    static void OnTimeout( uv_timer_t *req, int status );
-    static void Process( uv_poll_t* handle, int status, int events );
-    static void ProcessMessages();
-    static void DestroyCurlSocketContext( CurlSocketContext *ctx );
-    static void OnCurlSocketClose( uv_handle_t *handle );
+    static void FlushPending();
+    static int FlushStaged( Curl *obj );
+    static int DeliverStaged( Curl *obj, CurlBuffer &staged, std::vector<size_t> &ends, const char *method );
 
     //cURL callbacks
     static size_t WriteFunction( char *ptr, size_t size, size_t nmemb, void *userdata );
     static size_t HeaderFunction( char *ptr, size_t size, size_t nmemb, void *userdata );
+    static size_t ReadFunction( char *ptr, size_t size, size_t nmemb, void *userdata );
+
+    //libuv callbacks
+    static void OnSinkWritten( uv_fs_t *req );
 
     //Instance methods
     size_t OnData( char *data, size_t size, size_t nmemb );
     size_t OnHeader( char *data, size_t size, size_t nmemb );
+    size_t OnRead( char *data, size_t size, size_t nmemb );
     void OnEnd();
     void OnError( CURLcode errorCode );
+    bool IndexHeaderLine( size_t offset, size_t length );
+    void QueueFlush();
+    void SetShare( CurlShare *share );
+    void SetTemplate( CurlTemplate *curlTemplate );
+    void SetPostFieldsBuffer( v8::Handle<v8::Object> buffer );
+    void ResetHandle();
+    void ResetStorage();
+    void ResetUpload();
+    void ResumeUpload();
+    size_t WriteSink( const char *data, size_t size );
+    bool FlushSink( bool isFinal );
+    bool WriteSinkBlock();
+    void PreallocateSink();
+    void SetTimingsArray( v8::Handle<v8::Object> array );
+    void SetProgressArray( v8::Handle<v8::Object> array, uint32_t slot );
+    int OnProgress( v8::Persistent<v8::Function> &callback, double dltotal, double dlnow, double ultotal, double ulnow );
+    bool IsProgressCallDue( double dltotal, double dlnow, double ultotal, double ulnow );
+    void SnapshotTimings( bool isCompleted );
+    std::string GetHostKey() const;
     void DisposeCallbacks();
 
     //Helper static methods
@@ -99,6 +267,7 @@ private:
     static v8::Handle<v8::Value> GetInfoTmpl( const Curl &obj, int infoId );
 
     static Curl* Unwrap( v8::Handle<v8::Object> );
+    static bool HasInstance( v8::Handle<v8::Value> value );
     static v8::Handle<v8::Value> Raise( const char *message, const char *reason = NULL );
 
     //Callbacks
@@ -111,14 +280,40 @@ private:
     static void Destructor( v8::Persistent<v8::Value> value, void *data );
 
     static v8::Handle<v8::Value> SetOpt( const v8::Arguments &args );
+    static v8::Handle<v8::Value> SetOptInternal( Curl *obj, v8::Handle<v8::Value> opt, v8::Handle<v8::Value> value );
+    static v8::Handle<v8::Value> SetOpts( const v8::Arguments &args );
+    static v8::Handle<v8::Value> ValidateOpt( Curl *obj, const CurlRegistry::Entry *option, v8::Handle<v8::Value> value );
+    static CURLcode ApplyOpt( Curl *obj, const CurlRegistry::Entry *option, v8::Handle<v8::Value> value );
+    static int GetHttpPostFieldId( const v8::String::Utf8Value &fieldName );
+    static v8::Handle<v8::Value> GetInfoValue( Curl *obj, const CurlRegistry::Entry *info );
     static v8::Handle<v8::Value> GetInfo( const v8::Arguments &args );
+    static v8::Handle<v8::Value> GetInfos( const v8::Arguments &args );
+    static v8::Handle<v8::Value> SetTimings( const v8::Arguments &args );
+    static v8::Handle<v8::Value> SetMetricsLabel( const v8::Arguments &args );
+    static v8::Handle<v8::Value> SetTrace( const v8::Arguments &args );
+    static v8::Handle<v8::Value> SetProgressArray( const v8::Arguments &args );
+    static v8::Handle<v8::Value> SetProgressThrottle( const v8::Arguments &args );
+    static v8::Handle<v8::Value> SetPriority( const v8::Arguments &args );
+    static v8::Handle<v8::Value> GetTrace( const v8::Arguments &args );
     static v8::Handle<v8::Value> Perform( const v8::Arguments &args );
     static v8::Handle<v8::Value> Pause( const v8::Arguments &args );
+    static v8::Handle<v8::Value> EnableUpload( const v8::Arguments &args );
+    static v8::Handle<v8::Value> WriteUpload( const v8::Arguments &args );
+    static v8::Handle<v8::Value> EndUpload( const v8::Arguments &args );
+    static v8::Handle<v8::Value> SetSink( const v8::Arguments &args );
+    static v8::Handle<v8::Value> SetFeatures( const v8::Arguments &args );
+    static v8::Handle<v8::Value> SetMulti( const v8::Arguments &args );
     static v8::Handle<v8::Value> Reset( const v8::Arguments &args );
     static v8::Handle<v8::Value> Close( const v8::Arguments &args );
 
     static v8::Handle<v8::Value> GetCount( const v8::Arguments &args );
+    static v8::Handle<v8::Value> GetStats( const v8::Arguments &args );
     static v8::Handle<v8::Value> GetVersion( const v8::Arguments &args );
 
 };
+
+//Function that checks if given option is inside the given Curl::CurlOption struct, if it is, returns the optionId
+#define isInsideOption( options, option ) isInsideCurlOption( options, sizeof( options ), option )
+int isInsideCurlOption( const Curl::CurlOption *curlOptions, const int lenOfOption, const v8::Handle<v8::Value> &option );
+
 #endif
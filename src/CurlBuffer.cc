@@ -0,0 +1,113 @@
+#include "CurlBuffer.h"
+
+#include <node_buffer.h>
+#include <algorithm>
+
+CurlBuffer::CurlBuffer( size_t initialCapacity ) : data( NULL ), length( 0 ), capacity( 0 ), initialCapacity( initialCapacity )
+{
+
+}
+
+CurlBuffer::~CurlBuffer()
+{
+    this->reset();
+}
+
+bool CurlBuffer::reserve( size_t size )
+{
+    if ( size <= this->capacity )
+        return true;
+
+    char *newData = static_cast<char*>( realloc( this->data, size ) );
+
+    if ( !newData )
+        return false;
+
+    this->data     = newData;
+    this->capacity = size;
+
+    return true;
+}
+
+bool CurlBuffer::append( const char *chunk, size_t size )
+{
+    size_t needed = this->length + size;
+
+    //overflow
+    if ( needed < size )
+        return false;
+
+    if ( needed > this->capacity ) {
+
+        //grow geometrically, so the amount of reallocs is logarithmic on the body size
+        size_t newCapacity = this->capacity ? this->capacity * 2 : this->initialCapacity;
+
+        while ( newCapacity < needed && newCapacity * 2 > newCapacity )
+            newCapacity *= 2;
+
+        //the geometric growth may be too much, try again with the exact size needed
+        if ( !this->reserve( std::max( newCapacity, needed ) ) && !this->reserve( needed ) )
+            return false;
+    }
+
+    memcpy( this->data + this->length, chunk, size );
+    this->length = needed;
+
+    return true;
+}
+
+void CurlBuffer::reset()
+{
+    if ( this->data )
+        free( this->data );
+
+    this->data     = NULL;
+    this->length   = 0;
+    this->capacity = 0;
+}
+
+void CurlBuffer::swap( CurlBuffer &other )
+{
+    std::swap( this->data, other.data );
+    std::swap( this->length, other.length );
+    std::swap( this->capacity, other.capacity );
+    std::swap( this->initialCapacity, other.initialCapacity );
+}
+
+v8::Handle<v8::Object> CurlBuffer::release()
+{
+    v8::HandleScope scope;
+
+    node::Buffer *buffer;
+
+    if ( !this->length ) {
+
+        this->reset();
+        buffer = node::Buffer::New( 0 );
+
+        return scope.Close( buffer->handle_ );
+    }
+
+    //give back what was not used, if it's worth it
+    if ( this->capacity - this->length > this->length / 4 ) {
+
+        char *shrunk = static_cast<char*>( realloc( this->data, this->length ) );
+
+        if ( shrunk )
+            this->data = shrunk;
+    }
+
+    buffer = node::Buffer::New( this->data, this->length, CurlBuffer::FreeData, NULL );
+
+    //the memory belongs to the node::Buffer now
+    this->data     = NULL;
+    this->length   = 0;
+    this->capacity = 0;
+
+    return scope.Close( buffer->handle_ );
+}
+
+void CurlBuffer::FreeData( char *data, void *hint )
+{
+    free( data );
+}
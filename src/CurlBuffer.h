@@ -0,0 +1,43 @@
+#ifndef CURLBUFFER_H
+#define CURLBUFFER_H
+
+#include <v8.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Growable byte buffer used to accumulate data natively, its memory can be handed to js without copying.
+class CurlBuffer
+{
+public:
+
+    char  *data;
+    size_t length;
+    size_t capacity;
+
+    //initialCapacity is the amount allocated on the first append, when nothing was reserved before.
+    CurlBuffer( size_t initialCapacity = 16384 );
+
+    ~CurlBuffer();
+
+    //Make sure there is room for at least size bytes, returns false if the memory could not be allocated.
+    bool reserve( size_t size );
+
+    //Returns false, leaving the contents untouched, if the memory could not be allocated.
+    // Callers inside libcurl callbacks fail the transfer with it, instead of taking the process down.
+    bool append( const char *chunk, size_t size );
+
+    void reset();
+
+    //Exchange contents with other, used to hand the memory to another owner without copying.
+    void swap( CurlBuffer &other );
+
+    //Creates a node::Buffer that takes ownership of the memory, this buffer is left empty.
+    v8::Handle<v8::Object> release();
+
+private:
+
+    size_t initialCapacity;
+
+    static void FreeData( char *data, void *hint );
+};
+#endif
@@ -1,9 +1,10 @@
 #include "CurlHttpPost.h"
 
-CurlHttpPost::CurlHttpPost () : first( NULL ), last( NULL )
-{
+#include <node_buffer.h>
+#include <algorithm>
 
-    this->reset();
+CurlHttpPost::CurlHttpPost () : first( NULL ), last( NULL ), blockUsed( 0 ), blockSize( 0 )
+{
 
 }
 
@@ -14,74 +15,135 @@ CurlHttpPost::~CurlHttpPost ()
 
 void CurlHttpPost::reset()
 {
-    curl_httppost *current  = this->first;
+    for ( std::vector<char*>::iterator it = this->blocks.begin(), end = this->blocks.end(); it != end; ++it )
+        free( *it );
 
-    while ( current ) {
+    for ( std::vector< v8::Persistent<v8::Object> >::iterator it = this->buffers.begin(), end = this->buffers.end(); it != end; ++it )
+        it->Dispose();
 
-        curl_httppost *next = current->next;
+    this->blocks.clear();
+    this->buffers.clear();
 
-        if ( current->contenttype )
+    this->blockUsed = 0;
+    this->blockSize = 0;
 
-            free( current->contenttype );
+    this->first = NULL;
+    this->last  = NULL;
+}
 
-        if ( current->contents )
-            free( current->contents );
+//Zeroed memory from the current block, a new block is created if there is no room left.
+void *CurlHttpPost::allocate( size_t size )
+{
+    //keep the parts aligned
+    size = ( size + sizeof( void* ) - 1 ) & ~( sizeof( void* ) - 1 );
 
-        if ( current->buffer )
-            free( current->buffer );
+    if ( this->blocks.empty() || this->blockUsed + size > this->blockSize ) {
 
-        if ( current->name )
-            free( current->name );
+        this->blockSize = std::max( size, defaultBlockSize );
+        this->blockUsed = 0;
+        this->blocks.push_back( static_cast<char*>( malloc( this->blockSize ) ) );
+    }
 
-        free( current );
+    char *ptr = this->blocks.back() + this->blockUsed;
+    this->blockUsed += size;
 
-        current = next;
-    }
+    memset( ptr, 0, size );
 
-    this->first = NULL;
-    this->last  = NULL;
+    return ptr;
 }
 
 void CurlHttpPost::append()
 {
+    curl_httppost *part = static_cast<curl_httppost*>( this->allocate( sizeof( curl_httppost ) ) );
+
     if ( !this->first ) {
 
-        this->first = ( curl_httppost* ) calloc( 1, sizeof( curl_httppost ) );
+        this->first = part;
         this->last  = this->first;
 
     } else {
 
-        this->last->next = ( curl_httppost* ) calloc( 1, sizeof( curl_httppost ) );
+        this->last->next = part;
         this->last = this->last->next;
     }
 }
 
-void CurlHttpPost::set( int field, char *value, long length )
+void CurlHttpPost::set( int field, const char *value, long length )
 {
-    value = strndup( value, length );
+    char *copy = static_cast<char*>( this->allocate( length + 1 ) );
+    memcpy( copy, value, length );
 
     switch ( field ) {
 
     case NAME:
-        last->name = value;
+        last->name = copy;
         last->namelength = length;
         break;
 
     case TYPE:
-        last->contenttype = value;
+        last->contenttype = copy;
+        break;
+
+    case FILENAME:
+        last->showfilename = copy;
+        this->updateBufferPart();
         break;
 
+    //libcurl reads the file while sending it
     case FILE:
         last->flags |= HTTPPOST_FILENAME;
 
     case CONTENTS:
-        last->contents = value;
+        last->contents = copy;
         last->contentslength = length;
         break;
 
     default:
         // `default` should never be reached.
-        free(value);
         break;
     }
-}
\ No newline at end of file
+}
+
+void CurlHttpPost::setBuffer( v8::Handle<v8::Object> buffer )
+{
+    //libcurl takes a length of 0 as a zero terminated string, which the Buffer memory is not, an empty one is used instead
+    if ( !node::Buffer::Length( buffer ) ) {
+
+        last->contents = static_cast<char*>( this->allocate( 1 ) );
+        last->contentslength = 0;
+
+    } else {
+
+        this->buffers.push_back( v8::Persistent<v8::Object>::New( buffer ) );
+
+        last->contents = node::Buffer::Data( buffer );
+        last->contentslength = node::Buffer::Length( buffer );
+    }
+
+    last->flags |= HTTPPOST_PTRCONTENTS;
+
+    this->updateBufferPart();
+}
+
+void CurlHttpPost::updateBufferPart()
+{
+    if ( !( last->flags & HTTPPOST_PTRCONTENTS ) || !last->showfilename )
+        return;
+
+    last->buffer = last->contents;
+    last->bufferlength = last->contentslength;
+    last->contents = NULL;
+    last->contentslength = 0;
+    last->flags = ( last->flags & ~HTTPPOST_PTRCONTENTS ) | HTTPPOST_BUFFER | HTTPPOST_PTRBUFFER;
+}
+
+void CurlHttpPost::swap( CurlHttpPost &other )
+{
+    std::swap( this->first, other.first );
+    std::swap( this->last, other.last );
+    std::swap( this->blockUsed, other.blockUsed );
+    std::swap( this->blockSize, other.blockSize );
+
+    this->blocks.swap( other.blocks );
+    this->buffers.swap( other.buffers );
+}
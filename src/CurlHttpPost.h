@@ -1,15 +1,16 @@
 #ifndef CURLHTTPPOST_H
 #define CURLHTTPPOST_H
 
+#include <v8.h>
 #include <stdlib.h>
 #include <string.h>
+#include <vector>
 
 #include <curl/curl.h>
 
-#ifdef _WIN32
-#include "strndup.h"
-#endif
-
+//Builds the curl_httppost list used by the HTTPPOST option.
+// Parts and their fields are allocated from blocks freed together on reset, instead of one allocation each.
+// Buffer contents are not copied, they are kept alive until reset.
 class CurlHttpPost
 {
 public:
@@ -25,13 +26,34 @@ public:
         NAME,
         FILE,
         CONTENTS,
-        TYPE
+        TYPE,
+        FILENAME
     };
 
     void reset();
 
     void append();
 
-    void set( int field, char *value, long length );
+    void set( int field, const char *value, long length );
+
+    //Use the memory of the Buffer as the contents of the last part.
+    void setBuffer( v8::Handle<v8::Object> buffer );
+
+    void swap( CurlHttpPost &other );
+
+private:
+
+    std::vector<char*> blocks;
+    size_t blockUsed;
+    size_t blockSize;
+
+    std::vector< v8::Persistent<v8::Object> > buffers;
+
+    void *allocate( size_t size );
+
+    //Buffer contents with a file name are sent as a file
+    void updateBufferPart();
+
+    static const size_t defaultBlockSize = 4096;
 };
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,64 @@
+#include "CurlMessageQueue.h"
+
+//Based on Dmitry Vyukov's intrusive MPSC node-based queue,
+// http://www.1024cores.net/home/lock-free-algorithms/queues/intrusive-mpsc-node-based-queue
+CurlMessageQueue::CurlMessageQueue() : head( &stub ), tail( &stub ), stub( CurlMessage::DONE, 0 )
+{
+
+}
+
+CurlMessageQueue::~CurlMessageQueue()
+{
+    CurlMessage *message;
+
+    while ( ( message = this->Pop() ) )
+        delete message;
+}
+
+void CurlMessageQueue::Push( CurlMessage *message )
+{
+    message->next.store( NULL, std::memory_order_relaxed );
+
+    CurlMessage *prev = this->head.exchange( message, std::memory_order_acq_rel );
+
+    //between the exchange and this store the queue is "broken", Pop returns NULL until it's done
+    prev->next.store( message, std::memory_order_release );
+}
+
+CurlMessage *CurlMessageQueue::Pop()
+{
+    CurlMessage *tail = this->tail;
+    CurlMessage *next = tail->next.load( std::memory_order_acquire );
+
+    if ( tail == &this->stub ) {
+
+        if ( !next )
+            return NULL;
+
+        this->tail = next;
+        tail = next;
+        next = next->next.load( std::memory_order_acquire );
+    }
+
+    if ( next ) {
+
+        this->tail = next;
+        return tail;
+    }
+
+    if ( tail != this->head.load( std::memory_order_acquire ) )
+        return NULL;
+
+    //tail is the last message, put the stub back so it can be removed
+    this->Push( &this->stub );
+
+    next = tail->next.load( std::memory_order_acquire );
+
+    if ( next ) {
+
+        this->tail = next;
+        return tail;
+    }
+
+    return NULL;
+}
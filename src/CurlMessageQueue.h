@@ -0,0 +1,55 @@
+#ifndef CURLMESSAGEQUEUE_H
+#define CURLMESSAGEQUEUE_H
+
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+
+#include <curl/curl.h>
+
+#include "CurlBuffer.h"
+
+//Something that happened to a transfer running on a worker thread, to be handled on the main thread.
+struct CurlMessage {
+
+    enum {
+        HEADER, //staged header chunks
+        DATA,   //staged data chunks
+        DONE,   //transfer finished, result has the status
+        REMOVED //answer to CurlWorker::Remove, the worker is not using the handle anymore
+    };
+
+    CurlMessage( int type, uint32_t requestId ) : next( NULL ), type( type ), requestId( requestId ), result( CURLE_OK ) {}
+
+    std::atomic<CurlMessage*> next;
+
+    int type;
+    uint32_t requestId;
+    CURLcode result;
+
+    //chunks and the offset where each one ends, same layout used by BATCH_CALLBACKS
+    CurlBuffer chunks;
+    std::vector<size_t> ends;
+};
+
+//Intrusive multiple producer / single consumer queue, push is lock-free and wait-free.
+// Any thread can push, only the main thread can pop.
+class CurlMessageQueue {
+
+public:
+
+    CurlMessageQueue();
+    ~CurlMessageQueue();
+
+    void Push( CurlMessage *message );
+
+    //Returns NULL when empty, or when a push is still in progress, the pusher is going to notify again in that case.
+    CurlMessage *Pop();
+
+private:
+
+    std::atomic<CurlMessage*> head;
+    CurlMessage *tail;
+    CurlMessage stub;
+};
+#endif
@@ -0,0 +1,346 @@
+#include "CurlMetrics.h"
+#include "CurlBuffer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+bool CurlMetrics::isEnabled = false;
+std::vector<CurlMetrics::LabelHistograms*> CurlMetrics::labels;
+std::map<std::string, int32_t> CurlMetrics::labelIds;
+
+//Names used on the exported metrics, in the order of CurlMetrics::Phase
+static const char *phaseNames[] = {
+    "dns",
+    "connect",
+    "tls",
+    "ttfb",
+    "total"
+};
+
+//Snapshot format version, increase it when the layout changes
+static const uint32_t snapshotVersion = 1;
+
+void CurlMetrics::Initialize( v8::Handle<v8::Object> exports )
+{
+    v8::HandleScope scope;
+
+    v8::Handle<v8::Object> metrics = v8::Object::New();
+
+    NODE_SET_METHOD( metrics, "_enable", CurlMetrics::Enable );
+    NODE_SET_METHOD( metrics, "_reset", CurlMetrics::Reset );
+    NODE_SET_METHOD( metrics, "_toPrometheus", CurlMetrics::ToPrometheus );
+    NODE_SET_METHOD( metrics, "_getSnapshot", CurlMetrics::GetSnapshot );
+    NODE_SET_METHOD( metrics, "_quantile", CurlMetrics::Quantile );
+
+    exports->Set( v8::String::NewSymbol( "Metrics" ), metrics );
+
+    //handles without a label use this one
+    CurlMetrics::GetLabelId( "" );
+}
+
+int32_t CurlMetrics::GetLabelId( const std::string &label )
+{
+    std::map<std::string, int32_t>::iterator it = CurlMetrics::labelIds.find( label );
+
+    if ( it != CurlMetrics::labelIds.end() )
+        return it->second;
+
+    if ( CurlMetrics::labels.size() >= maxLabels )
+        return -1;
+
+    //value-initialized, the histograms start zeroed
+    LabelHistograms *histograms = new LabelHistograms();
+    histograms->label = label;
+
+    int32_t id = static_cast<int32_t>( CurlMetrics::labels.size() );
+
+    CurlMetrics::labels.push_back( histograms );
+    CurlMetrics::labelIds[label] = id;
+
+    return id;
+}
+
+void CurlMetrics::Record( int32_t labelId, double total, double nameLookup, double connect, double appConnect, double startTransfer )
+{
+    if ( labelId < 0 || labelId >= static_cast<int32_t>( CurlMetrics::labels.size() ) )
+        labelId = 0;
+
+    Histogram *phases = CurlMetrics::labels[labelId]->phases;
+
+    CurlMetrics::Add( phases[PHASE_DNS], nameLookup );
+    CurlMetrics::Add( phases[PHASE_CONNECT], connect - nameLookup );
+
+    //only when there was a handshake
+    if ( appConnect > 0 )
+        CurlMetrics::Add( phases[PHASE_TLS], appConnect - connect );
+
+    CurlMetrics::Add( phases[PHASE_TTFB], startTransfer );
+    CurlMetrics::Add( phases[PHASE_TOTAL], total );
+}
+
+//Values below subBucketCount have a bucket each, after that each power of two has subBucketCount buckets.
+int CurlMetrics::GetBucket( uint64_t value )
+{
+    if ( value < static_cast<uint64_t>( subBucketCount ) )
+        return static_cast<int>( value );
+
+    int exponent = subBucketBits;
+
+    while ( exponent < 63 && ( value >> ( exponent + 1 ) ) )
+        ++exponent;
+
+    if ( exponent > maxExponent )
+        return bucketCount - 1;
+
+    int shift = exponent - subBucketBits;
+
+    return ( shift + 1 ) * subBucketCount + static_cast<int>( ( value >> shift ) - subBucketCount );
+}
+
+//First value of the next bucket
+uint64_t CurlMetrics::GetBucketUpperBound( int bucket )
+{
+    ++bucket;
+
+    if ( bucket < subBucketCount )
+        return static_cast<uint64_t>( bucket );
+
+    int group = bucket / subBucketCount;
+    int subBucket = bucket % subBucketCount;
+
+    return static_cast<uint64_t>( subBucketCount + subBucket ) << ( group - 1 );
+}
+
+void CurlMetrics::Add( Histogram &histogram, double seconds )
+{
+    //the phases are computed from the infos, which could be missing
+    if ( seconds < 0 )
+        seconds = 0;
+
+    ++histogram.count;
+    histogram.sum += seconds;
+    ++histogram.buckets[CurlMetrics::GetBucket( static_cast<uint64_t>( seconds * 1e6 + 0.5 ) )];
+}
+
+//Upper bound of the bucket with the given quantile, in seconds. 0 if there is nothing recorded.
+double CurlMetrics::GetQuantile( const Histogram &histogram, double quantile )
+{
+    if ( !histogram.count )
+        return 0;
+
+    uint64_t rank = static_cast<uint64_t>( quantile * histogram.count + 0.5 );
+    uint64_t seen = 0;
+
+    if ( rank < 1 )
+        rank = 1;
+
+    for ( int i = 0; i < bucketCount; i++ ) {
+
+        seen += histogram.buckets[i];
+
+        if ( seen >= rank )
+            return CurlMetrics::GetBucketUpperBound( i ) / 1e6;
+    }
+
+    return CurlMetrics::GetBucketUpperBound( bucketCount - 1 ) / 1e6;
+}
+
+//Start or stop recording the transfers.
+v8::Handle<v8::Value> CurlMetrics::Enable( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    CurlMetrics::isEnabled = args[0]->BooleanValue();
+
+    return v8::Undefined();
+}
+
+//Clear all histograms, the labels are kept.
+v8::Handle<v8::Value> CurlMetrics::Reset( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    for ( std::vector<LabelHistograms*>::iterator it = CurlMetrics::labels.begin(), end = CurlMetrics::labels.end(); it != end; ++it )
+        memset( (*it)->phases, 0, sizeof( (*it)->phases ) );
+
+    return v8::Undefined();
+}
+
+//Label values of the Prometheus text format can have any character, but \, " and new lines must be escaped.
+static std::string EscapeLabelValue( const std::string &value )
+{
+    std::string escaped;
+
+    escaped.reserve( value.length() );
+
+    for ( std::string::const_iterator it = value.begin(), end = value.end(); it != end; ++it ) {
+
+        switch ( *it ) {
+            case '\\': escaped += "\\\\"; break;
+            case '"':  escaped += "\\\""; break;
+            case '\n': escaped += "\\n"; break;
+            default:   escaped += *it;
+        }
+    }
+
+    return escaped;
+}
+
+//Numbers are formatted on their own, the lines can have labels of any length.
+static std::string FormatNumber( const char *format, double value )
+{
+    char number[64];
+
+    snprintf( number, sizeof( number ), format, value );
+
+    return number;
+}
+
+//Prometheus text format, one histogram with the phase and label as labels. Only buckets with values are written.
+v8::Handle<v8::Value> CurlMetrics::ToPrometheus( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    std::string name = "curl_phase_duration_seconds";
+
+    if ( args[0]->IsString() )
+        name = *v8::String::Utf8Value( args[0] );
+
+    std::string text;
+
+    text += "# HELP " + name + " Duration of the phases of the completed transfers.\n";
+    text += "# TYPE " + name + " histogram\n";
+
+    for ( std::vector<LabelHistograms*>::iterator it = CurlMetrics::labels.begin(), end = CurlMetrics::labels.end(); it != end; ++it ) {
+
+        LabelHistograms *histograms = *it;
+
+        for ( int phase = 0; phase < PHASE_COUNT; phase++ ) {
+
+            Histogram &histogram = histograms->phases[phase];
+
+            if ( !histogram.count )
+                continue;
+
+            std::string labels = std::string( "phase=\"" ) + phaseNames[phase] + "\"";
+
+            if ( !histograms->label.empty() )
+                labels += ",label=\"" + EscapeLabelValue( histograms->label ) + "\"";
+
+            uint64_t cumulative = 0;
+
+            for ( int i = 0; i < bucketCount; i++ ) {
+
+                if ( !histogram.buckets[i] )
+                    continue;
+
+                cumulative += histogram.buckets[i];
+
+                text += name + "_bucket{" + labels + ",le=\"" + FormatNumber( "%.9g", CurlMetrics::GetBucketUpperBound( i ) / 1e6 ) + "\"} " + FormatNumber( "%.0f", static_cast<double>( cumulative ) ) + "\n";
+            }
+
+            std::string count = FormatNumber( "%.0f", static_cast<double>( histogram.count ) );
+
+            text += name + "_bucket{" + labels + ",le=\"+Inf\"} " + count + "\n";
+            text += name + "_sum{" + labels + "} " + FormatNumber( "%.9g", histogram.sum ) + "\n";
+            text += name + "_count{" + labels + "} " + count + "\n";
+        }
+    }
+
+    return scope.Close( v8::String::New( text.c_str(), static_cast<int>( text.length() ) ) );
+}
+
+//Binary snapshot, in the host byte order:
+// uint32 version, subBucketBits, bucketCount, phaseCount, labelCount
+// for each label: uint32 label length, label bytes,
+//   for each phase: uint64 count, double sum, uint32 amount of buckets with values, then (uint32 bucket, uint64 count) for each of them
+v8::Handle<v8::Value> CurlMetrics::GetSnapshot( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    CurlBuffer snapshot;
+    bool isAllocated = true;
+
+    uint32_t header[] = { snapshotVersion, subBucketBits, bucketCount, PHASE_COUNT, static_cast<uint32_t>( CurlMetrics::labels.size() ) };
+    isAllocated &= snapshot.append( reinterpret_cast<const char*>( header ), sizeof( header ) );
+
+    for ( std::vector<LabelHistograms*>::iterator it = CurlMetrics::labels.begin(), end = CurlMetrics::labels.end(); it != end; ++it ) {
+
+        LabelHistograms *histograms = *it;
+
+        uint32_t labelLength = static_cast<uint32_t>( histograms->label.length() );
+
+        isAllocated &= snapshot.append( reinterpret_cast<const char*>( &labelLength ), sizeof( labelLength ) );
+        isAllocated &= snapshot.append( histograms->label.data(), labelLength );
+
+        for ( int phase = 0; phase < PHASE_COUNT; phase++ ) {
+
+            Histogram &histogram = histograms->phases[phase];
+
+            uint32_t used = 0;
+
+            for ( int i = 0; i < bucketCount; i++ )
+                used += histogram.buckets[i] ? 1 : 0;
+
+            isAllocated &= snapshot.append( reinterpret_cast<const char*>( &histogram.count ), sizeof( histogram.count ) );
+            isAllocated &= snapshot.append( reinterpret_cast<const char*>( &histogram.sum ), sizeof( histogram.sum ) );
+            isAllocated &= snapshot.append( reinterpret_cast<const char*>( &used ), sizeof( used ) );
+
+            for ( uint32_t i = 0; i < static_cast<uint32_t>( bucketCount ); i++ ) {
+
+                if ( !histogram.buckets[i] )
+                    continue;
+
+                isAllocated &= snapshot.append( reinterpret_cast<const char*>( &i ), sizeof( i ) );
+                isAllocated &= snapshot.append( reinterpret_cast<const char*>( &histogram.buckets[i] ), sizeof( histogram.buckets[i] ) );
+            }
+        }
+    }
+
+    if ( !isAllocated ) {
+        v8::ThrowException( v8::Exception::Error( v8::String::New( "Could not allocate memory for the snapshot." ) ) );
+        return v8::Undefined();
+    }
+
+    return scope.Close( snapshot.release() );
+}
+
+//quantile( phase, quantile, label ), returns seconds.
+v8::Handle<v8::Value> CurlMetrics::Quantile( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    int phase = -1;
+
+    if ( args[0]->IsString() ) {
+
+        v8::String::Utf8Value phaseName( args[0] );
+
+        for ( int i = 0; i < PHASE_COUNT; i++ ) {
+
+            if ( !strcmp( *phaseName, phaseNames[i] ) )
+                phase = i;
+        }
+    }
+
+    if ( phase < 0 ) {
+        v8::ThrowException( v8::Exception::TypeError( v8::String::New( "Phase must be one of dns, connect, tls, ttfb or total." ) ) );
+        return v8::Undefined();
+    }
+
+    std::string label = args[2]->IsString() ? *v8::String::Utf8Value( args[2] ) : "";
+
+    std::map<std::string, int32_t>::iterator it = CurlMetrics::labelIds.find( label );
+
+    if ( it == CurlMetrics::labelIds.end() )
+        return scope.Close( v8::Number::New( 0 ) );
+
+    double quantile = args[1]->NumberValue();
+
+    if ( !( quantile >= 0 && quantile <= 1 ) ) {
+        v8::ThrowException( v8::Exception::RangeError( v8::String::New( "Quantile must be between 0 and 1." ) ) );
+        return v8::Undefined();
+    }
+
+    return scope.Close( v8::Number::New( CurlMetrics::GetQuantile( CurlMetrics::labels[it->second]->phases[phase], quantile ) ) );
+}
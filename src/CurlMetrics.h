@@ -0,0 +1,77 @@
+#ifndef CURLMETRICS_H
+#define CURLMETRICS_H
+
+#include <v8.h>
+#include <node.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+//Latency histograms of the phases of the completed transfers, kept for each label set on the handles.
+// Values are stored in microseconds, on log-linear buckets: each power of two is split in subBucketCount
+// buckets, so the error is below 1 / subBucketCount. Memory is fixed, maxLabels sets of histograms at most.
+class CurlMetrics {
+
+public:
+
+    enum Phase {
+        PHASE_DNS,
+        PHASE_CONNECT,
+        PHASE_TLS,
+        PHASE_TTFB,
+        PHASE_TOTAL,
+        PHASE_COUNT
+    };
+
+    //Export Metrics to js
+    static void Initialize( v8::Handle<v8::Object> exports );
+
+    static bool IsEnabled()
+    {
+        return isEnabled;
+    }
+
+    //Id of the given label, creating it if needed. Returns -1 if there are already maxLabels.
+    static int32_t GetLabelId( const std::string &label );
+
+    //Record a completed transfer, durations are the TOTAL_TIME, NAMELOOKUP_TIME, CONNECT_TIME, APPCONNECT_TIME and STARTTRANSFER_TIME infos.
+    static void Record( int32_t labelId, double total, double nameLookup, double connect, double appConnect, double startTransfer );
+
+private:
+
+    static const int subBucketBits = 4;
+    static const int subBucketCount = 1 << subBucketBits;
+    static const int maxExponent = 36; //~19 hours, bigger values go to the last bucket
+    static const int bucketCount = ( maxExponent - subBucketBits + 2 ) * subBucketCount;
+    static const size_t maxLabels = 64;
+
+    struct Histogram {
+        uint64_t count;
+        double sum; //seconds
+        uint64_t buckets[bucketCount];
+    };
+
+    struct LabelHistograms {
+        std::string label;
+        Histogram phases[PHASE_COUNT];
+    };
+
+    static bool isEnabled;
+    static std::vector<LabelHistograms*> labels;
+    static std::map<std::string, int32_t> labelIds;
+
+    static int GetBucket( uint64_t value );
+    static uint64_t GetBucketUpperBound( int bucket );
+    static void Add( Histogram &histogram, double seconds );
+    static double GetQuantile( const Histogram &histogram, double quantile );
+
+    //Js exported Methods
+    static v8::Handle<v8::Value> Enable( const v8::Arguments &args );
+    static v8::Handle<v8::Value> Reset( const v8::Arguments &args );
+    static v8::Handle<v8::Value> ToPrometheus( const v8::Arguments &args );
+    static v8::Handle<v8::Value> GetSnapshot( const v8::Arguments &args );
+    static v8::Handle<v8::Value> Quantile( const v8::Arguments &args );
+};
+
+#endif
@@ -0,0 +1,1292 @@
+#include "CurlMulti.h"
+#include "CurlStats.h"
+#include "CurlWorker.h"
+#include "Curl.h"
+
+#include <iostream>
+#include <stdlib.h>
+
+#define X(name) {#name, CURLMOPT_##name}
+Curl::CurlOption curlMultiOptionsInteger[] = {
+    X(PIPELINING),
+    X(MAXCONNECTS),
+
+#if LIBCURL_VERSION_NUM >= 0x071e00
+    X(MAX_HOST_CONNECTIONS),
+    X(MAX_PIPELINE_LENGTH),
+    X(MAX_TOTAL_CONNECTIONS)
+#endif
+};
+
+#if LIBCURL_VERSION_NUM >= 0x071e00
+Curl::CurlOption curlMultiOptionsOfft[] = {
+    X(CONTENT_LENGTH_PENALTY_SIZE),
+    X(CHUNK_LENGTH_PENALTY_SIZE)
+};
+#endif
+#undef X
+
+//For use with the PIPELINING option.
+Curl::CurlOption curlMultiPipe[] = {
+#if LIBCURL_VERSION_NUM >= 0x072b00
+    {"NOTHING", CURLPIPE_NOTHING},
+    {"HTTP1", CURLPIPE_HTTP1},
+    {"MULTIPLEX", CURLPIPE_MULTIPLEX}
+#else
+    {"NOTHING", 0},
+    {"HTTP1", 1}
+#endif
+};
+
+//Priorities of the scheduler, for use with Curl#setPriority.
+Curl::CurlOption curlMultiPriority[] = {
+    {"HIGH", CurlScheduler::PRIORITY_HIGH},
+    {"NORMAL", CurlScheduler::PRIORITY_NORMAL},
+    {"LOW", CurlScheduler::PRIORITY_LOW}
+};
+
+//Initialize static properties
+v8::Persistent<v8::Function> CurlMulti::constructor;
+v8::Persistent<v8::FunctionTemplate> CurlMulti::constructorTemplate;
+CurlMulti *CurlMulti::defaultMulti = NULL;
+
+// Add Multi constructor to the module exports
+void CurlMulti::Initialize( v8::Handle<v8::Object> exports ) {
+
+    v8::HandleScope scope;
+
+    //** Construct Multi js "class"
+    v8::Handle<v8::FunctionTemplate> tpl = v8::FunctionTemplate::New( CurlMulti::New );
+
+    tpl->SetClassName( v8::String::NewSymbol( "Multi" ) );
+    tpl->InstanceTemplate()->SetInternalFieldCount( 1 ); //to wrap this
+
+    // Prototype Methods
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_setOpt", CurlMulti::SetOpt );
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_getCount", CurlMulti::GetCount );
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_setScheduler", CurlMulti::SetScheduler );
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_getSchedulerStats", CurlMulti::GetSchedulerStats );
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_setCompletionBudget", CurlMulti::SetCompletionBudget );
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_close", CurlMulti::Close );
+
+    // Static Methods
+    NODE_SET_METHOD( tpl, "getDefault", CurlMulti::GetDefaultMulti );
+
+    v8::Handle<v8::Function> tplFunction = tpl->GetFunction();
+
+    // Export cURL multi Constants
+    v8::Handle<v8::Object> optionsObj = v8::Object::New();
+    v8::Handle<v8::Object> pipeObj    = v8::Object::New();
+    v8::Handle<v8::Object> priorityObj = v8::Object::New();
+
+    Curl::ExportConstants( &optionsObj, curlMultiOptionsInteger, sizeof( curlMultiOptionsInteger ), nullptr, nullptr );
+#if LIBCURL_VERSION_NUM >= 0x071e00
+    Curl::ExportConstants( &optionsObj, curlMultiOptionsOfft, sizeof( curlMultiOptionsOfft ), nullptr, nullptr );
+#endif
+    Curl::ExportConstants( &pipeObj, curlMultiPipe, sizeof( curlMultiPipe ), nullptr, nullptr );
+    Curl::ExportConstants( &priorityObj, curlMultiPriority, sizeof( curlMultiPriority ), nullptr, nullptr );
+
+    tplFunction->Set( v8::String::NewSymbol( "option" ), optionsObj, static_cast<v8::PropertyAttribute>( v8::ReadOnly|v8::DontDelete ) );
+    tplFunction->Set( v8::String::NewSymbol( "pipe" ), pipeObj, static_cast<v8::PropertyAttribute>( v8::ReadOnly|v8::DontDelete ) );
+    tplFunction->Set( v8::String::NewSymbol( "priority" ), priorityObj, static_cast<v8::PropertyAttribute>( v8::ReadOnly|v8::DontDelete ) );
+
+    CurlMulti::constructorTemplate = v8::Persistent<v8::FunctionTemplate>::New( tpl );
+    CurlMulti::constructor = v8::Persistent<v8::Function>::New( tplFunction );
+
+    //the default multi lives for the whole process, so its handle is not weak.
+    v8::Handle<v8::Object> defaultObj = CurlMulti::constructor->NewInstance();
+
+    CurlMulti::defaultMulti = CurlMulti::Unwrap( defaultObj );
+    CurlMulti::defaultMulti->handle.ClearWeak();
+
+    exports->Set( v8::String::NewSymbol( "Multi" ), CurlMulti::constructor );
+}
+
+CurlMulti::CurlMulti( v8::Handle<v8::Object> obj, int threads ) : multi( NULL ), timeoutDue( 0 ), runningHandles( 0 ), handlesCount( 0 ), pendingCloses( 0 ), scheduler( NULL ), isSchedulerEnabled( false ), maxCompletions( 0 ), maxCompletionTime( 0 ), deferredMessages( 0 ), nextWorker( 0 ), lastRequestId( 0 )
+{
+    obj->SetPointerInInternalField( 0, this );
+
+    this->handle = v8::Persistent<v8::Object>::New( obj );
+    this->handle.MakeWeak( this, CurlMulti::Destructor );
+
+    //init uv timer to be used with HandleTimeout
+    int timerStatus = uv_timer_init( uv_default_loop(), &this->timeout );
+    assert( timerStatus == 0 );
+
+    this->timeout.data = this;
+
+    uv_idle_init( uv_default_loop(), &this->immediateTimeout );
+    this->immediateTimeout.data = this;
+
+    uv_idle_init( uv_default_loop(), &this->deferredCompletions );
+    this->deferredCompletions.data = this;
+
+    uv_idle_init( uv_default_loop(), &this->pendingAdmission );
+    this->pendingAdmission.data = this;
+
+    //only keeps the loop alive while there are transfers running on the workers
+    uv_async_init( uv_default_loop(), &this->completionsNotify, CurlMulti::OnCompletions );
+    uv_unref( reinterpret_cast<uv_handle_t*>( &this->completionsNotify ) );
+
+    this->completionsNotify.data = this;
+
+    if ( threads > 0 ) {
+
+        for ( int i = 0; i < threads; ++i ) {
+
+            CurlWorker *worker = new CurlWorker( &this->completions, &this->completionsNotify );
+
+            if ( !worker->Start() ) {
+
+                delete worker;
+                this->Cleanup();
+
+                Curl::Raise( "Could not start the Multi worker threads." );
+                return;
+            }
+
+            this->workers.push_back( worker );
+        }
+
+        return;
+    }
+
+    this->multi = curl_multi_init();
+
+    if ( !this->multi ) {
+
+        Curl::Raise( "curl_multi_init failed!" );
+        return;
+    }
+
+    //set curl_multi callbacks to use libuv
+    curl_multi_setopt( this->multi, CURLMOPT_SOCKETFUNCTION, CurlMulti::HandleSocket );
+    curl_multi_setopt( this->multi, CURLMOPT_SOCKETDATA, this );
+    curl_multi_setopt( this->multi, CURLMOPT_TIMERFUNCTION, CurlMulti::HandleTimeout );
+    curl_multi_setopt( this->multi, CURLMOPT_TIMERDATA, this );
+}
+
+CurlMulti::~CurlMulti()
+{
+    this->Cleanup();
+
+    delete this->scheduler;
+}
+
+//Release the curl_multi handle and the sockets being watched, the instance cannot be used after that.
+void CurlMulti::Cleanup()
+{
+    CurlMessage *message;
+
+    uv_idle_stop( &this->deferredCompletions );
+    uv_idle_stop( &this->pendingAdmission );
+
+    if ( !this->workers.empty() ) {
+
+        for ( std::vector<CurlWorker*>::iterator it = this->workers.begin(), end = this->workers.end(); it != end; ++it ) {
+
+            (*it)->Stop();
+            delete *it;
+        }
+
+        this->workers.clear();
+        this->requests.clear();
+
+        //the workers are stopped, nothing is using these handles anymore
+        for ( std::map<uint32_t, Curl*>::iterator it = this->detaching.begin(), end = this->detaching.end(); it != end; ++it ) {
+
+            Curl *curl = it->second;
+
+            curl->worker = NULL;
+            curl->requestId = 0;
+            curl->detachResult = CURLE_OK;
+            CurlMulti::SetRunning( curl, false );
+
+            if ( curl->isDisposed )
+                delete curl;
+        }
+
+        this->detaching.clear();
+
+        for ( std::deque<CurlMessage*>::iterator it = this->deferredQueue.begin(), end = this->deferredQueue.end(); it != end; ++it )
+            delete *it;
+
+        this->deferredQueue.clear();
+
+        while ( ( message = this->completions.Pop() ) )
+            delete message;
+    }
+
+    if ( !this->multi )
+        return;
+
+    curl_multi_cleanup( this->multi );
+    this->multi = NULL;
+
+    uv_timer_stop( &this->timeout );
+    uv_idle_stop( &this->immediateTimeout );
+    this->timeoutDue = 0;
+
+    for ( std::vector<CurlSocketContext*>::iterator it = this->sockets.begin(), end = this->sockets.end(); it != end; ++it ) {
+
+        if ( !*it )
+            continue;
+
+        if ( (*it)->isActive )
+            CurlStats::Add( CurlStats::ACTIVE_SOCKETS, -1 );
+
+        uv_poll_stop( &(*it)->pollHandle );
+        uv_close( reinterpret_cast<uv_handle_t*>( &(*it)->pollHandle ), CurlMulti::OnCurlSocketClose );
+    }
+
+    this->sockets.clear();
+}
+
+//Dispose persistent handler, and delete itself after the timer is closed
+void CurlMulti::Dispose()
+{
+    this->Cleanup();
+
+    this->handle->SetPointerInInternalField( 0, NULL );
+
+    this->handle.Dispose();
+    this->handle.Clear();
+
+    this->pendingCloses = 5;
+
+    uv_close( reinterpret_cast<uv_handle_t*>( &this->timeout ), CurlMulti::OnHandleClose );
+    uv_close( reinterpret_cast<uv_handle_t*>( &this->immediateTimeout ), CurlMulti::OnHandleClose );
+    uv_close( reinterpret_cast<uv_handle_t*>( &this->deferredCompletions ), CurlMulti::OnHandleClose );
+    uv_close( reinterpret_cast<uv_handle_t*>( &this->pendingAdmission ), CurlMulti::OnHandleClose );
+    uv_close( reinterpret_cast<uv_handle_t*>( &this->completionsNotify ), CurlMulti::OnHandleClose );
+}
+
+void CurlMulti::OnHandleClose( uv_handle_t *handle )
+{
+    CurlMulti *obj = static_cast<CurlMulti*>( handle->data );
+
+    if ( !--obj->pendingCloses )
+        delete obj;
+}
+
+CurlMulti *CurlMulti::GetDefault()
+{
+    return CurlMulti::defaultMulti;
+}
+
+CurlMulti* CurlMulti::Unwrap( v8::Handle<v8::Object> value )
+{
+    return static_cast<CurlMulti*>( value->GetPointerFromInternalField( 0 ) );
+}
+
+bool CurlMulti::HasInstance( v8::Handle<v8::Value> value )
+{
+    return value->IsObject() && CurlMulti::constructorTemplate->HasInstance( value );
+}
+
+bool CurlMulti::IsClosed() const
+{
+    return this->multi == NULL && this->workers.empty();
+}
+
+bool CurlMulti::IsThreaded() const
+{
+    return !this->workers.empty();
+}
+
+//isInsideMultiCurl is only changed here, to keep the amount of handles running without going through all of them.
+void CurlMulti::SetRunning( Curl *curl, bool isRunning )
+{
+    if ( curl->isInsideMultiCurl == isRunning )
+        return;
+
+    curl->isInsideMultiCurl = isRunning;
+
+    CurlStats::Add( CurlStats::ACTIVE_HANDLES, isRunning ? 1 : -1 );
+}
+
+//Start the transfer of the handle, or queue it on the scheduler until there is a free slot.
+CURLMcode CurlMulti::AddHandle( Curl *curl )
+{
+    if ( !this->isSchedulerEnabled )
+        return this->AdmitHandle( curl );
+
+    //a handle waiting is already counted as running
+    CurlMulti::SetRunning( curl, true );
+
+    this->scheduler->Push( curl, curl->GetHostKey(), curl->priority );
+
+    CURLMcode code = this->AdmitQueued( curl );
+
+    if ( code != CURLM_OK ) {
+
+        this->scheduler->Remove( curl );
+        CurlMulti::SetRunning( curl, false );
+    }
+
+    return code;
+}
+
+//Start the handles waiting on the scheduler while there are free slots.
+// Returns the result of starting caller, if it was one of them, the others that cannot be started get an error event.
+CURLMcode CurlMulti::AdmitQueued( Curl *caller )
+{
+    CurlScheduler::Entry entry;
+    CURLMcode result = CURLM_OK;
+
+    while ( this->scheduler->Next( entry ) ) {
+
+        Curl *curl = entry.curl;
+
+        CURLMcode code = this->AdmitHandle( curl );
+
+        if ( code == CURLM_OK )
+            continue;
+
+#if LIBCURL_VERSION_NUM >= 0x073b00
+        //performed from inside a libcurl callback, the ones waiting can be started on the next loop iteration
+        if ( code == CURLM_RECURSIVE_API_CALL && curl != caller ) {
+
+            this->scheduler->Unpop( entry );
+            uv_idle_start( &this->pendingAdmission, CurlMulti::OnPendingAdmission );
+            break;
+        }
+#endif
+
+        //not put back, it would keep the ones behind it waiting
+        this->scheduler->Release( curl );
+        CurlMulti::SetRunning( curl, false );
+
+        //perform throws for it
+        if ( curl == caller ) {
+
+            result = code;
+            continue;
+        }
+
+        curl->OnError( code == CURLM_OUT_OF_MEMORY ? CURLE_OUT_OF_MEMORY : CURLE_FAILED_INIT );
+    }
+
+    return result;
+}
+
+//The slot used by the handle on the scheduler is free, the handles waiting are started after the current messages
+// are processed, or on the next loop iteration when it's not called from there.
+void CurlMulti::ReleaseSlot( Curl *curl )
+{
+    if ( !curl->schedulerHost )
+        return;
+
+    this->scheduler->Release( curl );
+
+    if ( this->scheduler->GetQueued() )
+        uv_idle_start( &this->pendingAdmission, CurlMulti::OnPendingAdmission );
+}
+
+void CurlMulti::OnPendingAdmission( uv_idle_t *handle, int status )
+{
+    CurlMulti *obj = static_cast<CurlMulti*>( handle->data );
+
+    uv_idle_stop( handle );
+
+    if ( obj->IsClosed() || !obj->scheduler->GetQueued() )
+        return;
+
+    obj->AdmitQueued();
+}
+
+//Pass the times of a finished transfer to the adaptive limit of the scheduler, before its slot is released.
+void CurlMulti::SampleTransfer( Curl *curl, CURLcode result )
+{
+    if ( !curl->schedulerHost || !this->scheduler->IsAdaptive() )
+        return;
+
+    double startTransferTime = 0;
+    double totalTime = 0;
+    long responseCode = 0;
+
+    curl_easy_getinfo( curl->curl, CURLINFO_STARTTRANSFER_TIME, &startTransferTime );
+    curl_easy_getinfo( curl->curl, CURLINFO_TOTAL_TIME, &totalTime );
+    curl_easy_getinfo( curl->curl, CURLINFO_RESPONSE_CODE, &responseCode );
+
+    //the host is overloaded, or asking to slow down
+    bool isFailed = result == CURLE_OPERATION_TIMEDOUT || result == CURLE_COULDNT_CONNECT || responseCode == 429 || responseCode == 503;
+
+    this->scheduler->Sample( curl, startTransferTime, totalTime, isFailed );
+}
+
+//The notify handle keeps the loop alive while there are transfers running on the workers.
+// Handles waiting on the scheduler always have a running transfer ahead of them, which keeps it alive.
+void CurlMulti::RefNotify()
+{
+    uv_handle_t *notify = reinterpret_cast<uv_handle_t*>( &this->completionsNotify );
+
+    if ( this->IsThreaded() && this->handlesCount )
+        uv_ref( notify );
+    else
+        uv_unref( notify );
+}
+
+CURLMcode CurlMulti::AdmitHandle( Curl *curl )
+{
+    if ( this->IsThreaded() ) {
+
+        //spread the transfers between the workers
+        CurlWorker *worker = this->workers[this->nextWorker++ % this->workers.size()];
+
+        if ( !++this->lastRequestId )
+            ++this->lastRequestId; //0 is never used
+
+        curl->worker = worker;
+        curl->requestId = this->lastRequestId;
+        CurlMulti::SetRunning( curl, true );
+
+        this->requests[curl->requestId] = curl;
+
+        ++this->handlesCount;
+        this->RefNotify();
+
+        worker->Add( curl, curl->requestId );
+
+        return CURLM_OK;
+    }
+
+    if ( !this->multi )
+        return CURLM_BAD_HANDLE;
+
+    CURLMcode code = curl_multi_add_handle( this->multi, curl->curl );
+
+    if ( code == CURLM_OK ) {
+
+        CurlMulti::SetRunning( curl, true );
+        ++this->handlesCount;
+    }
+
+    return code;
+}
+
+CURLMcode CurlMulti::RemoveHandle( Curl *curl )
+{
+    //not started yet
+    if ( curl->isQueued ) {
+
+        this->scheduler->Remove( curl );
+        CurlMulti::SetRunning( curl, false );
+
+        return CURLM_OK;
+    }
+
+    if ( curl->worker ) {
+
+        //already waiting for the worker
+        if ( this->detaching.count( curl->requestId ) )
+            return CURLM_OK;
+
+        //messages still queued for it are dropped from now on, the handle stays running until the worker answers
+        this->requests.erase( curl->requestId );
+        this->detaching[curl->requestId] = curl;
+
+        curl->worker->Remove( curl, curl->requestId );
+
+        return CURLM_OK;
+    }
+
+    if ( !this->multi )
+        return CURLM_BAD_HANDLE;
+
+    CURLMcode code = curl_multi_remove_handle( this->multi, curl->curl );
+
+    if ( code == CURLM_OK ) {
+
+        CurlMulti::SetRunning( curl, false );
+        --this->handlesCount;
+
+        this->ReleaseSlot( curl );
+    }
+
+    return code;
+}
+
+//Handle is back on the main thread, messages still queued for it are going to be dropped.
+void CurlMulti::OnHandleRemoved( Curl *curl )
+{
+    this->requests.erase( curl->requestId );
+
+    curl->worker = NULL;
+    curl->requestId = 0;
+    CurlMulti::SetRunning( curl, false );
+
+    --this->handlesCount;
+
+    this->ReleaseSlot( curl );
+    this->RefNotify();
+}
+
+//The worker answered the removal of the handle, it can be used, or deleted, by the main thread again.
+void CurlMulti::OnHandleDetached( uint32_t requestId )
+{
+    std::map<uint32_t, Curl*>::iterator it = this->detaching.find( requestId );
+
+    if ( it == this->detaching.end() )
+        return;
+
+    Curl *curl = it->second;
+    CURLcode statusCode = curl->detachResult;
+
+    this->detaching.erase( it );
+    this->OnHandleRemoved( curl );
+
+    curl->detachResult = CURLE_OK;
+
+    //closed while the worker was still using it
+    if ( curl->isDisposed ) {
+
+        delete curl;
+        return;
+    }
+
+    if ( statusCode != CURLE_OK )
+        curl->OnError( statusCode );
+}
+
+//The curl_multi_socket_action(3) function informs the application about updates
+//  in the socket (file descriptor) status by doing none, one, or multiple calls to this function
+int CurlMulti::HandleSocket( CURL *easy, curl_socket_t s, int action, void *userp, void *socketp )
+{
+    CurlMulti *obj = static_cast<CurlMulti*>( userp );
+    CurlSocketContext *ctx;
+    uv_err_s error;
+
+    if ( action == CURL_POLL_IN || action == CURL_POLL_OUT || action == CURL_POLL_INOUT || action == CURL_POLL_NONE ) {
+
+        //create ctx if it doesn't exists and assign it to the current socket,
+        ctx = ( socketp ) ? static_cast<CurlSocketContext*>( socketp ) : obj->CreateCurlSocketContext( s );
+        curl_multi_assign( obj->multi, s, static_cast<void*>( ctx ) );
+
+        //set event based on the current action
+        int events = 0;
+
+        switch ( action ) {
+
+        case CURL_POLL_IN:
+            events |= UV_READABLE;
+            break;
+        case CURL_POLL_OUT:
+            events |= UV_WRITABLE;
+            break;
+        case CURL_POLL_INOUT:
+            events |= UV_READABLE | UV_WRITABLE;
+            break;
+        }
+
+        //call process when possible
+        return uv_poll_start( &ctx->pollHandle, events, CurlMulti::Process );
+    }
+
+    //action == CURL_POLL_REMOVE
+    if ( action == CURL_POLL_REMOVE && socketp ) {
+
+        ctx = static_cast<CurlSocketContext*>( socketp );
+
+        uv_poll_stop( &ctx->pollHandle );
+        curl_multi_assign( obj->multi, s, NULL );
+
+        obj->DestroyCurlSocketContext( ctx );
+
+        return 0;
+    }
+
+    //this should NEVER happen, I don't even know why this is here.
+    error = uv_last_error( uv_default_loop() );
+    std::cerr << uv_err_name( error ) << " " << uv_strerror( error );
+    abort();
+}
+
+//Creates a Context to be used to store data between events, or reuses the one left by the last socket with this fd
+CurlMulti::CurlSocketContext* CurlMulti::CreateCurlSocketContext( curl_socket_t sockfd )
+{
+    int r;
+    uv_err_s error;
+    CurlSocketContext *ctx = NULL;
+    size_t slot = static_cast<size_t>( sockfd );
+
+    if ( slot >= this->sockets.size() )
+        this->sockets.resize( slot + 1, NULL );
+
+    ctx = this->sockets[slot];
+
+    if ( ctx ) {
+
+        ctx->isActive = true;
+
+        CurlStats::Add( CurlStats::ACTIVE_SOCKETS );
+
+        return ctx;
+    }
+
+    ctx = static_cast<CurlSocketContext*>( malloc( sizeof( *ctx ) ) );
+
+    ctx->sockfd   = sockfd;
+    ctx->multi    = this;
+    ctx->isActive = true;
+
+    //uv_poll simply watches file descriptors using the operating system notification mechanism
+    //Whenever the OS notices a change of state in file descriptors being polled, libuv will invoke the associated callback.
+    r = uv_poll_init_socket( uv_default_loop(), &ctx->pollHandle, sockfd );
+
+    if ( r == -1 ) {
+
+        error = uv_last_error( uv_default_loop() );
+        std::cerr << uv_err_name( error ) << uv_strerror( error );
+        abort();
+
+    } else {
+
+        ctx->pollHandle.data = ctx;
+    }
+
+    this->sockets[slot] = ctx;
+
+    CurlStats::Add( CurlStats::ACTIVE_SOCKETS );
+
+    return ctx;
+}
+
+//Called when libcurl thinks the socket can be destroyed.
+// The poll handle is already stopped, it is kept open for the next socket with the same fd.
+// On windows the handle is bound to the socket itself, so it must be closed.
+void CurlMulti::DestroyCurlSocketContext( CurlSocketContext* ctx )
+{
+    ctx->isActive = false;
+
+    CurlStats::Add( CurlStats::ACTIVE_SOCKETS, -1 );
+
+#if defined(_WIN32)
+    this->sockets[static_cast<size_t>( ctx->sockfd )] = NULL;
+
+    uv_close( reinterpret_cast<uv_handle_t*>( &ctx->pollHandle ), CurlMulti::OnCurlSocketClose );
+#endif
+}
+
+void CurlMulti::OnCurlSocketClose( uv_handle_t *handle )
+{
+    CurlSocketContext *ctx = static_cast<CurlSocketContext*>( handle->data );
+    free( ctx );
+}
+
+//This function will be called when the timeout value changes from LibCurl.
+//The timeout value is at what latest time the application should call one of
+//the "performing" functions of the multi interface (curl_multi_socket_action(3) and curl_multi_perform(3)) - to allow libcurl to keep timeouts and retries etc to work.
+int CurlMulti::HandleTimeout( CURLM *multi /* multi handle */ , long timeoutMs /* timeout in milliseconds */ , void *userp /* TIMERDATA */ )
+{
+    CurlMulti *obj = static_cast<CurlMulti*>( userp );
+
+    //A timeout value of -1 means that there is no timeout at all
+    if ( timeoutMs < 0 ) {
+
+        uv_timer_stop( &obj->timeout );
+        uv_idle_stop( &obj->immediateTimeout );
+        obj->timeoutDue = 0;
+
+        return 0;
+    }
+
+    //and 0 means that the timeout is already reached, it's run on the next loop iteration without waiting for the timer
+    // libcurl may be in the middle of a call here, so it cannot be run right away
+    if ( timeoutMs == 0 ) {
+
+        uv_timer_stop( &obj->timeout );
+        obj->timeoutDue = 0;
+
+        return uv_idle_start( &obj->immediateTimeout, CurlMulti::OnImmediateTimeout );
+    }
+
+    uv_idle_stop( &obj->immediateTimeout );
+
+    //libcurl sets the same timeout many times while processing the same event, the loop time doesn't change meanwhile
+    int64_t due = uv_now( uv_default_loop() ) + timeoutMs;
+
+    if ( due == obj->timeoutDue && uv_is_active( reinterpret_cast<uv_handle_t*>( &obj->timeout ) ) )
+        return 0;
+
+    obj->timeoutDue = due;
+
+    return uv_timer_start( &obj->timeout, CurlMulti::OnTimeout, timeoutMs, 0 );
+}
+
+//Function called when the previous timeout set reaches 0
+void CurlMulti::OnTimeout( uv_timer_t *req, int status )
+{
+    CurlMulti *obj = static_cast<CurlMulti*>( req->data );
+
+    obj->timeoutDue = 0;
+    obj->RunTimeout();
+}
+
+void CurlMulti::OnImmediateTimeout( uv_idle_t *handle, int status )
+{
+    CurlMulti *obj = static_cast<CurlMulti*>( handle->data );
+
+    //libcurl starts it again if there is still something to do right away
+    uv_idle_stop( handle );
+
+    obj->RunTimeout();
+}
+
+//timeout expired, let libcurl update handlers and timeouts
+void CurlMulti::RunTimeout()
+{
+    if ( !this->multi )
+        return;
+
+    CurlStats::Add( CurlStats::TIMER_FIRINGS );
+    CurlStats::Add( CurlStats::SOCKET_ACTIONS );
+
+    {
+        CurlStats::CurlScope curlScope;
+        curl_multi_socket_action( this->multi, CURL_SOCKET_TIMEOUT, 0, &this->runningHandles );
+    }
+
+    this->ProcessMessages();
+    Curl::FlushPending();
+}
+
+//Called when libcurl thinks there is something to process
+void CurlMulti::Process( uv_poll_t* handle, int status, int events )
+{
+    CurlSocketContext *ctx = static_cast<CurlSocketContext*>( handle->data );
+    CurlMulti *obj = ctx->multi;
+
+    if ( !obj->multi )
+        return;
+
+    //the timer is kept, libcurl updates it through HandleTimeout when the socket action changes it
+
+    int flags = 0;
+
+    CURLMcode code;
+
+    if ( events & UV_READABLE ) flags |= CURL_CSELECT_IN;
+    if ( events & UV_WRITABLE ) flags |= CURL_CSELECT_OUT;
+
+    do {
+
+        CurlStats::Add( CurlStats::SOCKET_ACTIONS );
+        CurlStats::CurlScope curlScope;
+
+        code = curl_multi_socket_action( obj->multi, ctx->sockfd, flags, &obj->runningHandles );
+
+    } while ( code == CURLM_CALL_MULTI_PERFORM ); //@todo is that loop really needed?
+
+    if ( code != CURLM_OK ) {
+
+        Curl::Raise( "curl_multi_socket_actioon Failed", curl_multi_strerror( code ) );
+        return;
+    }
+
+    obj->ProcessMessages();
+    Curl::FlushPending();
+}
+
+//Completions over the budget are left on the queue, and delivered on the next loop iteration.
+bool CurlMulti::IsOverBudget( uint32_t completions, uint64_t start ) const
+{
+    if ( !completions )
+        return false;
+
+    return ( this->maxCompletions && completions >= this->maxCompletions ) || ( this->maxCompletionTime && uv_hrtime() - start >= this->maxCompletionTime );
+}
+
+void CurlMulti::EndCompletions( uint32_t completions, uint64_t start )
+{
+    if ( !completions )
+        return;
+
+    int64_t elapsed = static_cast<int64_t>( uv_hrtime() - start );
+
+    CurlStats::Add( CurlStats::COMPLETION_TIME, elapsed );
+    CurlStats::Max( CurlStats::MAX_COMPLETION_TIME, elapsed );
+}
+
+void CurlMulti::OnDeferredCompletions( uv_idle_t *handle, int status )
+{
+    CurlMulti *obj = static_cast<CurlMulti*>( handle->data );
+
+    uv_idle_stop( handle );
+
+    if ( obj->IsClosed() )
+        return;
+
+    if ( obj->IsThreaded() ) {
+
+        obj->ProcessCompletions();
+        return;
+    }
+
+    obj->ProcessMessages();
+    Curl::FlushPending();
+}
+
+void CurlMulti::ProcessMessages()
+{
+    CURLMcode code;
+    CURLMsg *msg = NULL;
+    int pending = 0;
+    uint32_t completions = 0;
+    uint64_t start = uv_hrtime();
+
+    //the ones already deferred are delivered first
+    if ( uv_is_active( reinterpret_cast<uv_handle_t*>( &this->deferredCompletions ) ) )
+        return;
+
+    //js may close this multi on the end / error events
+    while( this->multi ) {
+
+        if ( this->IsOverBudget( completions, start ) ) {
+
+            //pending is the amount of messages left after the last one read, all of them are completions,
+            // the ones left by the last deferral are still at the front and were already counted
+            if ( pending ) {
+
+                if ( pending > this->deferredMessages )
+                    CurlStats::Add( CurlStats::DEFERRED_COMPLETIONS, pending - this->deferredMessages );
+
+                this->deferredMessages = pending;
+                uv_idle_start( &this->deferredCompletions, CurlMulti::OnDeferredCompletions );
+            }
+
+            break;
+        }
+
+        if ( !( msg = curl_multi_info_read( this->multi, &pending ) ) ) {
+
+            this->deferredMessages = 0;
+            break;
+        }
+
+        if ( this->deferredMessages )
+            --this->deferredMessages;
+
+        if ( msg->msg == CURLMSG_DONE ) {
+
+            Curl *curl = NULL;
+
+            //the instance is stored on the easy handle itself, no need to search for it
+            curl_easy_getinfo( msg->easy_handle, CURLINFO_PRIVATE, reinterpret_cast<char**>( &curl ) );
+
+            CURLcode statusCode = msg->data.result;
+
+            ++completions;
+
+            this->SampleTransfer( curl, statusCode );
+
+            code = this->RemoveHandle( curl );
+
+            if ( code != CURLM_OK ) {
+                Curl::Raise( "curl_multi_remove_handle Failed", curl_multi_strerror( code ) );
+                return;
+            }
+
+            //js must receive every chunk before the end
+            int flushResult = Curl::FlushStaged( curl );
+
+            if ( flushResult == Curl::FLUSH_CLOSED )
+                continue;
+
+            if ( flushResult == Curl::FLUSH_ABORTED && statusCode == CURLE_OK )
+                statusCode = CURLE_WRITE_ERROR;
+
+            if ( statusCode == CURLE_OK ) {
+
+                curl->OnEnd();
+
+            } else {
+
+                curl->OnError( statusCode );
+            }
+        }
+    }
+
+    this->EndCompletions( completions, start );
+
+    //the slots freed by the finished transfers
+    if ( this->scheduler && this->scheduler->GetQueued() )
+        this->AdmitQueued();
+}
+
+//Called on the main thread when the workers have messages
+void CurlMulti::OnCompletions( uv_async_t *handle, int status )
+{
+    CurlMulti *obj = static_cast<CurlMulti*>( handle->data );
+
+    obj->ProcessCompletions();
+}
+
+void CurlMulti::ProcessCompletions()
+{
+    CurlMessage *message;
+    uint32_t completions = 0;
+    uint64_t start = uv_hrtime();
+
+    if ( uv_is_active( reinterpret_cast<uv_handle_t*>( &this->deferredCompletions ) ) )
+        return;
+
+    while ( true ) {
+
+        if ( this->IsOverBudget( completions, start ) ) {
+
+            //the queue doesn't know its size, the messages left are moved out of it to count the completions among them
+            while ( ( message = this->completions.Pop() ) ) {
+
+                if ( message->type == CurlMessage::DONE )
+                    CurlStats::Add( CurlStats::DEFERRED_COMPLETIONS );
+
+                this->deferredQueue.push_back( message );
+            }
+
+            if ( !this->deferredQueue.empty() )
+                uv_idle_start( &this->deferredCompletions, CurlMulti::OnDeferredCompletions );
+
+            break;
+        }
+
+        //the ones already deferred are delivered first
+        if ( !this->deferredQueue.empty() ) {
+
+            message = this->deferredQueue.front();
+            this->deferredQueue.pop_front();
+
+        } else if ( !( message = this->completions.Pop() ) ) {
+
+            break;
+        }
+
+        if ( message->type == CurlMessage::REMOVED ) {
+
+            this->OnHandleDetached( message->requestId );
+
+            delete message;
+            continue;
+        }
+
+        std::map<uint32_t, Curl*>::iterator it = this->requests.find( message->requestId );
+
+        //handle was removed, or closed, after the message was sent
+        if ( it == this->requests.end() ) {
+
+            delete message;
+            continue;
+        }
+
+        Curl *curl = it->second;
+
+        if ( message->type == CurlMessage::DONE ) {
+
+            CURLcode statusCode = message->result;
+
+            delete message;
+
+            ++completions;
+
+            this->SampleTransfer( curl, statusCode );
+            this->OnHandleRemoved( curl );
+
+            if ( statusCode == CURLE_OK ) {
+
+                curl->OnEnd();
+
+            } else {
+
+                curl->OnError( statusCode );
+            }
+
+            continue;
+        }
+
+        Curl::flushing = curl;
+
+        int flushResult = Curl::DeliverStaged( curl, message->chunks, message->ends, message->type == CurlMessage::HEADER ? "_onHeaderBatch" : "_onDataBatch" );
+
+        delete message;
+
+        if ( flushResult == Curl::FLUSH_CLOSED )
+            continue;
+
+        Curl::flushing = NULL;
+
+        if ( flushResult == Curl::FLUSH_ABORTED ) {
+
+            //same behavior than returning a wrong length from the write callback, reported once the worker lets the handle go
+            curl->detachResult = CURLE_WRITE_ERROR;
+
+            this->RemoveHandle( curl );
+        }
+    }
+
+    this->EndCompletions( completions, start );
+
+    if ( this->scheduler && this->scheduler->GetQueued() )
+        this->AdmitQueued();
+}
+
+//Javascript Constructor
+v8::Handle<v8::Value> CurlMulti::New( const v8::Arguments &args ) {
+
+    v8::HandleScope scope;
+
+    if ( args.IsConstructCall() ) {
+        // Invoked as constructor: `new Multi(...)`
+
+        int threads = 0;
+
+        if ( args.Length() && args[0]->IsObject() ) {
+
+            v8::Handle<v8::Value> threadsValue = args[0]->ToObject()->Get( v8::String::NewSymbol( "threads" ) );
+
+            if ( !threadsValue->IsUndefined() && ( !threadsValue->IsInt32() || threadsValue->Int32Value() < 0 ) ) {
+
+                v8::ThrowException(v8::Exception::TypeError(
+                    v8::String::New( "Option threads should be a positive integer." )
+                ));
+                return v8::Undefined();
+            }
+
+            threads = threadsValue->Int32Value();
+        }
+
+        new CurlMulti( args.This(), threads );
+
+        return args.This();
+
+    } else {
+        // Invoked as plain function `Multi(...)`, turn into construct call.
+
+        v8::Handle<v8::Value> argv[] = { args[0] };
+
+        return scope.Close( constructor->NewInstance( args.Length() ? 1 : 0, argv ) );
+    }
+}
+
+//This is called by v8 when there are no more references to the Multi instance on js.
+void CurlMulti::Destructor( v8::Persistent<v8::Value> value, void *data )
+{
+    v8::Handle<v8::Object> object = value->ToObject();
+    CurlMulti *multi = static_cast<CurlMulti*>( object->GetPointerFromInternalField( 0 ) );
+    multi->Dispose();
+}
+
+v8::Handle<v8::Value> CurlMulti::SetOpt( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    CurlMulti *obj = CurlMulti::Unwrap( args.This() );
+
+    if ( !obj || obj->IsClosed() ) {
+        Curl::Raise( "Multi is closed." );
+        return v8::Undefined();
+    }
+
+    v8::Handle<v8::Value> opt   = args[0];
+    v8::Handle<v8::Value> value = args[1];
+
+    CURLMcode code = CURLM_UNKNOWN_OPTION;
+
+    int optionId;
+
+    if ( ( optionId = isInsideOption( curlMultiOptionsInteger, opt ) ) ) {
+
+        if ( !value->IsInt32() && !value->IsBoolean() ) {
+            v8::ThrowException(v8::Exception::TypeError(
+                v8::String::New( "Option value should be an integer." )
+            ));
+            return v8::Undefined();
+        }
+
+        long longValue = static_cast<long>( value->Int32Value() );
+
+        code = obj->IsThreaded() ? CURLM_OK : curl_multi_setopt( obj->multi, (CURLMoption) optionId, longValue );
+
+        for ( std::vector<CurlWorker*>::iterator it = obj->workers.begin(), end = obj->workers.end(); it != end; ++it )
+            (*it)->SetOpt( (CURLMoption) optionId, longValue );
+
+#if LIBCURL_VERSION_NUM >= 0x071e00
+    } else if ( ( optionId = isInsideOption( curlMultiOptionsOfft, opt ) ) ) {
+
+        if ( !value->IsNumber() ) {
+            v8::ThrowException(v8::Exception::TypeError(
+                v8::String::New( "Option value should be a number." )
+            ));
+            return v8::Undefined();
+        }
+
+        curl_off_t offtValue = static_cast<curl_off_t>( value->IntegerValue() );
+
+        code = obj->IsThreaded() ? CURLM_OK : curl_multi_setopt( obj->multi, (CURLMoption) optionId, offtValue );
+
+        for ( std::vector<CurlWorker*>::iterator it = obj->workers.begin(), end = obj->workers.end(); it != end; ++it )
+            (*it)->SetOptOfft( (CURLMoption) optionId, offtValue );
+#endif
+    }
+
+    if ( code != CURLM_OK ) {
+
+        Curl::Raise(
+            code == CURLM_UNKNOWN_OPTION ? "Unknown option given. First argument must be the option internal id or the option name. You can use the Curl.Multi.option constants." : curl_multi_strerror( code )
+        );
+        return v8::Undefined();
+    }
+
+    return scope.Close( v8::Integer::New( code ) );
+}
+
+//returns the amount of Curl instances added to this multi, including the ones waiting on the scheduler
+v8::Handle<v8::Value> CurlMulti::GetCount( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    CurlMulti *obj = CurlMulti::Unwrap( args.This() );
+
+    if ( !obj )
+        return scope.Close( v8::Integer::New( 0 ) );
+
+    size_t queued = obj->scheduler ? obj->scheduler->GetQueued() : 0;
+
+    return scope.Close( v8::Integer::New( obj->handlesCount + static_cast<int32_t>( queued ) ) );
+}
+
+//Limit the transfers running: _setScheduler( maxTotal, maxPerHost, adaptive ), 0 removes a limit.
+// adaptive is an object with all the fields of CurlScheduler::AdaptiveOptions, or undefined to use maxPerHost.
+// _setScheduler( null ) starts the handles waiting, and the next ones are started right away.
+v8::Handle<v8::Value> CurlMulti::SetScheduler( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    CurlMulti *obj = CurlMulti::Unwrap( args.This() );
+
+    if ( !obj || obj->IsClosed() ) {
+        Curl::Raise( "Multi is closed." );
+        return v8::Undefined();
+    }
+
+    if ( !obj->scheduler )
+        obj->scheduler = new CurlScheduler();
+
+    if ( args[0]->IsNull() ) {
+
+        obj->scheduler->SetLimits( 0, 0 );
+        obj->scheduler->SetAdaptive( CurlScheduler::AdaptiveOptions() );
+        obj->isSchedulerEnabled = false;
+
+    } else {
+
+        if ( !args[0]->IsUint32() || !args[1]->IsUint32() ) {
+            v8::ThrowException(v8::Exception::TypeError(
+                v8::String::New( "Scheduler limits should be positive integers." )
+            ));
+            return v8::Undefined();
+        }
+
+        CurlScheduler::AdaptiveOptions adaptive = CurlScheduler::AdaptiveOptions();
+
+        if ( args[2]->IsObject() ) {
+
+            v8::Handle<v8::Object> options = args[2]->ToObject();
+
+            adaptive.isEnabled = true;
+            adaptive.initialLimit = options->Get( v8::String::NewSymbol( "initialLimit" ) )->NumberValue();
+            adaptive.minLimit = options->Get( v8::String::NewSymbol( "minLimit" ) )->NumberValue();
+            adaptive.maxLimit = options->Get( v8::String::NewSymbol( "maxLimit" ) )->NumberValue();
+            adaptive.smoothing = options->Get( v8::String::NewSymbol( "smoothing" ) )->NumberValue();
+            adaptive.tolerance = options->Get( v8::String::NewSymbol( "tolerance" ) )->NumberValue();
+            adaptive.backoff = options->Get( v8::String::NewSymbol( "backoff" ) )->NumberValue();
+
+            //NaN fails all of them
+            if ( !( adaptive.minLimit >= 1 && adaptive.maxLimit >= adaptive.minLimit && adaptive.initialLimit >= adaptive.minLimit && adaptive.initialLimit <= adaptive.maxLimit &&
+                    adaptive.smoothing > 0 && adaptive.smoothing <= 1 && adaptive.tolerance >= 1 && adaptive.backoff > 0 && adaptive.backoff < 1 ) ) {
+
+                v8::ThrowException(v8::Exception::RangeError(
+                    v8::String::New( "Invalid adaptive limit options." )
+                ));
+                return v8::Undefined();
+            }
+        }
+
+        obj->scheduler->SetLimits( args[0]->Int32Value(), args[1]->Int32Value() );
+        obj->scheduler->SetAdaptive( adaptive );
+        obj->isSchedulerEnabled = true;
+    }
+
+    //the limits may be higher now
+    obj->AdmitQueued();
+
+    return args.This();
+}
+
+//Limit the completions delivered to js on each loop iteration: _setCompletionBudget( maxCompletions, maxTimeUs ), 0 removes a limit.
+// The transfer that goes over maxTimeUs is still delivered, the budget is checked between them.
+v8::Handle<v8::Value> CurlMulti::SetCompletionBudget( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    CurlMulti *obj = CurlMulti::Unwrap( args.This() );
+
+    if ( !obj || obj->IsClosed() ) {
+        Curl::Raise( "Multi is closed." );
+        return v8::Undefined();
+    }
+
+    if ( !args[0]->IsUint32() || !args[1]->IsUint32() ) {
+        v8::ThrowException(v8::Exception::TypeError(
+            v8::String::New( "Completion budget limits should be positive integers." )
+        ));
+        return v8::Undefined();
+    }
+
+    obj->maxCompletions = args[0]->Uint32Value();
+    obj->maxCompletionTime = static_cast<uint64_t>( args[1]->Uint32Value() ) * 1000;
+
+    return args.This();
+}
+
+v8::Handle<v8::Value> CurlMulti::GetSchedulerStats( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    CurlMulti *obj = CurlMulti::Unwrap( args.This() );
+
+    if ( !obj || !obj->scheduler )
+        return scope.Close( CurlScheduler().ToObject() );
+
+    return scope.Close( obj->scheduler->ToObject() );
+}
+
+v8::Handle<v8::Value> CurlMulti::Close( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    CurlMulti *obj = CurlMulti::Unwrap( args.This() );
+
+    if ( !obj )
+        return args.This();
+
+    if ( obj == CurlMulti::defaultMulti ) {
+        Curl::Raise( "The default multi cannot be closed." );
+        return v8::Undefined();
+    }
+
+    if ( obj->handlesCount || ( obj->scheduler && obj->scheduler->GetQueued() ) ) {
+        Curl::Raise( "Multi still has running requests." );
+        return v8::Undefined();
+    }
+
+    obj->Cleanup();
+
+    return args.This();
+}
+
+v8::Handle<v8::Value> CurlMulti::GetDefaultMulti( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    return scope.Close( CurlMulti::defaultMulti->handle );
+}
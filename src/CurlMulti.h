@@ -0,0 +1,136 @@
+#ifndef CURLMULTI_H
+#define CURLMULTI_H
+
+#include <v8.h>
+#include <node.h>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include <curl/curl.h>
+
+#include "CurlMessageQueue.h"
+#include "CurlScheduler.h"
+
+class Curl;
+class CurlWorker;
+
+//Wrapper around a curl_multi handle, each instance has its own connection cache, timer and sockets.
+// A threaded multi has instead one curl_multi handle for each of its workers, which run the transfers
+// outside the main thread, and send back what happened to them through a queue.
+class CurlMulti {
+
+public:
+
+    //Export Multi to js
+    static void Initialize( v8::Handle<v8::Object> exports );
+
+    //Multi used by the Curl instances that did not set one.
+    static CurlMulti *GetDefault();
+
+    static CurlMulti* Unwrap( v8::Handle<v8::Object> );
+    static bool HasInstance( v8::Handle<v8::Value> value );
+
+    CURLMcode AddHandle( Curl *curl );
+    CURLMcode RemoveHandle( Curl *curl );
+
+    bool IsClosed() const;
+    bool IsThreaded() const;
+
+    v8::Persistent<v8::Object> handle;
+
+private:
+
+    //Constructors/Destructors
+    CurlMulti( v8::Handle<v8::Object> obj, int threads );
+    ~CurlMulti();
+    void Cleanup();
+    void Dispose();
+
+    //Context used with curl_multi_assign to create a relationship between the socket being used and the poll handler.
+    // Contexts are kept after libcurl removes their socket, and reused by the next socket with the same fd.
+    struct CurlSocketContext {
+        uv_poll_t pollHandle;
+        curl_socket_t sockfd;
+        CurlMulti *multi;
+        bool isActive;
+    };
+
+    //Members
+    CURLM *multi;
+    uv_timer_t timeout;
+    uv_idle_t immediateTimeout; //runs the timeouts already reached on the next loop iteration
+    int64_t timeoutDue;         //loop time the timer was started for, 0 when stopped
+    int runningHandles;
+    int handlesCount;
+    //contexts indexed by fd, NULL where no socket was seen yet
+    std::vector<CurlSocketContext*> sockets;
+    int pendingCloses;
+
+    //limits the transfers running, NULL until setScheduler is called
+    CurlScheduler *scheduler;
+    bool isSchedulerEnabled;
+
+    //completions delivered to js in one go, the rest wait for the next loop iteration, 0 is unlimited
+    uint32_t maxCompletions;
+    uint64_t maxCompletionTime; //ns
+    uv_idle_t deferredCompletions;
+    uv_idle_t pendingAdmission; //starts the handles waiting on the scheduler on the next loop iteration
+    int deferredMessages;                    //messages of libcurl left by the last deferral, already counted
+    std::deque<CurlMessage*> deferredQueue;  //messages of the workers left by the budget, in order
+
+    //threaded mode
+    std::vector<CurlWorker*> workers;
+    size_t nextWorker;
+    uint32_t lastRequestId;
+    std::map<uint32_t, Curl*> requests;
+    std::map<uint32_t, Curl*> detaching; //removed, waiting for the worker to let them go, still counted as running
+    CurlMessageQueue completions;
+    uv_async_t completionsNotify;
+
+    //static members
+    static CurlMulti *defaultMulti;
+    static v8::Persistent<v8::Function> constructor;
+    static v8::Persistent<v8::FunctionTemplate> constructorTemplate;
+
+    //LibUV Socket polling
+    CurlSocketContext *CreateCurlSocketContext( curl_socket_t sockfd );
+    void DestroyCurlSocketContext( CurlSocketContext *ctx );
+    void ProcessMessages();
+    void ProcessCompletions();
+    void OnHandleRemoved( Curl *curl );
+    void OnHandleDetached( uint32_t requestId );
+    CURLMcode AdmitHandle( Curl *curl );
+    CURLMcode AdmitQueued( Curl *caller = NULL );
+    void ReleaseSlot( Curl *curl );
+    void SampleTransfer( Curl *curl, CURLcode result );
+    void RefNotify();
+    static void SetRunning( Curl *curl, bool isRunning );
+    void RunTimeout();
+    bool IsOverBudget( uint32_t completions, uint64_t start ) const;
+    void EndCompletions( uint32_t completions, uint64_t start );
+    static int HandleSocket( CURL *easy, curl_socket_t s, int action, void *userp, void *socketp );
+    static int HandleTimeout( CURLM *multi, long timeoutMs, void *userp );
+    static void OnTimeout( uv_timer_t *req, int status );
+    static void OnImmediateTimeout( uv_idle_t *handle, int status );
+    static void Process( uv_poll_t* handle, int status, int events );
+    static void OnCurlSocketClose( uv_handle_t *handle );
+    static void OnCompletions( uv_async_t *handle, int status );
+    static void OnDeferredCompletions( uv_idle_t *handle, int status );
+    static void OnPendingAdmission( uv_idle_t *handle, int status );
+    static void OnHandleClose( uv_handle_t *handle );
+
+    //Js exported Methods
+    static v8::Handle<v8::Value> New( const v8::Arguments &args );
+    static void Destructor( v8::Persistent<v8::Value> value, void *data );
+
+    static v8::Handle<v8::Value> SetOpt( const v8::Arguments &args );
+    static v8::Handle<v8::Value> GetCount( const v8::Arguments &args );
+    static v8::Handle<v8::Value> SetScheduler( const v8::Arguments &args );
+    static v8::Handle<v8::Value> GetSchedulerStats( const v8::Arguments &args );
+    static v8::Handle<v8::Value> SetCompletionBudget( const v8::Arguments &args );
+    static v8::Handle<v8::Value> Close( const v8::Arguments &args );
+
+    static v8::Handle<v8::Value> GetDefaultMulti( const v8::Arguments &args );
+};
+#endif
@@ -0,0 +1,474 @@
+#include "CurlPool.h"
+#include "Curl.h"
+
+#include <algorithm>
+
+//Initialize static properties
+v8::Persistent<v8::Function> CurlPool::constructor;
+
+// Add Pool constructor to the module exports
+void CurlPool::Initialize( v8::Handle<v8::Object> exports ) {
+
+    v8::HandleScope scope;
+
+    //** Construct Pool js "class"
+    v8::Handle<v8::FunctionTemplate> tpl = v8::FunctionTemplate::New( CurlPool::New );
+
+    tpl->SetClassName( v8::String::NewSymbol( "Pool" ) );
+    tpl->InstanceTemplate()->SetInternalFieldCount( 1 ); //to wrap this
+
+    // Prototype Methods
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_lease", CurlPool::Lease );
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_release", CurlPool::Release );
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_getStats", CurlPool::GetStats );
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_close", CurlPool::Close );
+
+    CurlPool::constructor = v8::Persistent<v8::Function>::New( tpl->GetFunction() );
+
+    exports->Set( v8::String::NewSymbol( "Pool" ), CurlPool::constructor );
+}
+
+CurlPool::CurlPool( v8::Handle<v8::Object> obj ) : multi( NULL ), max( 64 ), min( 0 ), maxIdle( 64 ), idleTimeout( 30000 ), isClosed( false ),
+    created( 0 ), leases( 0 ), releases( 0 ), reuses( 0 ), evictions( 0 )
+{
+    obj->SetPointerInInternalField( 0, this );
+
+    this->handle = v8::Persistent<v8::Object>::New( obj );
+    this->handle.MakeWeak( this, CurlPool::Destructor );
+
+    int timerStatus = uv_timer_init( uv_default_loop(), &this->evictionTimer );
+    assert( timerStatus == 0 );
+
+    this->evictionTimer.data = this;
+
+    //idle handles should not keep the process running
+    uv_unref( reinterpret_cast<uv_handle_t*>( &this->evictionTimer ) );
+}
+
+CurlPool::~CurlPool()
+{
+    if ( !this->baseline.IsEmpty() ) {
+        this->baseline.Dispose();
+        this->baseline.Clear();
+    }
+
+    if ( !this->multiHandle.IsEmpty() ) {
+        this->multiHandle.Dispose();
+        this->multiHandle.Clear();
+    }
+}
+
+//Dispose persistent handler, and delete itself after the timer is closed.
+// Leased handles keep working, they are just not going back to the pool.
+void CurlPool::Dispose()
+{
+    this->isClosed = true;
+
+    uv_timer_stop( &this->evictionTimer );
+
+    //no js can be called from here
+    for ( std::vector<IdleEntry>::iterator it = this->idle.begin(), end = this->idle.end(); it != end; ++it )
+        this->Destroy( it->curl, false );
+
+    this->idle.clear();
+
+    for ( std::set<Curl*>::iterator it = this->leased.begin(), end = this->leased.end(); it != end; ++it )
+        (*it)->pool = NULL;
+
+    this->leased.clear();
+
+    this->handle->SetPointerInInternalField( 0, NULL );
+
+    this->handle.Dispose();
+    this->handle.Clear();
+
+    uv_close( reinterpret_cast<uv_handle_t*>( &this->evictionTimer ), CurlPool::OnTimerClose );
+}
+
+void CurlPool::OnTimerClose( uv_handle_t *handle )
+{
+    CurlPool *obj = static_cast<CurlPool*>( handle->data );
+    delete obj;
+}
+
+//Closes the idle handles, the leased ones are closed when released.
+void CurlPool::Shutdown()
+{
+    this->isClosed = true;
+
+    uv_timer_stop( &this->evictionTimer );
+
+    std::vector<IdleEntry> idle;
+    idle.swap( this->idle );
+
+    for ( std::vector<IdleEntry>::iterator it = idle.begin(), end = idle.end(); it != end; ++it )
+        this->Destroy( it->curl );
+}
+
+void CurlPool::OnCurlClosed( Curl *curl )
+{
+    this->leased.erase( curl );
+}
+
+CurlPool* CurlPool::Unwrap( v8::Handle<v8::Object> value )
+{
+    return static_cast<CurlPool*>( value->GetPointerFromInternalField( 0 ) );
+}
+
+//Creates a new Curl instance, the same way js does.
+Curl *CurlPool::Create()
+{
+    v8::HandleScope scope;
+
+    v8::Handle<v8::Object> obj = Curl::constructor->NewInstance();
+
+    Curl *curl = Curl::Unwrap( obj );
+
+    ++this->created;
+
+    return curl;
+}
+
+//Set the multi and the baseline options, returns false if some option failed, the exception is left for the caller.
+bool CurlPool::ApplyBaseline( Curl *curl )
+{
+    v8::HandleScope scope;
+
+    static v8::Persistent<v8::String> SYM_MULTI = v8::Persistent<v8::String>::New( v8::String::NewSymbol( "_multi" ) );
+
+    if ( this->multi ) {
+
+        curl->multi = this->multi;
+        curl->handle->Set( SYM_MULTI, this->multiHandle );
+
+    } else {
+
+        curl->multi = CurlMulti::GetDefault();
+        curl->handle->Set( SYM_MULTI, CurlMulti::GetDefault()->handle );
+    }
+
+    if ( this->baseline.IsEmpty() )
+        return true;
+
+    v8::Handle<v8::Array> names = this->baseline->GetPropertyNames();
+
+    for ( uint32_t i = 0, len = names->Length(); i < len; ++i ) {
+
+        v8::Handle<v8::Value> name = names->Get( i );
+        v8::Handle<v8::Value> result = Curl::SetOptInternal( curl, name, this->baseline->Get( name ) );
+
+        if ( result.IsEmpty() || result->IsUndefined() )
+            return false;
+    }
+
+    return true;
+}
+
+//Close the given handle, calling js close so it's also removed from the js side.
+void CurlPool::Destroy( Curl *curl, bool callJs )
+{
+    v8::HandleScope scope;
+
+    curl->pool = NULL;
+
+    //idle handles are strong references
+    curl->handle.MakeWeak( curl, Curl::Destructor );
+
+    if ( !callJs ) {
+
+        curl->Dispose();
+        return;
+    }
+
+    node::MakeCallback( curl->handle, "close", 0, NULL );
+}
+
+void CurlPool::ScheduleEviction()
+{
+    if ( !this->idleTimeout || this->idle.size() <= this->min )
+        return;
+
+    if ( !uv_is_active( reinterpret_cast<uv_handle_t*>( &this->evictionTimer ) ) )
+        uv_timer_start( &this->evictionTimer, CurlPool::OnEvictionTimer, this->idleTimeout, this->idleTimeout );
+}
+
+void CurlPool::OnEvictionTimer( uv_timer_t *timer, int status )
+{
+    CurlPool *obj = static_cast<CurlPool*>( timer->data );
+
+    obj->EvictIdle();
+}
+
+//Close handles idle for longer than idleTimeout, keeping at least min handles.
+void CurlPool::EvictIdle()
+{
+    uint64_t now = uv_now( uv_default_loop() );
+
+    std::vector<Curl*> evicted;
+
+    //oldest are at the front
+    while ( this->idle.size() > this->min && now - this->idle.front().since >= this->idleTimeout ) {
+
+        evicted.push_back( this->idle.front().curl );
+        this->idle.erase( this->idle.begin() );
+    }
+
+    if ( this->idle.size() <= this->min )
+        uv_timer_stop( &this->evictionTimer );
+
+    for ( std::vector<Curl*>::iterator it = evicted.begin(), end = evicted.end(); it != end; ++it ) {
+
+        ++this->evictions;
+        this->Destroy( *it );
+    }
+}
+
+//Javascript Constructor
+v8::Handle<v8::Value> CurlPool::New( const v8::Arguments &args ) {
+
+    v8::HandleScope scope;
+
+    if ( !args.IsConstructCall() ) {
+
+        v8::Handle<v8::Value> argv[] = { args[0] };
+
+        return scope.Close( constructor->NewInstance( args.Length() ? 1 : 0, argv ) );
+    }
+
+    v8::Handle<v8::Object> options = args[0]->IsObject() ? args[0]->ToObject() : v8::Object::New();
+
+    const char *sizes[] = { "max", "min", "maxIdle", "idleTimeout" };
+    int32_t values[] = { 64, 0, -1, 30000 };
+
+    for ( int i = 0; i < 4; ++i ) {
+
+        v8::Handle<v8::Value> value = options->Get( v8::String::NewSymbol( sizes[i] ) );
+
+        if ( value->IsUndefined() )
+            continue;
+
+        if ( !value->IsInt32() || value->Int32Value() < 0 ) {
+
+            std::string errorMsg = string_format( "Option %s should be a positive integer.", sizes[i] );
+
+            v8::ThrowException(v8::Exception::TypeError(
+                v8::String::New( errorMsg.c_str() )
+            ));
+            return v8::Undefined();
+        }
+
+        values[i] = value->Int32Value();
+    }
+
+    if ( !values[0] || values[1] > values[0] ) {
+        Curl::Raise( "Option max should be bigger than zero, and not smaller than min." );
+        return v8::Undefined();
+    }
+
+    v8::Handle<v8::Value> multiValue = options->Get( v8::String::NewSymbol( "multi" ) );
+    v8::Handle<v8::Value> optionsValue = options->Get( v8::String::NewSymbol( "options" ) );
+
+    if ( !multiValue->IsUndefined() && !multiValue->IsNull() && !CurlMulti::HasInstance( multiValue ) ) {
+        v8::ThrowException(v8::Exception::TypeError(
+            v8::String::New( "Option multi should be a Curl.Multi instance." )
+        ));
+        return v8::Undefined();
+    }
+
+    if ( !optionsValue->IsUndefined() && !optionsValue->IsObject() ) {
+        v8::ThrowException(v8::Exception::TypeError(
+            v8::String::New( "Option options should be an object with the Curl options to set on each handle." )
+        ));
+        return v8::Undefined();
+    }
+
+    CurlPool *obj = new CurlPool( args.This() );
+
+    obj->max = values[0];
+    obj->min = values[1];
+    obj->maxIdle = values[2] < 0 ? obj->max : std::min( std::max( static_cast<size_t>( values[2] ), obj->min ), obj->max );
+    obj->idleTimeout = values[3];
+
+    if ( CurlMulti::HasInstance( multiValue ) ) {
+
+        obj->multi = CurlMulti::Unwrap( multiValue->ToObject() );
+        obj->multiHandle = v8::Persistent<v8::Object>::New( multiValue->ToObject() );
+    }
+
+    if ( optionsValue->IsObject() )
+        obj->baseline = v8::Persistent<v8::Object>::New( optionsValue->ToObject() );
+
+    //pre-initialized handles, the baseline options are validated with the first one
+    size_t warm = std::max( obj->min, obj->baseline.IsEmpty() ? 0 : static_cast<size_t>( 1 ) );
+
+    for ( size_t i = 0; i < warm; ++i ) {
+
+        v8::TryCatch tryCatch;
+
+        Curl *curl = obj->Create();
+
+        if ( !obj->ApplyBaseline( curl ) ) {
+
+            obj->Destroy( curl );
+            obj->Shutdown();
+
+            return tryCatch.ReThrow();
+        }
+
+        curl->handle.ClearWeak();
+
+        IdleEntry entry = { curl, uv_now( uv_default_loop() ) };
+        obj->idle.push_back( entry );
+    }
+
+    return args.This();
+}
+
+//This is called by v8 when there are no more references to the Pool instance on js.
+void CurlPool::Destructor( v8::Persistent<v8::Value> value, void *data )
+{
+    v8::Handle<v8::Object> object = value->ToObject();
+    CurlPool *pool = static_cast<CurlPool*>( object->GetPointerFromInternalField( 0 ) );
+    pool->Dispose();
+}
+
+//Returns an idle handle, or a new one if there is none, null if the pool is at its max size.
+v8::Handle<v8::Value> CurlPool::Lease( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    CurlPool *obj = CurlPool::Unwrap( args.This() );
+
+    if ( !obj || obj->isClosed ) {
+        Curl::Raise( "Pool is closed." );
+        return v8::Undefined();
+    }
+
+    Curl *curl;
+
+    if ( !obj->idle.empty() ) {
+
+        //the most recently used, the one with the warmest connection
+        curl = obj->idle.back().curl;
+        obj->idle.pop_back();
+
+        curl->handle.MakeWeak( curl, Curl::Destructor );
+
+        ++obj->reuses;
+
+    } else if ( obj->leased.size() >= obj->max ) {
+
+        return scope.Close( v8::Null() );
+
+    } else {
+
+        v8::TryCatch tryCatch;
+
+        curl = obj->Create();
+
+        if ( !obj->ApplyBaseline( curl ) ) {
+
+            obj->Destroy( curl );
+            return tryCatch.ReThrow();
+        }
+    }
+
+    curl->pool = obj;
+    obj->leased.insert( curl );
+
+    ++obj->leases;
+
+    return scope.Close( curl->handle );
+}
+
+//Reset the given handle and keep it for the next lease.
+// Returns true if the handle is kept, false if it was closed, because the pool is full or closed.
+v8::Handle<v8::Value> CurlPool::Release( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    CurlPool *obj = CurlPool::Unwrap( args.This() );
+
+    if ( !obj ) {
+        Curl::Raise( "Pool is closed." );
+        return v8::Undefined();
+    }
+
+    Curl *curl = Curl::HasInstance( args[0] ) ? Curl::Unwrap( args[0]->ToObject() ) : NULL;
+
+    if ( !curl || !obj->leased.count( curl ) ) {
+        Curl::Raise( "Curl instance was not leased from this pool." );
+        return v8::Undefined();
+    }
+
+    if ( curl->isInsideMultiCurl ) {
+        Curl::Raise( "Curl instance is still running." );
+        return v8::Undefined();
+    }
+
+    obj->leased.erase( curl );
+
+    ++obj->releases;
+
+    if ( obj->isClosed || obj->idle.size() >= obj->maxIdle ) {
+
+        obj->Destroy( curl );
+        return scope.Close( v8::False() );
+    }
+
+    curl->pool = NULL;
+    curl->ResetHandle();
+    curl->features = 0;
+
+    //the options were valid when the handle was created, so this is not expected to fail
+    v8::TryCatch tryCatch;
+
+    if ( !obj->ApplyBaseline( curl ) ) {
+
+        obj->Destroy( curl );
+        return scope.Close( v8::False() );
+    }
+
+    curl->handle.ClearWeak();
+
+    IdleEntry entry = { curl, uv_now( uv_default_loop() ) };
+    obj->idle.push_back( entry );
+
+    obj->ScheduleEviction();
+
+    return scope.Close( v8::True() );
+}
+
+v8::Handle<v8::Value> CurlPool::GetStats( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    CurlPool *obj = CurlPool::Unwrap( args.This() );
+
+    v8::Handle<v8::Object> stats = v8::Object::New();
+
+    if ( !obj )
+        return scope.Close( stats );
+
+    stats->Set( v8::String::NewSymbol( "leased" ), v8::Number::New( static_cast<double>( obj->leased.size() ) ) );
+    stats->Set( v8::String::NewSymbol( "idle" ), v8::Number::New( static_cast<double>( obj->idle.size() ) ) );
+    stats->Set( v8::String::NewSymbol( "created" ), v8::Number::New( obj->created ) );
+    stats->Set( v8::String::NewSymbol( "leases" ), v8::Number::New( obj->leases ) );
+    stats->Set( v8::String::NewSymbol( "releases" ), v8::Number::New( obj->releases ) );
+    stats->Set( v8::String::NewSymbol( "reuses" ), v8::Number::New( obj->reuses ) );
+    stats->Set( v8::String::NewSymbol( "evictions" ), v8::Number::New( obj->evictions ) );
+
+    return scope.Close( stats );
+}
+
+v8::Handle<v8::Value> CurlPool::Close( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    CurlPool *obj = CurlPool::Unwrap( args.This() );
+
+    if ( obj && !obj->isClosed )
+        obj->Shutdown();
+
+    return args.This();
+}
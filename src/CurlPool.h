@@ -0,0 +1,83 @@
+#ifndef CURLPOOL_H
+#define CURLPOOL_H
+
+#include <v8.h>
+#include <node.h>
+#include <set>
+#include <vector>
+
+class Curl;
+class CurlMulti;
+
+//Keeps Curl instances alive between requests, so they don't need to be created again.
+// Handles are reset and have the baseline options applied when released.
+class CurlPool {
+
+public:
+
+    //Export Pool to js
+    static void Initialize( v8::Handle<v8::Object> exports );
+
+    //Called by a leased Curl instance that was closed.
+    void OnCurlClosed( Curl *curl );
+
+private:
+
+    //Constructors/Destructors
+    CurlPool( v8::Handle<v8::Object> obj );
+    ~CurlPool();
+    void Dispose();
+    void Shutdown();
+
+    struct IdleEntry {
+        Curl *curl;
+        uint64_t since; //uv_now when released
+    };
+
+    //Members
+    v8::Persistent<v8::Object> handle;
+    v8::Persistent<v8::Object> baseline; //options set on each handle
+    v8::Persistent<v8::Object> multiHandle;
+
+    CurlMulti *multi;
+    std::vector<IdleEntry> idle; //the most recently released is at the back
+    std::set<Curl*> leased;
+    uv_timer_t evictionTimer;
+
+    size_t max;
+    size_t min;
+    size_t maxIdle;
+    uint64_t idleTimeout;
+    bool isClosed;
+
+    //stats
+    double created;
+    double leases;
+    double releases;
+    double reuses;
+    double evictions;
+
+    //static members
+    static v8::Persistent<v8::Function> constructor;
+
+    //Helper methods
+    Curl *Create();
+    bool ApplyBaseline( Curl *curl );
+    void Destroy( Curl *curl, bool callJs = true );
+    void EvictIdle();
+    void ScheduleEviction();
+
+    static CurlPool* Unwrap( v8::Handle<v8::Object> );
+    static void OnEvictionTimer( uv_timer_t *timer, int status );
+    static void OnTimerClose( uv_handle_t *handle );
+
+    //Js exported Methods
+    static v8::Handle<v8::Value> New( const v8::Arguments &args );
+    static void Destructor( v8::Persistent<v8::Value> value, void *data );
+
+    static v8::Handle<v8::Value> Lease( const v8::Arguments &args );
+    static v8::Handle<v8::Value> Release( const v8::Arguments &args );
+    static v8::Handle<v8::Value> GetStats( const v8::Arguments &args );
+    static v8::Handle<v8::Value> Close( const v8::Arguments &args );
+};
+#endif
@@ -0,0 +1,83 @@
+#include "CurlRegistry.h"
+
+#include <string.h>
+
+#include "generated-stubs/curlRegistry.h"
+
+const CurlRegistry::Entry* CurlRegistry::FindOption( v8::Handle<v8::Value> option )
+{
+    return CurlRegistry::Find( curlOptionsRegistry, option );
+}
+
+const CurlRegistry::Entry* CurlRegistry::FindInfo( v8::Handle<v8::Value> info )
+{
+    return CurlRegistry::Find( curlInfosRegistry, info );
+}
+
+//FNV-1a, must give the same result than hashName on tools/generate-stubs.js
+uint32_t CurlRegistry::Hash( const char *name, size_t length, uint32_t seed )
+{
+    uint32_t hash = 2166136261u ^ seed;
+
+    for ( size_t i = 0; i < length; ++i ) {
+
+        hash ^= static_cast<unsigned char>( name[i] );
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+const CurlRegistry::Entry* CurlRegistry::Find( const Table &table, v8::Handle<v8::Value> value )
+{
+    if ( value->IsInt32() ) {
+
+        int32_t id = value->Int32Value();
+
+        if ( id <= 0 )
+            return NULL;
+
+        uint32_t number = static_cast<uint32_t>( id % table.idModulo );
+
+        if ( number >= table.idsLength || table.ids[number] < 0 )
+            return NULL;
+
+        const Entry &entry = table.entries[table.ids[number]];
+
+        //same number, but other type
+        return ( entry.id == id ) ? &entry : NULL;
+    }
+
+    if ( !value->IsString() )
+        return NULL;
+
+    v8::Handle<v8::String> nameString = value.As<v8::String>();
+
+    int length = nameString->Length();
+
+    if ( length <= 0 || length > maxNameLength )
+        return NULL;
+
+    char name[maxNameLength * 3];
+
+    length = nameString->WriteUtf8( name, sizeof( name ), NULL, v8::String::NO_NULL_TERMINATION );
+
+    for ( int i = 0; i < length; ++i ) {
+
+        if ( name[i] >= 'a' && name[i] <= 'z' )
+            name[i] -= 'a' - 'A';
+    }
+
+    uint32_t seed = table.displacements[CurlRegistry::Hash( name, length, 0 ) % table.displacementsLength];
+    int16_t index = table.slots[CurlRegistry::Hash( name, length, seed ) % table.slotsLength];
+
+    if ( index < 0 )
+        return NULL;
+
+    const Entry &entry = table.entries[index];
+
+    if ( strncmp( entry.name, name, length ) != 0 || entry.name[length] != '\0' )
+        return NULL;
+
+    return &entry;
+}
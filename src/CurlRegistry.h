@@ -0,0 +1,60 @@
+#ifndef CURLREGISTRY_H
+#define CURLREGISTRY_H
+
+#include <v8.h>
+#include <stdint.h>
+
+#include <curl/curl.h>
+
+//Lookup of the options and infos given by js, using the tables generated by tools/generate-stubs.js
+// Both names (case insensitive) and ids are found in constant time, without allocating memory.
+class CurlRegistry
+{
+public:
+
+    //How the value of the option/info must be handled
+    enum Type {
+        NONE,
+        STRING,
+        INTEGER,
+        OFFT,
+        DOUBLE,
+        FUNCTION,
+        LINKED_LIST,
+        SHARE
+    };
+
+    struct Entry {
+        const char *name;
+        int32_t id;
+        Type type;
+    };
+
+    struct Table {
+        const Entry *entries;
+        uint32_t entriesLength;
+        //perfect hash, seed of each bucket and entry index of each slot
+        const uint32_t *displacements;
+        uint32_t displacementsLength;
+        const int16_t *slots;
+        uint32_t slotsLength;
+        //entry index of each id, without the type offset
+        const int16_t *ids;
+        uint32_t idsLength;
+        int32_t idModulo;
+    };
+
+    //Returns NULL if the value is not a known option/info name or id.
+    static const Entry* FindOption( v8::Handle<v8::Value> option );
+    static const Entry* FindInfo( v8::Handle<v8::Value> info );
+
+    static uint32_t Hash( const char *name, size_t length, uint32_t seed );
+
+private:
+
+    static const Entry* Find( const Table &table, v8::Handle<v8::Value> value );
+
+    //Bigger than any option/info name
+    static const int maxNameLength = 64;
+};
+#endif
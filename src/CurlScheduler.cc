@@ -0,0 +1,352 @@
+#include "CurlScheduler.h"
+#include "Curl.h"
+
+#include <uv.h>
+#include <math.h>
+
+//weights of the new sample on the recent and baseline latencies
+static const double rttWeight = 0.2;
+static const double baselineRttWeight = 0.02;
+
+CurlScheduler::CurlScheduler() : maxTotal( 0 ), maxPerHost( 0 ), running( 0 ), queued( 0 ), lastSequence( 0 ), started( 0 ), waitTime( 0 ), maxWaitTime( 0 ), lastWait( 0 ), lastExpiry( 0 )
+{
+    for ( int32_t i = 0; i < PRIORITY_COUNT; ++i )
+        this->queuedByPriority[i] = 0;
+
+    this->adaptive.isEnabled = false;
+}
+
+void CurlScheduler::SetLimits( int32_t maxTotal, int32_t maxPerHost )
+{
+    this->maxTotal = maxTotal;
+    this->maxPerHost = maxPerHost;
+}
+
+void CurlScheduler::SetAdaptive( const AdaptiveOptions &options )
+{
+    this->adaptive = options;
+
+    //hosts already known start again from the initial limit, their latency estimates are kept.
+    // Without the adaptive limit, only the ones with handles running or waiting are.
+    for ( std::map<std::string, Host>::iterator it = this->hosts.begin(), end = this->hosts.end(); it != end; ) {
+
+        if ( !options.isEnabled && CurlScheduler::IsIdle( it->second ) ) {
+
+            this->hosts.erase( it++ );
+            continue;
+        }
+
+        it->second.limit = options.initialLimit;
+        ++it;
+    }
+}
+
+bool CurlScheduler::IsAdaptive() const
+{
+    return this->adaptive.isEnabled;
+}
+
+//Gradient of the baseline latency over the recent one: the limit shrinks when the latency goes up with the load,
+// and grows by its square root, the amount of transfers allowed to wait on the host, otherwise.
+void CurlScheduler::Sample( Curl *curl, double startTransferTime, double totalTime, bool isFailed )
+{
+    Host *host = curl->schedulerHost;
+    const AdaptiveOptions &options = this->adaptive;
+
+    if ( !options.isEnabled || !host || curl->isQueued )
+        return;
+
+    if ( isFailed ) {
+
+        host->limit = fmax( options.minLimit, host->limit * options.backoff );
+        return;
+    }
+
+    if ( startTransferTime <= 0 )
+        return;
+
+    if ( !host->samples++ ) {
+
+        host->rtt = host->baselineRtt = startTransferTime;
+        host->totalTime = totalTime;
+        return;
+    }
+
+    host->rtt += ( startTransferTime - host->rtt ) * rttWeight;
+    host->baselineRtt += ( startTransferTime - host->baselineRtt ) * baselineRttWeight;
+    host->totalTime += ( totalTime - host->totalTime ) * rttWeight;
+
+    //the latency without load went down
+    if ( host->rtt < host->baselineRtt )
+        host->baselineRtt = host->rtt;
+
+    double gradient = fmax( 0.5, fmin( 1.0, options.tolerance * host->baselineRtt / host->rtt ) );
+    double limit = host->limit * gradient + sqrt( host->limit );
+
+    //a limit that is not being used would grow without bounds
+    if ( limit > host->limit && host->running * 2 < host->limit )
+        return;
+
+    limit = host->limit * ( 1 - options.smoothing ) + limit * options.smoothing;
+
+    host->limit = fmax( options.minLimit, fmin( options.maxLimit, limit ) );
+}
+
+int32_t CurlScheduler::GetHostLimit( const Host &host ) const
+{
+    return this->adaptive.isEnabled ? static_cast<int32_t>( host.limit ) : this->maxPerHost;
+}
+
+void CurlScheduler::Push( Curl *curl, const std::string &hostKey, int32_t priority )
+{
+    Host &host = this->hosts[hostKey];
+
+    if ( host.key.empty() ) {
+
+        host.key = hostKey;
+        host.limit = this->adaptive.isEnabled ? this->adaptive.initialLimit : 0;
+    }
+
+    Entry entry = { curl, ++this->lastSequence, uv_hrtime() };
+
+    host.waiting[priority].push_back( entry );
+
+    curl->schedulerHost = &host;
+    curl->isQueued = true;
+
+    ++this->queued;
+    ++this->queuedByPriority[priority];
+}
+
+bool CurlScheduler::Remove( Curl *curl )
+{
+    if ( !curl->isQueued )
+        return false;
+
+    std::deque<Entry> &waiting = curl->schedulerHost->waiting[curl->priority];
+
+    for ( std::deque<Entry>::iterator it = waiting.begin(), end = waiting.end(); it != end; ++it ) {
+
+        if ( it->curl == curl ) {
+
+            waiting.erase( it );
+            break;
+        }
+    }
+
+    --this->queued;
+    --this->queuedByPriority[curl->priority];
+
+    this->EraseIfIdle( curl->schedulerHost );
+
+    curl->schedulerHost = NULL;
+    curl->isQueued = false;
+
+    return true;
+}
+
+bool CurlScheduler::Next( Entry &entry )
+{
+    if ( !this->queued || ( this->maxTotal && this->running >= this->maxTotal ) )
+        return false;
+
+    for ( int32_t priority = 0; priority < PRIORITY_COUNT; ++priority ) {
+
+        if ( !this->queuedByPriority[priority] )
+            continue;
+
+        Host *next = NULL;
+
+        //within a priority, the one waiting for longer, on a host that is below its limit
+        for ( std::map<std::string, Host>::iterator it = this->hosts.begin(), end = this->hosts.end(); it != end; ++it ) {
+
+            Host &host = it->second;
+            int32_t hostLimit = this->GetHostLimit( host );
+
+            if ( host.waiting[priority].empty() || ( hostLimit && host.running >= hostLimit ) )
+                continue;
+
+            if ( !next || host.waiting[priority].front().sequence < next->waiting[priority].front().sequence )
+                next = &host;
+        }
+
+        if ( !next )
+            continue;
+
+        entry = next->waiting[priority].front();
+        next->waiting[priority].pop_front();
+
+        --this->queued;
+        --this->queuedByPriority[priority];
+
+        ++next->running;
+        ++this->running;
+
+        entry.curl->isQueued = false;
+
+        this->lastWait = uv_hrtime() - entry.queuedAt;
+
+        ++this->started;
+        this->waitTime += this->lastWait;
+
+        if ( this->lastWait > this->maxWaitTime )
+            this->maxWaitTime = this->lastWait;
+
+        return true;
+    }
+
+    return false;
+}
+
+void CurlScheduler::Unpop( const Entry &entry )
+{
+    Curl *curl = entry.curl;
+    Host *host = curl->schedulerHost;
+
+    host->waiting[curl->priority].push_front( entry );
+
+    --host->running;
+    --this->running;
+
+    ++this->queued;
+    ++this->queuedByPriority[curl->priority];
+
+    --this->started;
+    this->waitTime -= this->lastWait;
+
+    curl->isQueued = true;
+}
+
+void CurlScheduler::Release( Curl *curl )
+{
+    Host *host = curl->schedulerHost;
+
+    if ( !host || curl->isQueued )
+        return;
+
+    --host->running;
+    --this->running;
+
+    curl->schedulerHost = NULL;
+
+    this->EraseIfIdle( host );
+}
+
+size_t CurlScheduler::GetQueued() const
+{
+    return this->queued;
+}
+
+bool CurlScheduler::IsIdle( const Host &host )
+{
+    if ( host.running )
+        return false;
+
+    for ( int32_t i = 0; i < PRIORITY_COUNT; ++i ) {
+
+        if ( !host.waiting[i].empty() )
+            return false;
+    }
+
+    return true;
+}
+
+//Hosts are only kept while there are handles running or waiting for them, or their latency is being followed.
+// Handles only point to hosts that are not idle, so erasing these is safe.
+void CurlScheduler::EraseIfIdle( Host *host )
+{
+    if ( !CurlScheduler::IsIdle( *host ) )
+        return;
+
+    if ( !this->adaptive.isEnabled ) {
+
+        std::string key = host->key;
+
+        this->hosts.erase( key );
+        return;
+    }
+
+    host->lastUsed = uv_hrtime();
+
+    this->ExpireIdleHosts( host->lastUsed );
+}
+
+//Forget the latency of the hosts idle for longer than hostIdleTimeout, and of the least recently used one while there are more than maxHosts.
+// Runs at most once per hostExpiryInterval, unless there are too many.
+void CurlScheduler::ExpireIdleHosts( uint64_t now )
+{
+    if ( now - this->lastExpiry < hostExpiryInterval && this->hosts.size() <= maxHosts )
+        return;
+
+    this->lastExpiry = now;
+
+    std::map<std::string, Host>::iterator oldest = this->hosts.end();
+
+    for ( std::map<std::string, Host>::iterator it = this->hosts.begin(), end = this->hosts.end(); it != end; ) {
+
+        Host &host = it->second;
+
+        if ( !CurlScheduler::IsIdle( host ) ) {
+
+            ++it;
+            continue;
+        }
+
+        if ( now - host.lastUsed >= hostIdleTimeout ) {
+
+            this->hosts.erase( it++ );
+            continue;
+        }
+
+        if ( oldest == this->hosts.end() || host.lastUsed < oldest->second.lastUsed )
+            oldest = it;
+
+        ++it;
+    }
+
+    if ( this->hosts.size() > maxHosts && oldest != this->hosts.end() )
+        this->hosts.erase( oldest );
+}
+
+v8::Handle<v8::Object> CurlScheduler::ToObject() const
+{
+    v8::HandleScope scope;
+
+    v8::Handle<v8::Object> stats = v8::Object::New();
+    v8::Handle<v8::Array> queuedByPriority = v8::Array::New( PRIORITY_COUNT );
+
+    for ( int32_t i = 0; i < PRIORITY_COUNT; ++i )
+        queuedByPriority->Set( i, v8::Number::New( static_cast<double>( this->queuedByPriority[i] ) ) );
+
+    stats->Set( v8::String::NewSymbol( "queued" ), v8::Number::New( static_cast<double>( this->queued ) ) );
+    stats->Set( v8::String::NewSymbol( "queuedByPriority" ), queuedByPriority );
+    stats->Set( v8::String::NewSymbol( "running" ), v8::Integer::New( this->running ) );
+    stats->Set( v8::String::NewSymbol( "hosts" ), v8::Number::New( static_cast<double>( this->hosts.size() ) ) );
+    stats->Set( v8::String::NewSymbol( "started" ), v8::Number::New( this->started ) );
+    stats->Set( v8::String::NewSymbol( "waitTimeMs" ), v8::Number::New( static_cast<double>( this->waitTime ) / 1e6 ) );
+    stats->Set( v8::String::NewSymbol( "maxWaitTimeMs" ), v8::Number::New( static_cast<double>( this->maxWaitTime ) / 1e6 ) );
+
+    if ( !this->adaptive.isEnabled )
+        return scope.Close( stats );
+
+    v8::Handle<v8::Object> limits = v8::Object::New();
+
+    for ( std::map<std::string, Host>::const_iterator it = this->hosts.begin(), end = this->hosts.end(); it != end; ++it ) {
+
+        const Host &host = it->second;
+        v8::Handle<v8::Object> hostStats = v8::Object::New();
+
+        hostStats->Set( v8::String::NewSymbol( "limit" ), v8::Integer::New( this->GetHostLimit( host ) ) );
+        hostStats->Set( v8::String::NewSymbol( "running" ), v8::Integer::New( host.running ) );
+        hostStats->Set( v8::String::NewSymbol( "rttMs" ), v8::Number::New( host.rtt * 1000 ) );
+        hostStats->Set( v8::String::NewSymbol( "baselineRttMs" ), v8::Number::New( host.baselineRtt * 1000 ) );
+        hostStats->Set( v8::String::NewSymbol( "totalTimeMs" ), v8::Number::New( host.totalTime * 1000 ) );
+        hostStats->Set( v8::String::NewSymbol( "samples" ), v8::Number::New( host.samples ) );
+
+        limits->Set( v8::String::New( it->first.c_str(), static_cast<int>( it->first.length() ) ), hostStats );
+    }
+
+    stats->Set( v8::String::NewSymbol( "limits" ), limits );
+
+    return scope.Close( stats );
+}
@@ -0,0 +1,122 @@
+#ifndef CURLSCHEDULER_H
+#define CURLSCHEDULER_H
+
+#include <v8.h>
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <string>
+
+class Curl;
+
+//Decides when the handles performed on a CurlMulti are really added to it, keeping the amount of
+// transfers running, in total and against each host, under the limits set.
+// Handles waiting are started by priority, and in the order they were performed within the same priority.
+// With the adaptive limit, the limit of each host follows the latency of its transfers: it grows while the
+// time to the first byte stays near the one seen without load, and shrinks when it goes up, or transfers fail.
+class CurlScheduler
+{
+public:
+
+    //Exported to js as Multi.priority
+    enum {
+        PRIORITY_HIGH,
+        PRIORITY_NORMAL,
+        PRIORITY_LOW,
+        PRIORITY_COUNT
+    };
+
+    struct Entry {
+        Curl *curl;
+        uint64_t sequence;
+        uint64_t queuedAt; //uv_hrtime
+    };
+
+    struct Host {
+        std::string key;
+        int32_t running;
+        std::deque<Entry> waiting[PRIORITY_COUNT];
+
+        //adaptive limit, and the estimates it's based on, in seconds
+        double limit;
+        double rtt;         //recent time to the first byte
+        double baselineRtt; //time to the first byte without load
+        double totalTime;
+        double samples;
+        uint64_t lastUsed; //uv_hrtime of when it became idle
+    };
+
+    struct AdaptiveOptions {
+        bool isEnabled;
+        double initialLimit;
+        double minLimit;
+        double maxLimit;
+        double smoothing; //weight of the new limit
+        double tolerance; //latency increase accepted before shrinking
+        double backoff;   //the limit is multiplied by it when a transfer fails
+    };
+
+    CurlScheduler();
+
+    //0 removes the limit.
+    void SetLimits( int32_t maxTotal, int32_t maxPerHost );
+
+    //maxPerHost is not used while the adaptive limit is enabled. Disabling it forgets the idle hosts.
+    void SetAdaptive( const AdaptiveOptions &options );
+
+    bool IsAdaptive() const;
+
+    //Update the limit of the host of a running handle with the times of its transfer, before it's released.
+    void Sample( Curl *curl, double startTransferTime, double totalTime, bool isFailed );
+
+    //Queue the handle, it's started once Next returns it.
+    void Push( Curl *curl, const std::string &hostKey, int32_t priority );
+
+    //Remove a handle that was not started yet.
+    bool Remove( Curl *curl );
+
+    //Pop the handle that can be started next, which is counted as running until Release is called with it.
+    // Returns false when there is none, or the limits were reached.
+    bool Next( Entry &entry );
+
+    //Put back an entry returned by Next, that could not be started.
+    void Unpop( const Entry &entry );
+
+    //The handle is not running anymore, its slot can be used by the next one.
+    void Release( Curl *curl );
+
+    size_t GetQueued() const;
+
+    //Object with the amount of handles waiting and running, and how long they waited.
+    v8::Handle<v8::Object> ToObject() const;
+
+private:
+
+    std::map<std::string, Host> hosts;
+
+    int32_t maxTotal;
+    int32_t maxPerHost;
+    AdaptiveOptions adaptive;
+    int32_t running;
+    size_t queued;
+    size_t queuedByPriority[PRIORITY_COUNT];
+    uint64_t lastSequence;
+
+    //stats
+    double started;
+    uint64_t waitTime;
+    uint64_t maxWaitTime;
+    uint64_t lastWait; //of the entry returned by Next, in case it's put back
+
+    uint64_t lastExpiry; //uv_hrtime of the last ExpireIdleHosts
+
+    static const uint64_t hostIdleTimeout = 300 * 1000000000ULL;
+    static const uint64_t hostExpiryInterval = 1000000000ULL;
+    static const size_t maxHosts = 4096;
+
+    static bool IsIdle( const Host &host );
+    void EraseIfIdle( Host *host );
+    void ExpireIdleHosts( uint64_t now );
+    int32_t GetHostLimit( const Host &host ) const;
+};
+#endif
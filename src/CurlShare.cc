@@ -0,0 +1,234 @@
+#include "CurlShare.h"
+#include "Curl.h"
+
+Curl::CurlOption curlShareOptions[] = {
+    {"SHARE", CURLSHOPT_SHARE},
+    {"UNSHARE", CURLSHOPT_UNSHARE}
+};
+
+//For use with the SHARE and UNSHARE options.
+Curl::CurlOption curlShareLocks[] = {
+    {"COOKIE", CURL_LOCK_DATA_COOKIE},
+    {"DNS", CURL_LOCK_DATA_DNS},
+    {"SSL_SESSION", CURL_LOCK_DATA_SSL_SESSION},
+
+#if LIBCURL_VERSION_NUM >= 0x073900
+    {"CONNECT", CURL_LOCK_DATA_CONNECT}
+#endif
+};
+
+//Initialize static properties
+v8::Persistent<v8::Function> CurlShare::constructor;
+v8::Persistent<v8::FunctionTemplate> CurlShare::constructorTemplate;
+
+// Add Share constructor to the module exports
+void CurlShare::Initialize( v8::Handle<v8::Object> exports ) {
+
+    v8::HandleScope scope;
+
+    //** Construct Share js "class"
+    v8::Handle<v8::FunctionTemplate> tpl = v8::FunctionTemplate::New( CurlShare::New );
+
+    tpl->SetClassName( v8::String::NewSymbol( "Share" ) );
+    tpl->InstanceTemplate()->SetInternalFieldCount( 1 ); //to wrap this
+
+    // Prototype Methods
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_setOpt", CurlShare::SetOpt );
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_close", CurlShare::Close );
+
+    v8::Handle<v8::Function> tplFunction = tpl->GetFunction();
+
+    // Export cURL share Constants
+    v8::Handle<v8::Object> optionsObj = v8::Object::New();
+    v8::Handle<v8::Object> locksObj   = v8::Object::New();
+
+    Curl::ExportConstants( &optionsObj, curlShareOptions, sizeof( curlShareOptions ), nullptr, nullptr );
+    Curl::ExportConstants( &locksObj, curlShareLocks, sizeof( curlShareLocks ), nullptr, nullptr );
+
+    tplFunction->Set( v8::String::NewSymbol( "option" ), optionsObj, static_cast<v8::PropertyAttribute>( v8::ReadOnly|v8::DontDelete ) );
+    tplFunction->Set( v8::String::NewSymbol( "lock" ), locksObj, static_cast<v8::PropertyAttribute>( v8::ReadOnly|v8::DontDelete ) );
+
+    CurlShare::constructorTemplate = v8::Persistent<v8::FunctionTemplate>::New( tpl );
+    CurlShare::constructor = v8::Persistent<v8::Function>::New( tplFunction );
+
+    exports->Set( v8::String::NewSymbol( "Share" ), CurlShare::constructor );
+}
+
+CurlShare::CurlShare( v8::Handle<v8::Object> obj ) : share( NULL ), refs( 0 ), isDisposed( false )
+{
+    obj->SetPointerInInternalField( 0, this );
+
+    this->handle = v8::Persistent<v8::Object>::New( obj );
+    this->handle.MakeWeak( this, CurlShare::Destructor );
+
+    for ( int i = 0; i < CURL_LOCK_DATA_LAST; ++i )
+        uv_mutex_init( &this->locks[i] );
+
+    this->share = curl_share_init();
+
+    if ( !this->share ) {
+
+        Curl::Raise( "curl_share_init failed!" );
+        return;
+    }
+
+    curl_share_setopt( this->share, CURLSHOPT_LOCKFUNC, CurlShare::Lock );
+    curl_share_setopt( this->share, CURLSHOPT_UNLOCKFUNC, CurlShare::Unlock );
+    curl_share_setopt( this->share, CURLSHOPT_USERDATA, this );
+}
+
+CurlShare::~CurlShare()
+{
+    this->Cleanup();
+
+    for ( int i = 0; i < CURL_LOCK_DATA_LAST; ++i )
+        uv_mutex_destroy( &this->locks[i] );
+}
+
+void CurlShare::Cleanup()
+{
+    if ( !this->share )
+        return;
+
+    curl_share_cleanup( this->share );
+    this->share = NULL;
+}
+
+//Dispose persistent handler, the instance is deleted when no Curl instance is using it anymore
+void CurlShare::Dispose()
+{
+    this->handle->SetPointerInInternalField( 0, NULL );
+
+    this->handle.Dispose();
+    this->handle.Clear();
+
+    this->isDisposed = true;
+
+    if ( !this->refs )
+        delete this;
+}
+
+void CurlShare::Ref()
+{
+    ++this->refs;
+}
+
+void CurlShare::Unref()
+{
+    if ( !--this->refs && this->isDisposed )
+        delete this;
+}
+
+bool CurlShare::IsClosed() const
+{
+    return this->share == NULL;
+}
+
+CurlShare* CurlShare::Unwrap( v8::Handle<v8::Object> value )
+{
+    return static_cast<CurlShare*>( value->GetPointerFromInternalField( 0 ) );
+}
+
+bool CurlShare::HasInstance( v8::Handle<v8::Value> value )
+{
+    return value->IsObject() && CurlShare::constructorTemplate->HasInstance( value );
+}
+
+//Called by libcurl, possibly from a worker thread, before using the shared data.
+void CurlShare::Lock( CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr )
+{
+    CurlShare *obj = static_cast<CurlShare*>( userptr );
+
+    uv_mutex_lock( &obj->locks[data] );
+}
+
+void CurlShare::Unlock( CURL *handle, curl_lock_data data, void *userptr )
+{
+    CurlShare *obj = static_cast<CurlShare*>( userptr );
+
+    uv_mutex_unlock( &obj->locks[data] );
+}
+
+//Javascript Constructor
+v8::Handle<v8::Value> CurlShare::New( const v8::Arguments &args ) {
+
+    v8::HandleScope scope;
+
+    if ( args.IsConstructCall() ) {
+        // Invoked as constructor: `new Share(...)`
+
+        new CurlShare( args.This() );
+
+        return args.This();
+
+    } else {
+        // Invoked as plain function `Share(...)`, turn into construct call.
+
+        return scope.Close( constructor->NewInstance() );
+    }
+}
+
+//This is called by v8 when there are no more references to the Share instance on js.
+void CurlShare::Destructor( v8::Persistent<v8::Value> value, void *data )
+{
+    v8::Handle<v8::Object> object = value->ToObject();
+    CurlShare *share = static_cast<CurlShare*>( object->GetPointerFromInternalField( 0 ) );
+    share->Dispose();
+}
+
+v8::Handle<v8::Value> CurlShare::SetOpt( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    CurlShare *obj = CurlShare::Unwrap( args.This() );
+
+    if ( !obj || obj->IsClosed() ) {
+        Curl::Raise( "Share is closed." );
+        return v8::Undefined();
+    }
+
+    v8::Handle<v8::Value> opt   = args[0];
+    v8::Handle<v8::Value> value = args[1];
+
+    int optionId;
+
+    if ( !( optionId = isInsideOption( curlShareOptions, opt ) ) ) {
+        Curl::Raise( "Unknown option given. First argument must be the option internal id or the option name. You can use the Curl.Share.option constants." );
+        return v8::Undefined();
+    }
+
+    if ( !value->IsInt32() ) {
+        v8::ThrowException(v8::Exception::TypeError(
+            v8::String::New( "Option value should be one of the Curl.Share.lock constants." )
+        ));
+        return v8::Undefined();
+    }
+
+    CURLSHcode code = curl_share_setopt( obj->share, (CURLSHoption) optionId, static_cast<curl_lock_data>( value->Int32Value() ) );
+
+    if ( code != CURLSHE_OK ) {
+        Curl::Raise( curl_share_strerror( code ) );
+        return v8::Undefined();
+    }
+
+    return scope.Close( v8::Integer::New( code ) );
+}
+
+v8::Handle<v8::Value> CurlShare::Close( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    CurlShare *obj = CurlShare::Unwrap( args.This() );
+
+    if ( !obj )
+        return args.This();
+
+    if ( obj->refs ) {
+        Curl::Raise( "Share is still being used by Curl instances." );
+        return v8::Undefined();
+    }
+
+    obj->Cleanup();
+
+    return args.This();
+}
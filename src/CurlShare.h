@@ -0,0 +1,58 @@
+#ifndef CURLSHARE_H
+#define CURLSHARE_H
+
+#include <v8.h>
+#include <node.h>
+
+#include <curl/curl.h>
+
+//Wrapper around a curl_share handle, used to share data (dns cache, ssl sessions, connections, cookies) between Curl instances.
+// The Curl instances using it can run on different threads, so each kind of data has its own lock.
+class CurlShare {
+
+public:
+
+    //Export Share to js
+    static void Initialize( v8::Handle<v8::Object> exports );
+
+    static CurlShare* Unwrap( v8::Handle<v8::Object> );
+    static bool HasInstance( v8::Handle<v8::Value> value );
+
+    //Curl instances using this share must hold a reference, so the handle is not cleaned while in use.
+    void Ref();
+    void Unref();
+
+    bool IsClosed() const;
+
+    CURLSH *share;
+    v8::Persistent<v8::Object> handle;
+
+private:
+
+    //Constructors/Destructors
+    CurlShare( v8::Handle<v8::Object> obj );
+    ~CurlShare();
+    void Cleanup();
+    void Dispose();
+
+    //Members
+    int refs;
+    bool isDisposed;
+    uv_mutex_t locks[CURL_LOCK_DATA_LAST];
+
+    //static members
+    static v8::Persistent<v8::Function> constructor;
+    static v8::Persistent<v8::FunctionTemplate> constructorTemplate;
+
+    //cURL callbacks
+    static void Lock( CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr );
+    static void Unlock( CURL *handle, curl_lock_data data, void *userptr );
+
+    //Js exported Methods
+    static v8::Handle<v8::Value> New( const v8::Arguments &args );
+    static void Destructor( v8::Persistent<v8::Value> value, void *data );
+
+    static v8::Handle<v8::Value> SetOpt( const v8::Arguments &args );
+    static v8::Handle<v8::Value> Close( const v8::Arguments &args );
+};
+#endif
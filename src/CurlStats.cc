@@ -0,0 +1,71 @@
+#include "CurlStats.h"
+
+std::atomic<int64_t> CurlStats::counters[CurlStats::COUNTER_COUNT];
+int CurlStats::jsDepth = 0;
+uint64_t CurlStats::jsTime = 0;
+
+//Names of the counters on the js object, in the order of CurlStats::Counter
+static const char *counterNames[] = {
+    "socketActions",
+    "timerFirings",
+    "dataCallbacks",
+    "headerCallbacks",
+    "batchCallbacks",
+    "uploadCallbacks",
+    "progressCallbacks",
+    "debugCallbacks",
+    "endCallbacks",
+    "errorCallbacks",
+    "bytesIn",
+    "bytesOut",
+    "activeSockets",
+    "activeHandles",
+    "jsTimeNs",
+    "curlTimeNs",
+    "completionTimeNs",
+    "maxCompletionTimeNs",
+    "deferredCompletions"
+};
+
+CurlStats::JsScope::JsScope( Counter counter ) : start( 0 )
+{
+    CurlStats::Add( counter );
+
+    if ( !CurlStats::jsDepth++ )
+        this->start = uv_hrtime();
+}
+
+CurlStats::JsScope::~JsScope()
+{
+    if ( --CurlStats::jsDepth )
+        return;
+
+    uint64_t elapsed = uv_hrtime() - this->start;
+
+    CurlStats::jsTime += elapsed;
+    CurlStats::Add( JS_TIME, static_cast<int64_t>( elapsed ) );
+}
+
+CurlStats::CurlScope::CurlScope() : start( uv_hrtime() ), jsTimeStart( CurlStats::jsTime )
+{
+}
+
+CurlStats::CurlScope::~CurlScope()
+{
+    uint64_t elapsed = uv_hrtime() - this->start;
+    uint64_t jsElapsed = CurlStats::jsTime - this->jsTimeStart;
+
+    CurlStats::Add( CURL_TIME, static_cast<int64_t>( elapsed - jsElapsed ) );
+}
+
+v8::Handle<v8::Object> CurlStats::ToObject()
+{
+    v8::HandleScope scope;
+
+    v8::Handle<v8::Object> stats = v8::Object::New();
+
+    for ( int i = 0; i < COUNTER_COUNT; i++ )
+        stats->Set( v8::String::NewSymbol( counterNames[i] ), v8::Number::New( static_cast<double>( CurlStats::counters[i].load() ) ) );
+
+    return scope.Close( stats );
+}
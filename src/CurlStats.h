@@ -0,0 +1,81 @@
+#ifndef CURLSTATS_H
+#define CURLSTATS_H
+
+#include <v8.h>
+#include <uv.h>
+#include <atomic>
+#include <stdint.h>
+
+//Process wide counters of the work done by the binding, returned by Curl.getStats.
+// Counters can be changed from the worker threads, the times are measured only on the main thread.
+class CurlStats {
+
+public:
+
+    enum Counter {
+        SOCKET_ACTIONS,
+        TIMER_FIRINGS,
+        DATA_CALLBACKS,
+        HEADER_CALLBACKS,
+        BATCH_CALLBACKS,
+        UPLOAD_CALLBACKS,
+        PROGRESS_CALLBACKS,
+        DEBUG_CALLBACKS,
+        END_CALLBACKS,
+        ERROR_CALLBACKS,
+        BYTES_IN,
+        BYTES_OUT,
+        ACTIVE_SOCKETS,
+        ACTIVE_HANDLES, //Curl instances running or waiting on a multi, kept by CurlMulti::SetRunning
+        JS_TIME,   //ns inside js callbacks
+        CURL_TIME, //ns inside curl_multi_socket_action, without the js callbacks called by it
+        COMPLETION_TIME,     //ns delivering finished transfers to js
+        MAX_COMPLETION_TIME, //longest time delivering them in one go, the stall to tune the completion budget with
+        DEFERRED_COMPLETIONS,
+        COUNTER_COUNT
+    };
+
+    static void Add( Counter counter, int64_t value = 1 )
+    {
+        counters[counter] += value;
+    }
+
+    static void Max( Counter counter, int64_t value )
+    {
+        int64_t current = counters[counter].load();
+
+        while ( value > current && !counters[counter].compare_exchange_weak( current, value ) );
+    }
+
+    //Measures a js call made from the main thread, counting it on the given counter.
+    class JsScope {
+    public:
+        JsScope( Counter counter );
+        ~JsScope();
+    private:
+        uint64_t start;
+    };
+
+    //Measures a call to libcurl made from the main thread.
+    class CurlScope {
+    public:
+        CurlScope();
+        ~CurlScope();
+    private:
+        uint64_t start;
+        uint64_t jsTimeStart;
+    };
+
+    //Object with all the counters.
+    static v8::Handle<v8::Object> ToObject();
+
+private:
+
+    static std::atomic<int64_t> counters[COUNTER_COUNT];
+
+    //js callbacks can call js callbacks, only the outer one is measured
+    static int jsDepth;
+    static uint64_t jsTime;
+};
+
+#endif
@@ -0,0 +1,284 @@
+#include "CurlTemplate.h"
+#include "Curl.h"
+
+//Initialize static properties
+v8::Persistent<v8::Function> CurlTemplate::constructor;
+v8::Persistent<v8::FunctionTemplate> CurlTemplate::constructorTemplate;
+
+// Add Template constructor to the module exports
+void CurlTemplate::Initialize( v8::Handle<v8::Object> exports ) {
+
+    v8::HandleScope scope;
+
+    //** Construct Template js "class"
+    v8::Handle<v8::FunctionTemplate> tpl = v8::FunctionTemplate::New( CurlTemplate::New );
+
+    tpl->SetClassName( v8::String::NewSymbol( "Template" ) );
+    tpl->InstanceTemplate()->SetInternalFieldCount( 1 ); //to wrap this
+
+    // Prototype Methods
+    NODE_SET_PROTOTYPE_METHOD( tpl, "_close", CurlTemplate::Close );
+
+    CurlTemplate::constructorTemplate = v8::Persistent<v8::FunctionTemplate>::New( tpl );
+    CurlTemplate::constructor = v8::Persistent<v8::Function>::New( tpl->GetFunction() );
+
+    exports->Set( v8::String::NewSymbol( "Template" ), CurlTemplate::constructor );
+}
+
+CurlTemplate::CurlTemplate( v8::Handle<v8::Object> obj, Curl *source ) : curl( NULL ), refs( 0 ), isDisposed( false ), share( NULL ), metricsLabel( source->metricsLabel ),
+    progressInterval( source->progressInterval ), progressBytes( source->progressBytes ), priority( source->priority ), parent( NULL )
+{
+    obj->SetPointerInInternalField( 0, this );
+
+    this->handle = v8::Persistent<v8::Object>::New( obj );
+    this->handle.MakeWeak( this, CurlTemplate::Destructor );
+
+    this->curl = curl_easy_duphandle( source->curl );
+
+    if ( !this->curl ) {
+
+        Curl::Raise( "curl_easy_duphandle failed!" );
+        return;
+    }
+
+    //the linked lists and the httppost are moved to the template, the source keeps using them through a reference
+    this->curlLinkedLists.swap( source->curlLinkedLists );
+    this->httpPost.swap( source->httpPost );
+
+    //libcurl only copies the strings since 7.17
+    this->curlStrings = source->curlStrings;
+
+    for ( std::map<int, std::string>::iterator it = this->curlStrings.begin(), end = this->curlStrings.end(); it != end; ++it ) {
+
+        curl_easy_setopt( this->curl, (CURLoption) it->first, it->second.c_str() );
+    }
+
+    if ( !source->postFieldsBuffer.IsEmpty() )
+        this->postFieldsBuffer = v8::Persistent<v8::Object>::New( source->postFieldsBuffer );
+
+    //the source was itself created from a template, some of its options may still use that storage
+    if ( source->curlTemplate ) {
+
+        this->parent = source->curlTemplate;
+        this->parent->Ref();
+    }
+
+    source->SetTemplate( this );
+
+    if ( !source->callbacks.progress.IsEmpty() )
+        this->progress = v8::Persistent<v8::Function>::New( source->callbacks.progress );
+
+    if ( !source->callbacks.xferinfo.IsEmpty() )
+        this->xferinfo = v8::Persistent<v8::Function>::New( source->callbacks.xferinfo );
+
+    if ( !source->callbacks.debug.IsEmpty() )
+        this->debug = v8::Persistent<v8::Function>::New( source->callbacks.debug );
+
+    //the share is not copied by curl_easy_duphandle
+    if ( source->share ) {
+
+        this->share = source->share;
+        this->share->Ref();
+    }
+}
+
+CurlTemplate::~CurlTemplate()
+{
+    this->Cleanup();
+
+    for ( std::vector<curl_slist*>::iterator it = this->curlLinkedLists.begin(), end = this->curlLinkedLists.end(); it != end; ++it ) {
+
+        if ( *it )
+            curl_slist_free_all( *it );
+    }
+
+    if ( this->share )
+        this->share->Unref();
+
+    if ( this->parent )
+        this->parent->Unref();
+
+    this->progress.Dispose();
+    this->xferinfo.Dispose();
+    this->debug.Dispose();
+    this->postFieldsBuffer.Dispose();
+}
+
+//Only the template handle is cleaned, the options storage is kept until no instance is using it
+void CurlTemplate::Cleanup()
+{
+    if ( !this->curl )
+        return;
+
+    curl_easy_cleanup( this->curl );
+    this->curl = NULL;
+}
+
+//Dispose persistent handler, the instance is deleted when no Curl instance is using it anymore
+void CurlTemplate::Dispose()
+{
+    this->handle->SetPointerInInternalField( 0, NULL );
+
+    this->handle.Dispose();
+    this->handle.Clear();
+
+    this->isDisposed = true;
+
+    if ( !this->refs )
+        delete this;
+}
+
+void CurlTemplate::Ref()
+{
+    ++this->refs;
+}
+
+void CurlTemplate::Unref()
+{
+    if ( !--this->refs && this->isDisposed )
+        delete this;
+}
+
+bool CurlTemplate::IsClosed() const
+{
+    return this->curl == NULL;
+}
+
+void CurlTemplate::Apply( Curl *curl )
+{
+    if ( !this->progress.IsEmpty() )
+        curl->callbacks.progress = v8::Persistent<v8::Function>::New( this->progress );
+
+#if LIBCURL_VERSION_NUM >= 0x072000
+    if ( !this->xferinfo.IsEmpty() )
+        curl->callbacks.xferinfo = v8::Persistent<v8::Function>::New( this->xferinfo );
+
+    curl_easy_setopt( curl->curl, CURLOPT_XFERINFODATA, curl );
+#endif
+
+    //the progress functions may have been set by a progress array on the source, without a js callback
+    curl_easy_setopt( curl->curl, CURLOPT_PROGRESSDATA, curl );
+
+    if ( !this->debug.IsEmpty() )
+        curl->callbacks.debug = v8::Persistent<v8::Function>::New( this->debug );
+
+    //the debug function may have been set by a trace on the source, without a js callback
+    curl_easy_setopt( curl->curl, CURLOPT_DEBUGDATA, curl );
+
+    //the upload queue of the source is not shared, the instance has to enable its own upload
+    curl_easy_setopt( curl->curl, CURLOPT_READDATA, curl );
+
+    //the duplicated handle uses the same memory
+    if ( !this->postFieldsBuffer.IsEmpty() )
+        curl->SetPostFieldsBuffer( this->postFieldsBuffer );
+
+    if ( this->share ) {
+
+        curl_easy_setopt( curl->curl, CURLOPT_SHARE, this->share->share );
+        curl->SetShare( this->share );
+    }
+
+    curl->metricsLabel = this->metricsLabel;
+    curl->progressInterval = this->progressInterval;
+    curl->progressBytes = this->progressBytes;
+    curl->priority = this->priority;
+
+    curl->SetTemplate( this );
+}
+
+const std::string *CurlTemplate::GetString( int optionId ) const
+{
+    std::map<int, std::string>::const_iterator it = this->curlStrings.find( optionId );
+
+    if ( it != this->curlStrings.end() )
+        return &it->second;
+
+    return this->parent ? this->parent->GetString( optionId ) : NULL;
+}
+
+CurlTemplate* CurlTemplate::Unwrap( v8::Handle<v8::Object> value )
+{
+    return static_cast<CurlTemplate*>( value->GetPointerFromInternalField( 0 ) );
+}
+
+bool CurlTemplate::HasInstance( v8::Handle<v8::Value> value )
+{
+    return value->IsObject() && CurlTemplate::constructorTemplate->HasInstance( value );
+}
+
+//Javascript Constructor
+v8::Handle<v8::Value> CurlTemplate::New( const v8::Arguments &args ) {
+
+    v8::HandleScope scope;
+
+    if ( args.IsConstructCall() ) {
+        // Invoked as constructor: `new Template(...)`
+
+        if ( !Curl::HasInstance( args[0] ) ) {
+            v8::ThrowException(v8::Exception::TypeError(
+                v8::String::New( "Template must be created from a Curl instance." )
+            ));
+            return v8::Undefined();
+        }
+
+        v8::Handle<v8::Object> sourceObj = args[0]->ToObject();
+        Curl *source = Curl::Unwrap( sourceObj );
+
+        if ( !source ) {
+            Curl::Raise( "Curl is closed." );
+            return v8::Undefined();
+        }
+
+        if ( source->isInsideMultiCurl ) {
+            Curl::Raise( "Cannot create a template from a running Curl session." );
+            return v8::Undefined();
+        }
+
+        new CurlTemplate( args.This(), source );
+
+        //js state of the source that is given to the new instances
+        static const char *jsState[] = { "features", "_multi", "_share" };
+
+        for ( size_t i = 0; i < sizeof( jsState ) / sizeof( jsState[0] ); ++i ) {
+
+            v8::Handle<v8::String> name = v8::String::NewSymbol( jsState[i] );
+            args.This()->Set( name, sourceObj->Get( name ) );
+        }
+
+        return args.This();
+
+    } else {
+        // Invoked as plain function `Template(...)`, turn into construct call.
+
+        const int argc = 1;
+        v8::Handle<v8::Value> argv[argc] = { args[0] };
+
+        return scope.Close( constructor->NewInstance( argc, argv ) );
+    }
+}
+
+//This is called by v8 when there are no more references to the Template instance on js.
+void CurlTemplate::Destructor( v8::Persistent<v8::Value> value, void *data )
+{
+    v8::Handle<v8::Object> object = value->ToObject();
+    CurlTemplate *curlTemplate = static_cast<CurlTemplate*>( object->GetPointerFromInternalField( 0 ) );
+    curlTemplate->Dispose();
+}
+
+//No instance can be created from the template after closing it,
+// the ones already created keep working.
+v8::Handle<v8::Value> CurlTemplate::Close( const v8::Arguments &args )
+{
+    v8::HandleScope scope;
+
+    CurlTemplate *obj = CurlTemplate::Unwrap( args.This() );
+
+    if ( !obj ) {
+        Curl::Raise( "Template is already closed." );
+        return v8::Undefined();
+    }
+
+    obj->Cleanup();
+
+    return args.This();
+}
@@ -0,0 +1,86 @@
+#ifndef CURLTEMPLATE_H
+#define CURLTEMPLATE_H
+
+#include <v8.h>
+#include <node.h>
+#include <map>
+#include <vector>
+#include <string>
+
+#include <curl/curl.h>
+
+#include "CurlHttpPost.h"
+
+class Curl;
+class CurlShare;
+
+//Options of a configured Curl instance, frozen, used to create new instances with curl_easy_duphandle.
+// The strings, linked lists and httppost used by the options are owned by the template,
+// the instances created from it, and the one it was created from, just reference them.
+class CurlTemplate {
+
+public:
+
+    //Export Template to js
+    static void Initialize( v8::Handle<v8::Object> exports );
+
+    static CurlTemplate* Unwrap( v8::Handle<v8::Object> );
+    static bool HasInstance( v8::Handle<v8::Value> value );
+
+    //Curl instances using the options storage must hold a reference, so it's not freed while in use.
+    void Ref();
+    void Unref();
+
+    bool IsClosed() const;
+
+    //Point the callbacks of a handle duplicated from this template to the given instance.
+    void Apply( Curl *curl );
+
+    //Value of a string option set on the template, or on the one it was created from. NULL if it was not set.
+    const std::string *GetString( int optionId ) const;
+
+    CURL *curl;
+    v8::Persistent<v8::Object> handle;
+
+private:
+
+    //Constructors/Destructors
+    CurlTemplate( v8::Handle<v8::Object> obj, Curl *source );
+    ~CurlTemplate();
+    void Cleanup();
+    void Dispose();
+
+    //Members
+    int refs;
+    bool isDisposed;
+
+    CurlHttpPost httpPost;
+    std::vector<curl_slist*> curlLinkedLists;
+    std::map<int, std::string> curlStrings;
+    v8::Persistent<v8::Object> postFieldsBuffer;
+
+    CurlShare *share;
+
+    int32_t metricsLabel;
+    uint64_t progressInterval;
+    double progressBytes;
+    int32_t priority;
+
+    //template the source was created from, its storage may still be used by the options
+    CurlTemplate *parent;
+
+    v8::Persistent<v8::Function> progress;
+    v8::Persistent<v8::Function> xferinfo;
+    v8::Persistent<v8::Function> debug;
+
+    //static members
+    static v8::Persistent<v8::Function> constructor;
+    static v8::Persistent<v8::FunctionTemplate> constructorTemplate;
+
+    //Js exported Methods
+    static v8::Handle<v8::Value> New( const v8::Arguments &args );
+    static void Destructor( v8::Persistent<v8::Value> value, void *data );
+
+    static v8::Handle<v8::Value> Close( const v8::Arguments &args );
+};
+#endif
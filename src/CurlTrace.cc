@@ -0,0 +1,94 @@
+#include "CurlTrace.h"
+
+#include <node.h>
+#include <node_buffer.h>
+#include <uv.h>
+#include <stdlib.h>
+#include <string.h>
+
+CurlTrace::CurlTrace( size_t capacity, size_t payloadSize ) : events( NULL ), capacity( capacity ), payloadSize( payloadSize ), next( 0 ), count( 0 ), dropped( 0 )
+{
+    //keeps the events aligned
+    this->stride = ( sizeof( Event ) + payloadSize + sizeof( uint64_t ) - 1 ) & ~( sizeof( uint64_t ) - 1 );
+
+    this->events = static_cast<char*>( malloc( this->stride * capacity ) );
+}
+
+CurlTrace::~CurlTrace()
+{
+    free( this->events );
+}
+
+CurlTrace::Event *CurlTrace::GetEvent( size_t index )
+{
+    return reinterpret_cast<Event*>( this->events + index * this->stride );
+}
+
+void CurlTrace::Record( curl_infotype type, const char *data, size_t size )
+{
+    if ( !this->events || !this->capacity )
+        return;
+
+    Event *event = this->GetEvent( this->next );
+
+    event->time = uv_hrtime();
+    event->type = type;
+    event->size = static_cast<uint32_t>( size );
+
+    //encrypted data is not useful
+    event->length = ( type == CURLINFO_SSL_DATA_IN || type == CURLINFO_SSL_DATA_OUT ) ? 0 : static_cast<uint32_t>( size < this->payloadSize ? size : this->payloadSize );
+
+    memcpy( reinterpret_cast<char*>( event + 1 ), data, event->length );
+
+    this->next = ( this->next + 1 ) % this->capacity;
+
+    if ( this->count < this->capacity )
+        ++this->count;
+    else
+        ++this->dropped;
+}
+
+v8::Handle<v8::Object> CurlTrace::Drain()
+{
+    v8::HandleScope scope;
+
+    v8::Handle<v8::Array> events = v8::Array::New( static_cast<int>( this->count ) );
+
+    v8::Handle<v8::String> timeSymbol = v8::String::NewSymbol( "time" );
+    v8::Handle<v8::String> typeSymbol = v8::String::NewSymbol( "type" );
+    v8::Handle<v8::String> sizeSymbol = v8::String::NewSymbol( "size" );
+    v8::Handle<v8::String> dataSymbol = v8::String::NewSymbol( "data" );
+
+    size_t first = ( this->next + this->capacity - this->count ) % this->capacity;
+
+    for ( size_t i = 0; i < this->count; ++i ) {
+
+        Event *event = this->GetEvent( ( first + i ) % this->capacity );
+        const char *payload = reinterpret_cast<const char*>( event + 1 );
+
+        v8::Handle<v8::Object> item = v8::Object::New();
+
+        item->Set( timeSymbol, v8::Number::New( event->time / 1e6 ) );
+        item->Set( typeSymbol, v8::Integer::New( event->type ) );
+        item->Set( sizeSymbol, v8::Number::New( event->size ) );
+
+        //text and headers are strings, the rest is binary
+        if ( event->type == CURLINFO_TEXT || event->type == CURLINFO_HEADER_IN || event->type == CURLINFO_HEADER_OUT )
+            item->Set( dataSymbol, v8::String::New( payload, static_cast<int>( event->length ) ) );
+        else
+            item->Set( dataSymbol, node::Buffer::New( payload, event->length )->handle_ );
+
+        events->Set( static_cast<uint32_t>( i ), item );
+    }
+
+    v8::Handle<v8::Object> trace = v8::Object::New();
+
+    trace->Set( v8::String::NewSymbol( "events" ), events );
+    trace->Set( v8::String::NewSymbol( "dropped" ), v8::Number::New( this->dropped ) );
+
+    this->next = 0;
+    this->count = 0;
+    this->dropped = 0;
+
+    return scope.Close( trace );
+}
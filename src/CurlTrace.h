@@ -0,0 +1,45 @@
+#ifndef CURLTRACE_H
+#define CURLTRACE_H
+
+#include <v8.h>
+#include <stdint.h>
+
+#include <curl/curl.h>
+
+//Ring of the debug events of a handle, recorded natively and read by js only when needed.
+// Memory is allocated once, when the ring is full the oldest events are overwritten.
+class CurlTrace
+{
+public:
+
+    //capacity is the amount of events kept, payloadSize the maximum amount of bytes kept from each one.
+    CurlTrace( size_t capacity, size_t payloadSize );
+
+    ~CurlTrace();
+
+    //Called from the debug callback, can be on a worker thread.
+    void Record( curl_infotype type, const char *data, size_t size );
+
+    //Object with the events recorded, the oldest first, and the amount overwritten. The ring is emptied.
+    v8::Handle<v8::Object> Drain();
+
+private:
+
+    struct Event {
+        uint64_t time; //uv_hrtime
+        uint32_t size; //of the whole data given by libcurl
+        uint32_t length; //of the data kept
+        int32_t type;
+    };
+
+    char *events;
+    size_t stride;
+    size_t capacity;
+    size_t payloadSize;
+    size_t next;
+    size_t count;
+    double dropped;
+
+    Event *GetEvent( size_t index );
+};
+#endif
@@ -0,0 +1,592 @@
+#include "CurlWorker.h"
+#include "Curl.h"
+#include "CurlStats.h"
+
+#include <iostream>
+#include <algorithm>
+#include <stdlib.h>
+
+CurlWorker::CurlWorker( CurlMessageQueue *completions, uv_async_t *notify ) : loop( NULL ), multi( NULL ), runningHandles( 0 ), hasPushed( false ), completions( completions ), notify( notify )
+{
+    uv_mutex_init( &this->mutex );
+}
+
+CurlWorker::~CurlWorker()
+{
+    uv_mutex_destroy( &this->mutex );
+}
+
+//Creates the loop and the multi handle, and starts the thread.
+bool CurlWorker::Start()
+{
+    this->multi = curl_multi_init();
+
+    if ( !this->multi )
+        return false;
+
+    this->loop = uv_loop_new();
+
+    if ( !this->loop ) {
+
+        curl_multi_cleanup( this->multi );
+        this->multi = NULL;
+        return false;
+    }
+
+    uv_async_init( this->loop, &this->wakeup, CurlWorker::OnWakeup );
+    this->wakeup.data = this;
+
+    uv_timer_init( this->loop, &this->timeout );
+    this->timeout.data = this;
+
+    uv_idle_init( this->loop, &this->immediateTimeout );
+    this->immediateTimeout.data = this;
+    this->timeoutDue = 0;
+
+    curl_multi_setopt( this->multi, CURLMOPT_SOCKETFUNCTION, CurlWorker::HandleSocket );
+    curl_multi_setopt( this->multi, CURLMOPT_SOCKETDATA, this );
+    curl_multi_setopt( this->multi, CURLMOPT_TIMERFUNCTION, CurlWorker::HandleTimeout );
+    curl_multi_setopt( this->multi, CURLMOPT_TIMERDATA, this );
+
+    if ( uv_thread_create( &this->thread, CurlWorker::Run, this ) != 0 ) {
+
+        //nothing is running on the loop yet, it can be cleaned here
+        curl_multi_cleanup( this->multi );
+        this->multi = NULL;
+
+        uv_close( reinterpret_cast<uv_handle_t*>( &this->wakeup ), NULL );
+        uv_close( reinterpret_cast<uv_handle_t*>( &this->timeout ), NULL );
+        uv_close( reinterpret_cast<uv_handle_t*>( &this->immediateTimeout ), NULL );
+        uv_run( this->loop, UV_RUN_DEFAULT );
+
+        uv_loop_delete( this->loop );
+        this->loop = NULL;
+
+        return false;
+    }
+
+    return true;
+}
+
+//Stops the thread, any transfer still running is dropped.
+void CurlWorker::Stop()
+{
+    if ( !this->loop )
+        return;
+
+    Command command = Command();
+    command.type = Command::STOP;
+
+    this->Post( command );
+
+    uv_thread_join( &this->thread );
+
+    uv_loop_delete( this->loop );
+    this->loop = NULL;
+}
+
+void CurlWorker::Add( Curl *curl, uint32_t requestId )
+{
+    Command command = Command();
+    command.type = Command::ADD;
+    command.curl = curl;
+    command.requestId = requestId;
+
+    this->Post( command );
+}
+
+void CurlWorker::Remove( Curl *curl, uint32_t requestId )
+{
+    Command command = Command();
+    command.type = Command::REMOVE;
+    command.curl = curl;
+    command.requestId = requestId;
+
+    this->Post( command );
+}
+
+void CurlWorker::Pause( Curl *curl, int bitmask )
+{
+    Command command = Command();
+    command.type = Command::PAUSE;
+    command.curl = curl;
+    command.value = bitmask;
+
+    this->Post( command );
+}
+
+void CurlWorker::SetOpt( CURLMoption option, long value )
+{
+    Command command = Command();
+    command.type = Command::SETOPT;
+    command.option = option;
+    command.value = value;
+
+    this->Post( command );
+}
+
+void CurlWorker::SetOptOfft( CURLMoption option, curl_off_t value )
+{
+    Command command = Command();
+    command.type = Command::SETOPT_OFFT;
+    command.option = option;
+    command.offtValue = value;
+
+    this->Post( command );
+}
+
+void CurlWorker::Post( const Command &command )
+{
+    uv_mutex_lock( &this->mutex );
+    this->commands.push_back( command );
+    uv_mutex_unlock( &this->mutex );
+
+    uv_async_send( &this->wakeup );
+}
+
+void CurlWorker::Run( void *arg )
+{
+    CurlWorker *worker = static_cast<CurlWorker*>( arg );
+
+    //returns after Shutdown closes all handles
+    uv_run( worker->loop, UV_RUN_DEFAULT );
+}
+
+void CurlWorker::OnWakeup( uv_async_t *handle, int status )
+{
+    CurlWorker *worker = static_cast<CurlWorker*>( handle->data );
+
+    worker->RunCommands();
+
+    if ( !worker->multi )
+        return;
+
+    worker->PostAllStaged();
+    worker->ProcessMessages();
+    worker->Notify();
+}
+
+void CurlWorker::RunCommands()
+{
+    std::vector<Command> commands;
+
+    uv_mutex_lock( &this->mutex );
+    commands.swap( this->commands );
+    uv_mutex_unlock( &this->mutex );
+
+    for ( std::vector<Command>::iterator it = commands.begin(), end = commands.end(); it != end; ++it ) {
+
+        Command &command = *it;
+
+        switch ( command.type ) {
+
+        case Command::ADD: {
+
+            Request request = { command.curl, command.requestId };
+
+            CURLMcode code = curl_multi_add_handle( this->multi, command.curl->curl );
+
+            if ( code != CURLM_OK ) {
+
+                CurlMessage *message = new CurlMessage( CurlMessage::DONE, command.requestId );
+                message->result = CURLE_FAILED_INIT;
+
+                this->completions->Push( message );
+                this->hasPushed = true;
+
+                break;
+            }
+
+            this->requests[command.curl->curl] = request;
+            break;
+        }
+
+        case Command::REMOVE: {
+
+            Curl *curl = command.curl;
+
+            if ( this->requests.erase( curl->curl ) ) {
+
+                curl_multi_remove_handle( this->multi, curl->curl );
+
+                if ( curl->isQueuedForFlush ) {
+
+                    this->staged.erase( std::remove( this->staged.begin(), this->staged.end(), curl ), this->staged.end() );
+                    curl->isQueuedForFlush = false;
+                }
+            }
+
+            //the main thread owns the handle again after this message
+            this->completions->Push( new CurlMessage( CurlMessage::REMOVED, command.requestId ) );
+            this->hasPushed = true;
+
+            break;
+        }
+
+        case Command::PAUSE:
+
+            if ( this->requests.count( command.curl->curl ) )
+                curl_easy_pause( command.curl->curl, static_cast<int>( command.value ) );
+
+            break;
+
+        case Command::SETOPT:
+
+            curl_multi_setopt( this->multi, command.option, command.value );
+            break;
+
+        case Command::SETOPT_OFFT:
+
+            curl_multi_setopt( this->multi, command.option, command.offtValue );
+            break;
+
+        case Command::STOP:
+
+            this->Shutdown();
+            return;
+        }
+    }
+}
+
+uv_loop_t *CurlWorker::GetLoop() const
+{
+    return this->loop;
+}
+
+void CurlWorker::QueueStaged( Curl *curl )
+{
+    if ( curl->isQueuedForFlush )
+        return;
+
+    curl->isQueuedForFlush = true;
+    this->staged.push_back( curl );
+}
+
+//Moves the staged chunks of the given handle to messages, the memory is not copied.
+void CurlWorker::PostStaged( Curl *curl, uint32_t requestId )
+{
+    curl->isQueuedForFlush = false;
+
+    if ( !curl->stagedHeaderEnds.empty() ) {
+
+        CurlMessage *message = new CurlMessage( CurlMessage::HEADER, requestId );
+
+        message->chunks.swap( curl->stagedHeader );
+        message->ends.swap( curl->stagedHeaderEnds );
+
+        this->completions->Push( message );
+        this->hasPushed = true;
+    }
+
+    if ( !curl->stagedDataEnds.empty() ) {
+
+        CurlMessage *message = new CurlMessage( CurlMessage::DATA, requestId );
+
+        message->chunks.swap( curl->stagedData );
+        message->ends.swap( curl->stagedDataEnds );
+
+        this->completions->Push( message );
+        this->hasPushed = true;
+    }
+}
+
+void CurlWorker::PostAllStaged()
+{
+    for ( std::vector<Curl*>::iterator it = this->staged.begin(), end = this->staged.end(); it != end; ++it ) {
+
+        Curl *curl = *it;
+
+        this->PostStaged( curl, this->requests[curl->curl].requestId );
+    }
+
+    this->staged.clear();
+}
+
+void CurlWorker::ProcessMessages()
+{
+    CURLMsg *msg = NULL;
+    int pending = 0;
+
+    while( ( msg = curl_multi_info_read( this->multi, &pending ) ) ) {
+
+        if ( msg->msg == CURLMSG_DONE ) {
+
+            std::map<CURL*, Request>::iterator it = this->requests.find( msg->easy_handle );
+
+            if ( it == this->requests.end() )
+                continue;
+
+            Request request = it->second;
+            CURLcode statusCode = msg->data.result;
+
+            this->requests.erase( it );
+
+            curl_multi_remove_handle( this->multi, request.curl->curl );
+
+            //the main thread owns the handle again after the DONE message, nothing can be left behind
+            if ( request.curl->isQueuedForFlush ) {
+
+                this->staged.erase( std::remove( this->staged.begin(), this->staged.end(), request.curl ), this->staged.end() );
+                this->PostStaged( request.curl, request.requestId );
+            }
+
+            CurlMessage *message = new CurlMessage( CurlMessage::DONE, request.requestId );
+            message->result = statusCode;
+
+            this->completions->Push( message );
+            this->hasPushed = true;
+        }
+    }
+}
+
+//Wake up the main thread, if there is something for it.
+void CurlWorker::Notify()
+{
+    if ( !this->hasPushed )
+        return;
+
+    this->hasPushed = false;
+
+    uv_async_send( this->notify );
+}
+
+//Runs on the worker thread, closes everything so uv_run returns.
+void CurlWorker::Shutdown()
+{
+    //transfers still running are dropped, the main thread is not waiting for them
+    for ( std::map<CURL*, Request>::iterator it = this->requests.begin(), end = this->requests.end(); it != end; ++it )
+        curl_multi_remove_handle( this->multi, it->first );
+
+    this->requests.clear();
+    this->staged.clear();
+
+    curl_multi_cleanup( this->multi );
+    this->multi = NULL;
+
+    for ( std::vector<CurlSocketContext*>::iterator it = this->sockets.begin(), end = this->sockets.end(); it != end; ++it ) {
+
+        if ( !*it )
+            continue;
+
+        if ( (*it)->isActive )
+            CurlStats::Add( CurlStats::ACTIVE_SOCKETS, -1 );
+
+        uv_poll_stop( &(*it)->pollHandle );
+        uv_close( reinterpret_cast<uv_handle_t*>( &(*it)->pollHandle ), CurlWorker::OnCurlSocketClose );
+    }
+
+    this->sockets.clear();
+
+    uv_timer_stop( &this->timeout );
+    uv_idle_stop( &this->immediateTimeout );
+
+    uv_close( reinterpret_cast<uv_handle_t*>( &this->timeout ), NULL );
+    uv_close( reinterpret_cast<uv_handle_t*>( &this->immediateTimeout ), NULL );
+    uv_close( reinterpret_cast<uv_handle_t*>( &this->wakeup ), NULL );
+}
+
+int CurlWorker::HandleSocket( CURL *easy, curl_socket_t s, int action, void *userp, void *socketp )
+{
+    CurlWorker *worker = static_cast<CurlWorker*>( userp );
+    CurlSocketContext *ctx;
+    uv_err_s error;
+
+    if ( action == CURL_POLL_IN || action == CURL_POLL_OUT || action == CURL_POLL_INOUT || action == CURL_POLL_NONE ) {
+
+        ctx = ( socketp ) ? static_cast<CurlSocketContext*>( socketp ) : worker->CreateCurlSocketContext( s );
+        curl_multi_assign( worker->multi, s, static_cast<void*>( ctx ) );
+
+        int events = 0;
+
+        switch ( action ) {
+
+        case CURL_POLL_IN:
+            events |= UV_READABLE;
+            break;
+        case CURL_POLL_OUT:
+            events |= UV_WRITABLE;
+            break;
+        case CURL_POLL_INOUT:
+            events |= UV_READABLE | UV_WRITABLE;
+            break;
+        }
+
+        return uv_poll_start( &ctx->pollHandle, events, CurlWorker::Process );
+    }
+
+    if ( action == CURL_POLL_REMOVE && socketp ) {
+
+        ctx = static_cast<CurlSocketContext*>( socketp );
+
+        uv_poll_stop( &ctx->pollHandle );
+        curl_multi_assign( worker->multi, s, NULL );
+
+        worker->DestroyCurlSocketContext( ctx );
+
+        return 0;
+    }
+
+    error = uv_last_error( worker->loop );
+    std::cerr << uv_err_name( error ) << " " << uv_strerror( error );
+    abort();
+}
+
+CurlWorker::CurlSocketContext* CurlWorker::CreateCurlSocketContext( curl_socket_t sockfd )
+{
+    uv_err_s error;
+    CurlSocketContext *ctx;
+    size_t slot = static_cast<size_t>( sockfd );
+
+    if ( slot >= this->sockets.size() )
+        this->sockets.resize( slot + 1, NULL );
+
+    ctx = this->sockets[slot];
+
+    if ( ctx ) {
+
+        ctx->isActive = true;
+
+        CurlStats::Add( CurlStats::ACTIVE_SOCKETS );
+
+        return ctx;
+    }
+
+    ctx = static_cast<CurlSocketContext*>( malloc( sizeof( *ctx ) ) );
+
+    ctx->sockfd   = sockfd;
+    ctx->worker   = this;
+    ctx->isActive = true;
+
+    if ( uv_poll_init_socket( this->loop, &ctx->pollHandle, sockfd ) == -1 ) {
+
+        error = uv_last_error( this->loop );
+        std::cerr << uv_err_name( error ) << uv_strerror( error );
+        abort();
+    }
+
+    ctx->pollHandle.data = ctx;
+
+    this->sockets[slot] = ctx;
+
+    CurlStats::Add( CurlStats::ACTIVE_SOCKETS );
+
+    return ctx;
+}
+
+//The poll handle is already stopped, see CurlMulti::DestroyCurlSocketContext
+void CurlWorker::DestroyCurlSocketContext( CurlSocketContext* ctx )
+{
+    ctx->isActive = false;
+
+    CurlStats::Add( CurlStats::ACTIVE_SOCKETS, -1 );
+
+#if defined(_WIN32)
+    this->sockets[static_cast<size_t>( ctx->sockfd )] = NULL;
+
+    uv_close( reinterpret_cast<uv_handle_t*>( &ctx->pollHandle ), CurlWorker::OnCurlSocketClose );
+#endif
+}
+
+void CurlWorker::OnCurlSocketClose( uv_handle_t *handle )
+{
+    CurlSocketContext *ctx = static_cast<CurlSocketContext*>( handle->data );
+    free( ctx );
+}
+
+int CurlWorker::HandleTimeout( CURLM *multi, long timeoutMs, void *userp )
+{
+    CurlWorker *worker = static_cast<CurlWorker*>( userp );
+
+    //same as CurlMulti::HandleTimeout
+    if ( timeoutMs < 0 ) {
+
+        uv_timer_stop( &worker->timeout );
+        uv_idle_stop( &worker->immediateTimeout );
+        worker->timeoutDue = 0;
+
+        return 0;
+    }
+
+    if ( timeoutMs == 0 ) {
+
+        uv_timer_stop( &worker->timeout );
+        worker->timeoutDue = 0;
+
+        return uv_idle_start( &worker->immediateTimeout, CurlWorker::OnImmediateTimeout );
+    }
+
+    uv_idle_stop( &worker->immediateTimeout );
+
+    int64_t due = uv_now( worker->loop ) + timeoutMs;
+
+    if ( due == worker->timeoutDue && uv_is_active( reinterpret_cast<uv_handle_t*>( &worker->timeout ) ) )
+        return 0;
+
+    worker->timeoutDue = due;
+
+    return uv_timer_start( &worker->timeout, CurlWorker::OnTimeout, timeoutMs, 0 );
+}
+
+void CurlWorker::OnTimeout( uv_timer_t *req, int status )
+{
+    CurlWorker *worker = static_cast<CurlWorker*>( req->data );
+
+    worker->timeoutDue = 0;
+    worker->RunTimeout();
+}
+
+void CurlWorker::OnImmediateTimeout( uv_idle_t *handle, int status )
+{
+    CurlWorker *worker = static_cast<CurlWorker*>( handle->data );
+
+    uv_idle_stop( handle );
+
+    worker->RunTimeout();
+}
+
+void CurlWorker::RunTimeout()
+{
+    if ( !this->multi )
+        return;
+
+    CurlStats::Add( CurlStats::TIMER_FIRINGS );
+    CurlStats::Add( CurlStats::SOCKET_ACTIONS );
+
+    curl_multi_socket_action( this->multi, CURL_SOCKET_TIMEOUT, 0, &this->runningHandles );
+
+    this->PostAllStaged();
+    this->ProcessMessages();
+    this->Notify();
+}
+
+void CurlWorker::Process( uv_poll_t* handle, int status, int events )
+{
+    CurlSocketContext *ctx = static_cast<CurlSocketContext*>( handle->data );
+    CurlWorker *worker = ctx->worker;
+
+    if ( !worker->multi )
+        return;
+
+    int flags = 0;
+
+    if ( events & UV_READABLE ) flags |= CURL_CSELECT_IN;
+    if ( events & UV_WRITABLE ) flags |= CURL_CSELECT_OUT;
+
+    CURLMcode code;
+
+    do {
+
+        CurlStats::Add( CurlStats::SOCKET_ACTIONS );
+
+        code = curl_multi_socket_action( worker->multi, ctx->sockfd, flags, &worker->runningHandles );
+
+    } while ( code == CURLM_CALL_MULTI_PERFORM );
+
+    //there is no js to report to from here, the transfers with problems are going to finish with an error
+    if ( code != CURLM_OK )
+        std::cerr << "curl_multi_socket_action Failed: " << curl_multi_strerror( code ) << std::endl;
+
+    worker->PostAllStaged();
+    worker->ProcessMessages();
+    worker->Notify();
+}
@@ -0,0 +1,111 @@
+#ifndef CURLWORKER_H
+#define CURLWORKER_H
+
+#include <v8.h>
+#include <node.h>
+#include <map>
+#include <vector>
+
+#include <curl/curl.h>
+
+#include "CurlMessageQueue.h"
+
+class Curl;
+
+//Native thread running its own curl_multi handle on its own libuv loop.
+// Transfers are handed to it with commands, and what happens with them is sent back as CurlMessage.
+// Nothing here touches v8, the Curl callbacks only stage the chunks while the transfer runs on the worker.
+class CurlWorker {
+
+public:
+
+    //messages are pushed to completions, notify is sent after each batch of messages.
+    CurlWorker( CurlMessageQueue *completions, uv_async_t *notify );
+    ~CurlWorker();
+
+    bool Start();
+    void Stop();
+
+    //Commands, called from the main thread.
+    void Add( Curl *curl, uint32_t requestId );
+    void Remove( Curl *curl, uint32_t requestId ); //a REMOVED message is sent when the worker is not using the handle anymore
+    void Pause( Curl *curl, int bitmask );
+    void SetOpt( CURLMoption option, long value );
+    void SetOptOfft( CURLMoption option, curl_off_t value );
+
+    //Called by the Curl callbacks, on the worker thread, when there are chunks staged.
+    void QueueStaged( Curl *curl );
+
+    //Loop of the worker thread, for synchronous fs calls made by the Curl callbacks.
+    uv_loop_t *GetLoop() const;
+
+private:
+
+    struct Command {
+        enum { ADD, REMOVE, PAUSE, SETOPT, SETOPT_OFFT, STOP };
+
+        int type;
+        Curl *curl;
+        uint32_t requestId;
+        long value;
+        curl_off_t offtValue;
+        CURLMoption option;
+    };
+
+    //kept after libcurl removes their socket, and reused by the next socket with the same fd
+    struct CurlSocketContext {
+        uv_poll_t pollHandle;
+        curl_socket_t sockfd;
+        CurlWorker *worker;
+        bool isActive;
+    };
+
+    struct Request {
+        Curl *curl;
+        uint32_t requestId;
+    };
+
+    //Members shared with the main thread, guarded by mutex
+    uv_mutex_t mutex;
+    std::vector<Command> commands;
+
+    //Members only used on the worker thread after Start
+    uv_loop_t *loop;
+    uv_thread_t thread;
+    uv_async_t wakeup;
+    uv_timer_t timeout;
+    uv_idle_t immediateTimeout;
+    int64_t timeoutDue;
+    CURLM *multi;
+    int runningHandles;
+    std::map<CURL*, Request> requests;
+    std::vector<Curl*> staged;
+    std::vector<CurlSocketContext*> sockets; //indexed by fd
+    bool hasPushed;
+
+    CurlMessageQueue *completions;
+    uv_async_t *notify;
+
+    void Post( const Command &command );
+    void RunCommands();
+    void PostStaged( Curl *curl, uint32_t requestId );
+    void PostAllStaged();
+    void ProcessMessages();
+    void Notify();
+    void Shutdown();
+    void RunTimeout();
+
+    static void Run( void *arg );
+    static void OnWakeup( uv_async_t *handle, int status );
+
+    //LibUV Socket polling, same as CurlMulti but on the worker loop
+    CurlSocketContext *CreateCurlSocketContext( curl_socket_t sockfd );
+    void DestroyCurlSocketContext( CurlSocketContext *ctx );
+    static int HandleSocket( CURL *easy, curl_socket_t s, int action, void *userp, void *socketp );
+    static int HandleTimeout( CURLM *multi, long timeoutMs, void *userp );
+    static void OnTimeout( uv_timer_t *req, int status );
+    static void OnImmediateTimeout( uv_idle_t *handle, int status );
+    static void Process( uv_poll_t* handle, int status, int events );
+    static void OnCurlSocketClose( uv_handle_t *handle );
+};
+#endif
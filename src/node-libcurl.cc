@@ -1,10 +1,20 @@
 #include <v8.h>
 #include <node.h>
 #include "Curl.h"
+#include "CurlMulti.h"
+#include "CurlShare.h"
+#include "CurlPool.h"
+#include "CurlTemplate.h"
+#include "CurlMetrics.h"
 
 void Initialize( v8::Handle<v8::Object> exports ) {
 
     Curl::Initialize( exports );
+    CurlMulti::Initialize( exports );
+    CurlShare::Initialize( exports );
+    CurlPool::Initialize( exports );
+    CurlTemplate::Initialize( exports );
+    CurlMetrics::Initialize( exports );
 }
 
 NODE_MODULE( node_libcurl, Initialize );
\ No newline at end of file
@@ -136,6 +136,99 @@ describe( 'Curl', function() {
             curl.perform();
         });
 
+        it( 'should store data natively when NATIVE_DATA_STORAGE is set', function( done ) {
+
+            var dataEventsCount = 0;
+
+            curl.enable( Curl.feature.NATIVE_DATA_STORAGE );
+
+            curl.on( 'data', function() {
+
+                ++dataEventsCount;
+            });
+
+            curl.on( 'error', function( err ) {
+
+                this.close();
+                done( err );
+            });
+
+            curl.on( 'end', function( status, data, headers ) {
+
+                this.close();
+
+                dataEventsCount.should.be.equal( 0 );
+                data.should.be.equal( responseData );
+                headers.should.be.an.Array.and.have.property( 'length', 1 );
+                done();
+            });
+
+            curl.perform();
+        });
+
+        it( 'should parse headers natively when NATIVE_HEADER_PARSING is set', function( done ) {
+
+            var headerEventsCount = 0;
+
+            curl.enable( Curl.feature.NATIVE_HEADER_PARSING );
+
+            curl.on( 'header', function() {
+
+                ++headerEventsCount;
+            });
+
+            curl.on( 'error', function( err ) {
+
+                this.close();
+                done( err );
+            });
+
+            curl.on( 'end', function( status, data, headers ) {
+
+                this.close();
+
+                headerEventsCount.should.be.equal( 0 );
+                headers.should.be.an.Array.and.have.property( 'length', 1 );
+                headers[0].should.be.instanceOf( Curl.Headers );
+                headers[0].result.code.should.be.equal( status );
+                headers[0].get( 'content-length' ).should.be.equal( String( responseLength ) );
+                headers[0].get( 'CONTENT-LENGTH' ).should.be.equal( String( responseLength ) );
+                done();
+            });
+
+            curl.perform();
+        });
+
+        it( 'should deliver every chunk when BATCH_CALLBACKS is set', function( done ) {
+
+            var dataReceived = '';
+
+            curl.enable( Curl.feature.BATCH_CALLBACKS );
+
+            curl.on( 'data', function( chunk ) {
+
+                dataReceived += chunk.toString();
+            });
+
+            curl.on( 'error', function( err ) {
+
+                this.close();
+                done( err );
+            });
+
+            curl.on( 'end', function( status, data, headers ) {
+
+                this.close();
+
+                dataReceived.should.be.equal( responseData );
+                data.should.be.equal( responseData );
+                headers.should.be.an.Array.and.have.property( 'length', 1 );
+                done();
+            });
+
+            curl.perform();
+        });
+
     });
 
 });
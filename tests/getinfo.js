@@ -60,6 +60,50 @@ describe( 'Curl', function() {
 
         });
 
+        it ( 'should get many infos at once', function ( done ) {
+
+            curl.on( 'end', function( status ) {
+
+                var infos = curl.getInfos( [ 'RESPONSE_CODE', Curl.info.EFFECTIVE_URL, 'TOTAL_TIME' ] );
+
+                infos.should.have.length( 3 );
+                infos[0].should.be.equal( status );
+                infos[1].should.be.equal( curl.getInfo( 'EFFECTIVE_URL' ) );
+                infos[2].should.be.equal( curl.getInfo( 'TOTAL_TIME' ) );
+
+                done();
+            });
+
+            curl.perform();
+        });
+
+        it ( 'should fill the timings array when the request ends', function ( done ) {
+
+            var timings = new Float64Array( Curl.timing.COUNT );
+
+            curl.setTimings( timings );
+
+            curl.on( 'end', function( status ) {
+
+                timings[Curl.timing.RESPONSE_CODE].should.be.equal( status );
+                timings[Curl.timing.TOTAL_TIME].should.be.equal( curl.getInfo( 'TOTAL_TIME' ) );
+                timings[Curl.timing.SIZE_DOWNLOAD].should.be.equal( 'Hello World!'.length );
+
+                done();
+            });
+
+            curl.perform();
+        });
+
+        it ( 'should not accept a small timings array', function () {
+
+            (function() {
+
+                curl.setTimings( new Float64Array( 2 ) );
+
+            }).should.throw();
+        });
+
     });
 
 });
@@ -97,6 +97,67 @@ describe( 'Curl', function() {
 
         });
 
+        it ( 'should upload a Buffer as a file', function ( done ) {
+
+            curl.setOpt( 'HTTPPOST', [{
+                name     : 'file',
+                contents : buff,
+                filename : 'memory.png',
+                type     : 'image/png'
+            }]);
+
+            curl.on( 'end', function( status, data ) {
+
+                status.should.be.equal( 200 );
+
+                data = JSON.parse( data );
+
+                data.size.should.be.equal( size );
+                data.name.should.be.equal( 'memory.png' );
+                data.type.should.be.equal( 'image/png' );
+
+                done();
+            });
+
+            curl.on( 'error', function( err ) {
+
+                done( err );
+            });
+
+            curl.perform();
+
+        });
+
+        it ( 'should upload an empty Buffer', function ( done ) {
+
+            curl.setOpt( 'HTTPPOST', [{
+                name     : 'file',
+                contents : new Buffer( 0 ),
+                filename : 'empty.txt',
+                type     : 'text/plain'
+            }]);
+
+            curl.on( 'end', function( status, data ) {
+
+                status.should.be.equal( 200 );
+
+                data = JSON.parse( data );
+
+                data.size.should.be.equal( 0 );
+                data.name.should.be.equal( 'empty.txt' );
+
+                done();
+            });
+
+            curl.on( 'error', function( err ) {
+
+                done( err );
+            });
+
+            curl.perform();
+
+        });
+
     });
 
 });
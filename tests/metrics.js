@@ -0,0 +1,112 @@
+var serverObj = require( './server' ),
+    should = require( 'should' ),
+    Curl   = require( '../lib/Curl' );
+
+var server = serverObj.server,
+    app    = serverObj.app;
+
+describe( 'Curl', function() {
+
+    var url;
+
+    before( function( done ) {
+
+        app.get( '/metrics', function( req, res ) {
+
+            res.send( 'Hello World!' );
+        });
+
+        server.listen( serverObj.port, serverObj.host, function() {
+
+            url = server.address().address + ':' + server.address().port + '/metrics';
+            done();
+        });
+    });
+
+    after( function() {
+
+        Curl.Metrics.enable( false ).reset();
+
+        app._router.stack.pop();
+        server.close();
+    });
+
+    describe( 'Metrics', function() {
+
+        it( 'should record the completed transfers with their label', function( done ) {
+
+            var curl = new Curl();
+
+            Curl.Metrics.reset().enable();
+
+            curl.setOpt( 'URL', url );
+            curl.setMetricsLabel( 'test' );
+
+            curl.on( 'end', function() {
+
+                var text = Curl.Metrics.toPrometheus(),
+                    total = curl.getInfo( 'TOTAL_TIME' );
+
+                curl.close();
+
+                text.should.containEql( '# TYPE curl_phase_duration_seconds histogram' );
+                text.should.containEql( 'curl_phase_duration_seconds_count{phase="total",label="test"} 1' );
+                text.should.containEql( 'curl_phase_duration_seconds_count{phase="ttfb",label="test"} 1' );
+
+                Curl.Metrics.quantile( 'total', 0.5, 'test' ).should.be.within( total, total * 1.07 + 0.000002 );
+                Curl.Metrics.quantile( 'total', 0.5 ).should.be.equal( 0 );
+
+                Curl.Metrics.getSnapshot().readUInt32LE( 0 ).should.be.equal( 1 );
+
+                done();
+            });
+
+            curl.on( 'error', function( err ) {
+
+                curl.close();
+                done( err );
+            });
+
+            curl.perform();
+        });
+
+        it( 'should escape the labels on the Prometheus text', function( done ) {
+
+            var curl  = new Curl(),
+                label = new Array( 600 ).join( 'a' ) + '"\\\n';
+
+            Curl.Metrics.reset().enable();
+
+            curl.setOpt( 'URL', url );
+            curl.setMetricsLabel( label );
+
+            curl.on( 'end', function() {
+
+                var text = Curl.Metrics.toPrometheus();
+
+                curl.close();
+
+                text.should.containEql( 'curl_phase_duration_seconds_count{phase="total",label="' + new Array( 600 ).join( 'a' ) + '\\"\\\\\\n"} 1\n' );
+
+                done();
+            });
+
+            curl.on( 'error', function( err ) {
+
+                curl.close();
+                done( err );
+            });
+
+            curl.perform();
+        });
+
+        it( 'should not accept an unknown phase', function() {
+
+            (function() {
+
+                Curl.Metrics.quantile( 'download', 0.5 );
+
+            }).should.throw();
+        });
+    });
+});
@@ -0,0 +1,556 @@
+var serverObj = require( './server' ),
+    should = require( 'should' ),
+    spawn  = require( 'child_process' ).spawn,
+    path   = require( 'path' ),
+    Curl   = require( '../lib/Curl' );
+
+var server = serverObj.server,
+    app    = serverObj.app;
+
+describe( 'Curl.Multi', function() {
+
+    var url;
+
+    before( function( done ) {
+
+        app.get( '/', function( req, res ) {
+
+            res.send( 'Hi' );
+        });
+
+        server.listen( serverObj.port, serverObj.host, function() {
+
+            url = server.address().address + ':' + server.address().port;
+            done();
+        });
+    });
+
+    after( function() {
+
+        app._router.stack.pop();
+        server.close();
+    });
+
+    it( 'should use the default multi when none is set', function() {
+
+        var curl = new Curl();
+
+        curl.getMulti().should.be.equal( Curl.Multi.getDefault() );
+
+        curl.close();
+    });
+
+    it( 'should not allow closing the default multi', function() {
+
+        (function() {
+            Curl.Multi.getDefault().close();
+        }).should.throw();
+    });
+
+    it( 'should accept options by name and by id', function() {
+
+        var multi = new Curl.Multi();
+
+        multi.setOpt( 'MAXCONNECTS', 2 ).should.be.equal( 0 );
+        multi.setOpt( Curl.Multi.option.PIPELINING, Curl.Multi.pipe.NOTHING ).should.be.equal( 0 );
+
+        (function() {
+            multi.setOpt( 'NOT_AN_OPTION', 1 );
+        }).should.throw();
+
+        multi.close();
+    });
+
+    it( 'should run requests on its own multi', function( done ) {
+
+        var multi = new Curl.Multi(),
+            curl  = new Curl();
+
+        curl.setMulti( multi );
+        curl.setOpt( 'URL', url );
+
+        curl.on( 'end', function( status, body ) {
+
+            status.should.be.equal( 200 );
+            body.should.be.equal( 'Hi' );
+
+            multi.getCount().should.be.equal( 0 );
+
+            this.close();
+            multi.close();
+
+            done();
+        });
+
+        curl.on( 'error', function( err ) {
+
+            this.close();
+            multi.close();
+
+            done( err );
+        });
+
+        curl.perform();
+
+        multi.getCount().should.be.equal( 1 );
+        Curl.Multi.getDefault().getCount().should.be.equal( 0 );
+
+        (function() {
+            multi.close();
+        }).should.throw();
+    });
+
+    it( 'should reuse the sockets of closed connections', function( done ) {
+
+        var multi = new Curl.Multi(),
+            curl  = new Curl(),
+            before = Curl.getStats(),
+            requests = 0;
+
+        curl.setMulti( multi );
+        curl.setOpt( 'URL', url );
+        curl.setOpt( 'FORBID_REUSE', true );
+
+        curl.on( 'end', function( status, body ) {
+
+            body.should.be.equal( 'Hi' );
+
+            if ( ++requests < 5 )
+                return this.perform();
+
+            Curl.getStats().activeSockets.should.not.be.above( before.activeSockets );
+
+            this.close();
+            multi.close();
+
+            done();
+        });
+
+        curl.on( 'error', function( err ) {
+
+            this.close();
+            multi.close();
+
+            done( err );
+        });
+
+        curl.perform();
+    });
+
+    it( 'should limit the requests running against a host', function( done ) {
+
+        var multi = new Curl.Multi(),
+            finished = [],
+            total = 4,
+            stats, i;
+
+        multi.setScheduler( { maxPerHost : 1 } );
+
+        function onEnd( status, body ) {
+
+            body.should.be.equal( 'Hi' );
+
+            multi.getSchedulerStats().running.should.not.be.above( 1 );
+
+            finished.push( this._index );
+
+            this.close();
+
+            if ( finished.length === total ) {
+
+                //in the order they were performed
+                finished.should.be.eql( [ 0, 1, 2, 3 ] );
+
+                stats = multi.getSchedulerStats();
+
+                stats.queued.should.be.equal( 0 );
+                stats.running.should.be.equal( 0 );
+                stats.started.should.be.equal( total );
+
+                multi.close();
+                done();
+            }
+        }
+
+        function onError( err ) {
+
+            this.close();
+            done( err );
+        }
+
+        for ( i = 0; i < total; i++ ) {
+
+            var curl = new Curl();
+
+            curl._index = i;
+            curl.setMulti( multi );
+            curl.setOpt( 'URL', url );
+            curl.on( 'end', onEnd );
+            curl.on( 'error', onError );
+            curl.perform();
+        }
+
+        stats = multi.getSchedulerStats();
+
+        stats.running.should.be.equal( 1 );
+        stats.queued.should.be.equal( total - 1 );
+        multi.getCount().should.be.equal( total );
+    });
+
+    it( 'should start the requests waiting by priority', function( done ) {
+
+        var multi = new Curl.Multi(),
+            finished = [],
+            priorities = [ Curl.Multi.priority.NORMAL, Curl.Multi.priority.LOW, Curl.Multi.priority.HIGH ],
+            i;
+
+        multi.setScheduler( { maxTotal : 1 } );
+
+        function onEnd() {
+
+            finished.push( this._index );
+
+            this.close();
+
+            if ( finished.length === priorities.length ) {
+
+                //the first one was started right away
+                finished.should.be.eql( [ 0, 2, 1 ] );
+
+                multi.close();
+                done();
+            }
+        }
+
+        function onError( err ) {
+
+            this.close();
+            done( err );
+        }
+
+        for ( i = 0; i < priorities.length; i++ ) {
+
+            var curl = new Curl();
+
+            curl._index = i;
+            curl.setMulti( multi );
+            curl.setPriority( priorities[i] );
+            curl.setOpt( 'URL', url );
+            curl.on( 'end', onEnd );
+            curl.on( 'error', onError );
+            curl.perform();
+        }
+
+        multi.getSchedulerStats().queuedByPriority.should.be.eql( [ 1, 0, 1 ] );
+    });
+
+    it( 'should adapt the limit of each host to its latency', function( done ) {
+
+        var multi = new Curl.Multi(),
+            curl  = new Curl(),
+            requests = 0;
+
+        multi.setScheduler( { adaptive : { initialLimit : 2, maxLimit : 8 } } );
+
+        curl.setMulti( multi );
+        curl.setOpt( 'URL', url );
+
+        curl.on( 'end', function() {
+
+            var limits, hostKey;
+
+            if ( ++requests < 5 )
+                return this.perform();
+
+            limits = multi.getSchedulerStats().limits;
+            hostKey = Object.keys( limits )[0];
+
+            Object.keys( limits ).length.should.be.equal( 1 );
+            limits[hostKey].samples.should.be.above( 0 );
+            limits[hostKey].limit.should.be.within( 1, 8 );
+            limits[hostKey].baselineRttMs.should.be.above( 0 );
+
+            //the idle hosts are only kept for the adaptive limit
+            multi.setScheduler( null );
+            multi.getSchedulerStats().hosts.should.be.equal( 0 );
+
+            this.close();
+            multi.close();
+
+            done();
+        });
+
+        curl.on( 'error', function( err ) {
+
+            this.close();
+            multi.close();
+
+            done( err );
+        });
+
+        curl.perform();
+    });
+
+    it( 'should deliver the finished requests within the completion budget', function( done ) {
+
+        //the workers keep finishing the requests while the main thread is busy, so they are waiting together
+        var multi = new Curl.Multi( { threads : 1 } ),
+            before = Curl.getStats(),
+            finished = 0,
+            total = 4,
+            i;
+
+        multi.setCompletionBudget( { maxCompletions : 1 } );
+
+        function onEnd( status, body ) {
+
+            var stats, until;
+
+            body.should.be.equal( 'Hi' );
+
+            this.close();
+
+            if ( ++finished === 1 ) {
+
+                until = Date.now() + 200;
+
+                while ( Date.now() < until );
+            }
+
+            if ( finished === total ) {
+
+                stats = Curl.getStats();
+
+                stats.completionTimeNs.should.be.above( before.completionTimeNs );
+                stats.maxCompletionTimeNs.should.be.above( 0 );
+                stats.deferredCompletions.should.be.above( before.deferredCompletions );
+
+                multi.close();
+                done();
+            }
+        }
+
+        function onError( err ) {
+
+            this.close();
+            done( err );
+        }
+
+        for ( i = 0; i < total; i++ ) {
+
+            var curl = new Curl();
+
+            curl.setMulti( multi );
+            curl.setOpt( 'URL', url );
+            curl.on( 'end', onEnd );
+            curl.on( 'error', onError );
+            curl.perform();
+        }
+    });
+
+    it( 'should run requests on worker threads', function( done ) {
+
+        var multi = new Curl.Multi( { threads : 2 } ),
+            finished = 0,
+            total = 4,
+            i;
+
+        function onEnd( status, body ) {
+
+            status.should.be.equal( 200 );
+            body.should.be.equal( 'Hi' );
+
+            this.close();
+
+            if ( ++finished === total ) {
+
+                multi.getCount().should.be.equal( 0 );
+                multi.close();
+                done();
+            }
+        }
+
+        function onError( err ) {
+
+            this.close();
+            done( err );
+        }
+
+        for ( i = 0; i < total; i++ ) {
+
+            var curl = new Curl();
+
+            curl.setMulti( multi );
+            curl.setOpt( 'URL', url );
+            curl.on( 'end', onEnd );
+            curl.on( 'error', onError );
+            curl.perform();
+        }
+
+        multi.getCount().should.be.equal( total );
+    });
+
+    it( 'should not allow progress callbacks on a threaded multi', function() {
+
+        var multi = new Curl.Multi( { threads : 1 } ),
+            curl  = new Curl();
+
+        curl.setMulti( multi );
+        curl.setOpt( 'URL', url );
+        curl.setOpt( 'NOPROGRESS', false );
+        curl.setProgressCallback( function() { return 0; } );
+
+        (function() {
+            curl.perform();
+        }).should.throw();
+
+        curl.close();
+        multi.close();
+    });
+
+    it( 'should not allow performing on a closed multi', function() {
+
+        var multi = new Curl.Multi(),
+            curl  = new Curl();
+
+        curl.setMulti( multi );
+        multi.close();
+
+        (function() {
+            curl.perform();
+        }).should.throw();
+
+        curl.close();
+    });
+
+    it( 'should run a timeout of 0 on the next loop iteration, without a timer', function( done ) {
+
+        var multi = new Curl.Multi(),
+            curl  = new Curl(),
+            firings = Curl.getStats().timerFirings,
+            isFired = false;
+
+        curl.setMulti( multi );
+        curl.setOpt( 'URL', url );
+
+        curl.on( 'end', function() {
+
+            this.close();
+            multi.close();
+
+            isFired.should.be.true;
+
+            done();
+        });
+
+        curl.on( 'error', function( err ) {
+
+            this.close();
+            multi.close();
+
+            done( err );
+        });
+
+        //adding the handle asks for a timeout of 0, it runs before the immediates of the same iteration
+        curl.perform();
+
+        setImmediate( function() {
+
+            isFired = Curl.getStats().timerFirings > firings;
+        });
+    });
+
+    it( 'should run a timeout of 0 on the worker right away', function( done ) {
+
+        var multi = new Curl.Multi( { threads : 1 } ),
+            curl  = new Curl(),
+            elapsed = [],
+            total = 5;
+
+        //the main thread is not needed by the worker, it waits for the first firing after the handle is added
+        function perform() {
+
+            var firings = Curl.getStats().timerFirings,
+                start = process.hrtime(),
+                diff;
+
+            curl.perform();
+
+            do {
+                diff = process.hrtime( start );
+            } while ( Curl.getStats().timerFirings === firings && diff[0] < 1 );
+
+            elapsed.push( diff[0] * 1e9 + diff[1] );
+        }
+
+        curl.setMulti( multi );
+        curl.setOpt( 'URL', url );
+
+        curl.on( 'end', function() {
+
+            if ( elapsed.length < total )
+                return perform();
+
+            this.close();
+            multi.close();
+
+            //the old timer waited at least 1ms, the fastest of them shows the floor is gone
+            Math.min.apply( Math, elapsed ).should.be.below( 1e6 );
+
+            done();
+        });
+
+        curl.on( 'error', function( err ) {
+
+            this.close();
+            multi.close();
+
+            done( err );
+        });
+
+        perform();
+    });
+
+    [ {}, { threads : 1 } ].forEach( function( options ) {
+
+        it( 'should let the process exit when it has no transfers left' + ( options.threads ? ', with threads' : '' ), function( done ) {
+
+            //the multi and the connection it keeps are not closed, the timer and the idle handles must not keep the loop alive
+            var script = [
+                    'var Curl = require( ' + JSON.stringify( path.join( __dirname, '..', 'lib', 'Curl' ) ) + ' ),',
+                    '    multi = new Curl.Multi( ' + JSON.stringify( options ) + ' ),',
+                    '    curl = new Curl();',
+                    'curl.setMulti( multi );',
+                    'curl.setOpt( "URL", ' + JSON.stringify( url ) + ' );',
+                    'curl.on( "end", function() { this.close(); } );',
+                    'curl.on( "error", function() { process.exit( 2 ); } );',
+                    'curl.perform();'
+                ].join( '\n' ),
+                child = spawn( process.execPath, [ '-e', script ], { stdio : 'inherit' } ),
+                timeout;
+
+            //starting node takes a while
+            this.timeout( 10000 );
+
+            timeout = setTimeout( function() {
+
+                child.kill();
+                done( new Error( 'The process did not exit.' ) );
+
+            }, 8000 );
+
+            child.on( 'exit', function( code ) {
+
+                //killed by the timeout
+                if ( code === null )
+                    return;
+
+                clearTimeout( timeout );
+
+                code.should.be.equal( 0 );
+
+                done();
+            });
+        });
+    });
+});
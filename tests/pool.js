@@ -0,0 +1,132 @@
+var serverObj = require( './server' ),
+    should = require( 'should' ),
+    Curl   = require( '../lib/Curl' );
+
+var server = serverObj.server,
+    app    = serverObj.app;
+
+describe( 'Curl.Pool', function() {
+
+    var url;
+
+    before( function( done ) {
+
+        app.get( '/', function( req, res ) {
+
+            res.send( 'Hi' );
+        });
+
+        server.listen( serverObj.port, serverObj.host, function() {
+
+            url = 'http://' + server.address().address + ':' + server.address().port + '/';
+            done();
+        });
+    });
+
+    after( function() {
+
+        app._router.stack.pop();
+        server.close();
+    });
+
+    it( 'should reuse released instances', function( done ) {
+
+        var pool = new Curl.Pool( { options : { URL : url } } ),
+            curl = pool.lease();
+
+        curl.on( 'end', function( status, body ) {
+
+            var stats, reused;
+
+            body.should.be.equal( 'Hi' );
+
+            pool.release( this ).should.be.true;
+
+            reused = pool.lease();
+            reused.should.be.equal( curl );
+
+            stats = pool.getStats();
+
+            stats.leases.should.be.equal( 2 );
+            stats.releases.should.be.equal( 1 );
+            stats.reuses.should.be.equal( 2 );
+            stats.leased.should.be.equal( 1 );
+
+            //baseline options are set again after the reset
+            reused.on( 'end', function( status, body ) {
+
+                body.should.be.equal( 'Hi' );
+
+                pool.release( this );
+                pool.close();
+
+                done();
+            });
+
+            reused.on( 'error', done );
+
+            reused.perform();
+        });
+
+        curl.on( 'error', done );
+
+        curl.perform();
+    });
+
+    it( 'should respect the max amount of instances', function() {
+
+        var pool = new Curl.Pool( { max : 2 } ),
+            first = pool.lease(),
+            second = pool.lease();
+
+        ( pool.lease() === null ).should.be.true;
+
+        pool.release( first );
+        pool.lease().should.be.equal( first );
+
+        pool.release( first );
+        pool.release( second );
+        pool.close();
+
+        pool.getStats().idle.should.be.equal( 0 );
+    });
+
+    it( 'should not accept instances from somewhere else', function() {
+
+        var pool = new Curl.Pool(),
+            curl = new Curl();
+
+        (function() {
+            pool.release( curl );
+        }).should.throw();
+
+        curl.close();
+        pool.close();
+    });
+
+    it( 'should validate the baseline options', function() {
+
+        (function() {
+            new Curl.Pool( { options : { NOT_AN_OPTION : 1 } } );
+        }).should.throw();
+    });
+
+    it( 'should close idle instances after idleTimeout', function( done ) {
+
+        var pool = new Curl.Pool( { idleTimeout : 10 } );
+
+        pool.release( pool.lease() );
+
+        setTimeout( function() {
+
+            var stats = pool.getStats();
+
+            stats.idle.should.be.equal( 0 );
+            stats.evictions.should.be.equal( 1 );
+
+            pool.close();
+            done();
+
+        }, 50 );
+    });
+});
@@ -42,11 +42,27 @@ describe( 'Curl', function() {
 
                 res.send( JSON.stringify( req.body ) );
             });
+
+            app.post( '/binary', function( req, res ) {
+
+                var chunks = [];
+
+                req.on( 'data', function( chunk ) {
+
+                    chunks.push( chunk );
+                });
+
+                req.on( 'end', function() {
+
+                    res.send( Buffer.concat( chunks ).toString( 'hex' ) );
+                });
+            });
         });
 
         after(function() {
 
             app._router.stack.pop();
+            app._router.stack.pop();
         });
 
         it ( 'should post the correct data', function ( done ) {
@@ -70,5 +86,32 @@ describe( 'Curl', function() {
 
             curl.perform();
         });
+
+        it ( 'should post a Buffer without changing it', function ( done ) {
+
+            var body = new Buffer( [ 0x00, 0xff, 0xc3, 0x28, 0x0a, 0x00, 0x80 ] );
+
+            curl.setOpt( 'URL', server.address().address + ':' + server.address().port + '/binary' );
+            curl.setOpt( 'HTTPHEADER', [ 'Content-Type: application/octet-stream' ] );
+            curl.setOpt( 'POSTFIELDS', body );
+
+            curl.on( 'end', function( status, data ) {
+
+                this.close();
+
+                status.should.be.equal( 200 );
+                data.should.be.equal( body.toString( 'hex' ) );
+
+                done();
+            });
+
+            curl.on( 'error', function( err ) {
+
+                this.close();
+                done( err );
+            });
+
+            curl.perform();
+        });
     });
 });
@@ -0,0 +1,116 @@
+var serverObj = require( './server' ),
+    should = require( 'should' ),
+    Curl   = require( '../lib/Curl' );
+
+var server = serverObj.server,
+    app    = serverObj.app;
+
+describe( 'Curl', function() {
+
+    var url,
+        body = new Buffer( 1024 * 1024 );
+
+    body.fill( 'p' );
+
+    before( function( done ) {
+
+        app.get( '/progress', function( req, res ) {
+
+            res.send( body );
+        });
+
+        server.listen( serverObj.port, serverObj.host, function() {
+
+            url = server.address().address + ':' + server.address().port + '/progress';
+            done();
+        });
+    });
+
+    after( function() {
+
+        app._router.stack.pop();
+        server.close();
+    });
+
+    describe( 'setProgressArray()', function() {
+
+        it( 'should write the progress on the slot of the handle', function( done ) {
+
+            var curl = new Curl(),
+                progress = new Float64Array( 8 );
+
+            curl.setOpt( 'URL', url );
+            curl.setProgressArray( progress, 1 );
+
+            curl.on( 'end', function() {
+
+                curl.close();
+
+                progress[0].should.be.equal( 0 );
+                progress[4].should.be.equal( body.length );
+                progress[5].should.be.equal( body.length );
+
+                done();
+            });
+
+            curl.on( 'error', function( err ) {
+
+                curl.close();
+                done( err );
+            });
+
+            curl.perform();
+        });
+
+        it( 'should not accept a slot outside the array', function() {
+
+            var curl = new Curl();
+
+            (function() {
+
+                curl.setProgressArray( new Float64Array( 4 ), 1 );
+
+            }).should.throw();
+
+            curl.close();
+        });
+    });
+
+    describe( 'setProgressCallback()', function() {
+
+        it( 'should call the callback only after the bytes given', function( done ) {
+
+            var curl = new Curl(),
+                calls = [];
+
+            curl.setOpt( 'URL', url );
+            curl.setOpt( 'NOPROGRESS', false );
+
+            curl.setProgressCallback( function( dltotal, dlnow ) {
+
+                calls.push( dlnow );
+                return 0;
+
+            }, { bytes : 512 * 1024 } );
+
+            curl.on( 'end', function() {
+
+                curl.close();
+
+                //the first update, after half of the body, and when it's complete
+                calls.length.should.be.within( 1, 3 );
+                calls[calls.length - 1].should.be.equal( body.length );
+
+                done();
+            });
+
+            curl.on( 'error', function( err ) {
+
+                curl.close();
+                done( err );
+            });
+
+            curl.perform();
+        });
+    });
+});
@@ -26,6 +26,20 @@ describe( 'Curl', function() {
             app._router.stack.pop();
         });
 
+        it ( 'should not reset a running curl handler', function () {
+
+            var running = new Curl();
+
+            running.setOpt( 'URL', 'localhost:1' );
+            running.perform();
+
+            (function() {
+                running.reset();
+            }).should.throw( /running/ );
+
+            running.close();
+        });
+
         it ( 'should reset the curl handler', function ( done ) {
 
             server.listen( 3000, 'localhost', function() {
@@ -38,6 +38,25 @@ describe( 'Curl', function() {
 
         });
 
+        it( 'should accept the option name in any case, and the option id', function() {
+
+            curl.setOpt( 'url', 'http://localhost/' );
+            curl.setOpt( 'FollowLocation', true );
+            curl.setOpt( Curl.option.MAXREDIRS, 5 );
+        });
+
+        it( 'should not accept unknown options', function() {
+
+            var optionsToTest = [ 'NOT_AN_OPTION', '', 0, -1, Curl.option.URL + 1e6, {} ];
+
+            optionsToTest.forEach( function( option ) {
+
+                (function() {
+                    curl.setOpt( option, 1 );
+                }).should.throw();
+            });
+        });
+
         describe( 'HTTPPOST', function() {
 
             it ( 'should not accept invalid arrays', function( done ) {
@@ -100,4 +119,67 @@ describe( 'Curl', function() {
 
     });
 
+    describe( 'setOpts()', function() {
+
+        it( 'should set options given as an object', function() {
+
+            curl.setOpts({
+                URL : 'http://localhost/',
+                HTTPHEADER : [ 'X-Test: 1' ],
+                timeout : 10
+            }).should.be.equal( 3 );
+        });
+
+        it( 'should set options given as pairs', function() {
+
+            curl.setOpts([
+                [ Curl.option.URL, 'http://localhost/' ],
+                [ 'FOLLOWLOCATION', true ]
+            ]).should.be.equal( 2 );
+        });
+
+        it( 'should report the option that failed', function() {
+
+            var error = null;
+
+            try {
+
+                curl.setOpts({
+                    POSTFIELDS : 'after',
+                    URL : 0
+                });
+
+            } catch ( err ) {
+
+                error = err;
+            }
+
+            error.should.be.instanceOf( Error ).and.have.property( 'option', 'URL' );
+
+            (function() {
+                curl.setOpts([ [ 'NOT_AN_OPTION', 1 ] ]);
+            }).should.throw( /Unknown option/ );
+        });
+
+        it( 'should report the code of the option refused by libcurl', function() {
+
+            var error = null;
+
+            try {
+
+                curl.setOpts({
+                    URL : 'http://localhost/',
+                    SSLVERSION : 100
+                });
+
+            } catch ( err ) {
+
+                error = err;
+            }
+
+            error.should.be.instanceOf( Error ).and.have.property( 'option', 'SSLVERSION' );
+            error.should.have.property( 'code' ).and.be.above( 0 );
+        });
+    });
+
 });
@@ -0,0 +1,105 @@
+var serverObj = require( './server' ),
+    should = require( 'should' ),
+    Curl   = require( '../lib/Curl' );
+
+var server = serverObj.server,
+    app    = serverObj.app;
+
+describe( 'Curl.Share', function() {
+
+    var url;
+
+    before( function( done ) {
+
+        app.get( '/', function( req, res ) {
+
+            res.send( 'Hi' );
+        });
+
+        server.listen( serverObj.port, serverObj.host, function() {
+
+            url = server.address().address + ':' + server.address().port;
+            done();
+        });
+    });
+
+    after( function() {
+
+        app._router.stack.pop();
+        server.close();
+    });
+
+    it( 'should only accept a Share instance or null', function() {
+
+        var curl = new Curl();
+
+        (function() {
+            curl.setOpt( 'SHARE', {} );
+        }).should.throw();
+
+        curl.setOpt( 'SHARE', null ).should.be.equal( 0 );
+
+        curl.close();
+    });
+
+    it( 'should share data between requests', function( done ) {
+
+        var share = new Curl.Share(),
+            finished = 0,
+            total = 2,
+            i;
+
+        share.setOpt( 'SHARE', Curl.Share.lock.DNS );
+        share.setOpt( Curl.Share.option.SHARE, Curl.Share.lock.SSL_SESSION );
+
+        function onEnd( status, body ) {
+
+            status.should.be.equal( 200 );
+            body.should.be.equal( 'Hi' );
+
+            //cannot be closed while in use
+            if ( finished === 0 ) {
+
+                (function() {
+                    share.close();
+                }).should.throw();
+            }
+
+            this.close();
+
+            if ( ++finished === total ) {
+
+                share.close();
+                done();
+            }
+        }
+
+        function onError( err ) {
+
+            this.close();
+            done( err );
+        }
+
+        for ( i = 0; i < total; i++ ) {
+
+            var curl = new Curl();
+
+            curl.setOpt( 'URL', url );
+            curl.setOpt( 'SHARE', share );
+            curl.on( 'end', onEnd );
+            curl.on( 'error', onError );
+            curl.perform();
+        }
+    });
+
+    it( 'should not accept unknown options', function() {
+
+        var share = new Curl.Share();
+
+        (function() {
+            share.setOpt( 'NOT_AN_OPTION', Curl.Share.lock.DNS );
+        }).should.throw();
+
+        share.close();
+    });
+});
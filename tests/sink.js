@@ -0,0 +1,154 @@
+var serverObj = require( './server' ),
+    should = require( 'should' ),
+    fs     = require( 'fs' ),
+    os     = require( 'os' ),
+    path   = require( 'path' ),
+    Curl   = require( '../lib/Curl' );
+
+var server = serverObj.server,
+    app    = serverObj.app;
+
+describe( 'Curl', function() {
+
+    var url,
+        body = new Buffer( 100 * 1024 + 7 ),
+        largeBody = new Buffer( 4 * 1024 * 1024 + 3 ),
+        file = path.join( os.tmpdir(), 'node-libcurl-sink-' + process.pid );
+
+    body.fill( 'b' );
+
+    for ( var i = 0; i < largeBody.length; i++ )
+        largeBody[i] = i % 251;
+
+    before( function( done ) {
+
+        app.get( '/sink', function( req, res ) {
+
+            res.send( body );
+        });
+
+        app.get( '/sink-large', function( req, res ) {
+
+            res.send( largeBody );
+        });
+
+        server.listen( serverObj.port, serverObj.host, function() {
+
+            url = server.address().address + ':' + server.address().port + '/sink';
+            done();
+        });
+    });
+
+    after( function() {
+
+        app._router.stack.pop();
+        app._router.stack.pop();
+        server.close();
+
+        if ( fs.existsSync( file ) )
+            fs.unlinkSync( file );
+    });
+
+    describe( 'setSink()', function() {
+
+        it( 'should write the body to the file', function( done ) {
+
+            var curl = new Curl(),
+                isDataEmitted = false;
+
+            curl.setOpt( 'URL', url );
+            curl.setSink( { path : file, bufferSize : 8192, preallocate : true } );
+
+            curl.on( 'data', function() {
+
+                isDataEmitted = true;
+            });
+
+            curl.on( 'end', function( status, bytes ) {
+
+                curl.close();
+
+                status.should.be.equal( 200 );
+                bytes.should.be.equal( body.length );
+                isDataEmitted.should.be.false;
+
+                fs.readFileSync( file ).toString().should.be.equal( body.toString() );
+
+                done();
+            });
+
+            curl.on( 'error', function( err ) {
+
+                curl.close();
+                done( err );
+            });
+
+            curl.perform();
+        });
+
+        it( 'should keep the order of the data while the writes are running', function( done ) {
+
+            var curl = new Curl();
+
+            //smallest buffer, so the transfer is paused often waiting for the writes
+            curl.setOpt( 'URL', url + '-large' );
+            curl.setSink( { path : file, bufferSize : 4096 } );
+
+            curl.on( 'end', function( status, bytes ) {
+
+                curl.close();
+
+                bytes.should.be.equal( largeBody.length );
+
+                var written = fs.readFileSync( file );
+
+                written.length.should.be.equal( largeBody.length );
+                written.toString( 'hex' ).should.be.equal( largeBody.toString( 'hex' ) );
+
+                done();
+            });
+
+            curl.on( 'error', function( err ) {
+
+                curl.close();
+                done( err );
+            });
+
+            curl.perform();
+        });
+
+        it( 'should keep a given fd for the next requests', function( done ) {
+
+            var curl = new Curl(),
+                fd = fs.openSync( file, 'w' ),
+                requests = 0;
+
+            curl.setOpt( 'URL', url );
+            curl.setSink( { fd : fd } );
+
+            curl.on( 'end', function( status, bytes ) {
+
+                bytes.should.be.equal( body.length );
+
+                if ( ++requests < 2 )
+                    return curl.perform();
+
+                curl.close();
+                fs.closeSync( fd );
+
+                fs.statSync( file ).size.should.be.equal( body.length * 2 );
+
+                done();
+            });
+
+            curl.on( 'error', function( err ) {
+
+                curl.close();
+                fs.closeSync( fd );
+                done( err );
+            });
+
+            curl.perform();
+        });
+    });
+});
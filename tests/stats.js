@@ -0,0 +1,70 @@
+var serverObj = require( './server' ),
+    should = require( 'should' ),
+    Curl   = require( '../lib/Curl' );
+
+var server = serverObj.server,
+    app    = serverObj.app;
+
+describe( 'Curl', function() {
+
+    var url;
+
+    before( function( done ) {
+
+        app.get( '/stats', function( req, res ) {
+
+            res.send( 'Hello World!' );
+        });
+
+        server.listen( serverObj.port, serverObj.host, function() {
+
+            url = server.address().address + ':' + server.address().port + '/stats';
+            done();
+        });
+    });
+
+    after( function() {
+
+        app._router.stack.pop();
+        server.close();
+    });
+
+    describe( 'getStats()', function() {
+
+        it( 'should count the work done by a request', function( done ) {
+
+            var curl = new Curl(),
+                before = Curl.getStats();
+
+            curl.setOpt( 'URL', url );
+
+            curl.on( 'end', function() {
+
+                var stats = Curl.getStats();
+
+                curl.close();
+
+                stats.socketActions.should.be.above( before.socketActions );
+                stats.dataCallbacks.should.be.above( before.dataCallbacks );
+                stats.headerCallbacks.should.be.above( before.headerCallbacks );
+                stats.endCallbacks.should.be.equal( before.endCallbacks + 1 );
+                stats.bytesIn.should.be.above( before.bytesIn + 'Hello World!'.length );
+                stats.bytesOut.should.be.above( before.bytesOut );
+                stats.jsTimeNs.should.be.above( before.jsTimeNs );
+                stats.curlTimeNs.should.be.above( before.curlTimeNs );
+
+                done();
+            });
+
+            curl.on( 'error', function( err ) {
+
+                curl.close();
+                done( err );
+            });
+
+            curl.perform();
+
+            Curl.getStats().activeHandles.should.be.above( before.activeHandles );
+        });
+    });
+});
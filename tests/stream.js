@@ -0,0 +1,157 @@
+var serverObj = require( './server' ),
+    should = require( 'should' ),
+    Curl   = require( '../lib/Curl' );
+
+var server = serverObj.server,
+    app    = serverObj.app;
+
+describe( 'Curl', function() {
+
+    var url,
+        body = new Buffer( 4 * 1024 * 1024 );
+
+    body.fill( 's' );
+
+    before( function( done ) {
+
+        app.get( '/stream', function( req, res ) {
+
+            res.send( body );
+        });
+
+        server.listen( serverObj.port, serverObj.host, function() {
+
+            url = server.address().address + ':' + server.address().port + '/stream';
+            done();
+        });
+    });
+
+    after( function() {
+
+        app._router.stack.pop();
+        server.close();
+    });
+
+    describe( 'stream()', function() {
+
+        function consume( readable, cb ) {
+
+            var received = 0;
+
+            readable.on( 'data', function( chunk ) {
+
+                received += chunk.length;
+            });
+
+            readable.on( 'end', function() {
+
+                cb( received );
+            });
+        }
+
+        it( 'should pause receiving while the stream is not read', function( done ) {
+
+            var curl = new Curl(),
+                highWaterMark = 64 * 1024,
+                readable = curl.stream( { highWaterMark : highWaterMark } ),
+                accepted = 0;
+
+            curl.setOpt( 'URL', url );
+
+            curl.on( 'data', function( chunk ) {
+
+                accepted += chunk.length;
+            });
+
+            curl.on( 'end', function( status, data ) {
+
+                status.should.be.equal( 200 );
+                data.length.should.be.equal( 0 );
+            });
+
+            curl.on( 'error', function( err ) {
+
+                curl.close();
+                done( err );
+            });
+
+            curl.perform();
+
+            setTimeout( function() {
+
+                //at most one chunk (CURL_MAX_WRITE_SIZE) after the stream is full
+                accepted.should.not.be.above( highWaterMark + 16384 );
+
+                consume( readable, function( received ) {
+
+                    curl.close();
+
+                    received.should.be.equal( body.length );
+
+                    done();
+                });
+
+            }, 200 );
+        });
+
+        it( 'should deliver the whole body with BATCH_CALLBACKS', function( done ) {
+
+            var curl = new Curl(),
+                readable;
+
+            curl.enable( Curl.feature.BATCH_CALLBACKS );
+            readable = curl.stream( { highWaterMark : 16 * 1024 } );
+
+            curl.setOpt( 'URL', url );
+
+            curl.on( 'error', function( err ) {
+
+                curl.close();
+                done( err );
+            });
+
+            curl.perform();
+
+            consume( readable, function( received ) {
+
+                curl.close();
+
+                received.should.be.equal( body.length );
+
+                done();
+            });
+        });
+
+        it( 'should emit the errors on the stream', function( done ) {
+
+            var curl = new Curl(),
+                readable = curl.stream();
+
+            curl.setOpt( 'URL', '127.0.0.1:1' );
+
+            readable.on( 'error', function( err ) {
+
+                curl.close();
+
+                err.should.be.instanceof( Error );
+
+                done();
+            });
+
+            curl.perform();
+        });
+
+        it( 'should not be allowed with a sink', function() {
+
+            var curl = new Curl();
+
+            curl.setSink( { fd : 1 } );
+
+            (function() {
+                curl.stream();
+            }).should.throw();
+
+            curl.close();
+        });
+    });
+});
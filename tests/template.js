@@ -0,0 +1,196 @@
+var serverObj = require( './server' ),
+    should = require( 'should' ),
+    Curl   = require( '../lib/Curl' );
+
+var server = serverObj.server,
+    app    = serverObj.app;
+
+describe( 'Curl.Template', function() {
+
+    var url;
+
+    before( function( done ) {
+
+        app.get( '/template', function( req, res ) {
+
+            res.send( req.get( 'x-template' ) || '' );
+        });
+
+        app.put( '/template', function( req, res ) {
+
+            var body = '';
+
+            req.on( 'data', function( chunk ) {
+
+                body += chunk;
+            });
+
+            req.on( 'end', function() {
+
+                res.send( body );
+            });
+        });
+
+        server.listen( serverObj.port, serverObj.host, function() {
+
+            url = server.address().address + ':' + server.address().port + '/template';
+            done();
+        });
+    });
+
+    after( function() {
+
+        app._router.stack.pop();
+        server.close();
+    });
+
+    it( 'should only be created from a Curl instance', function() {
+
+        (function() {
+            new Curl.Template( {} );
+        }).should.throw();
+    });
+
+    it( 'should create instances with the template options', function( done ) {
+
+        var source = new Curl(),
+            template, curl;
+
+        source.setOpts({
+            URL : url,
+            HTTPHEADER : [ 'X-Template: yes' ]
+        });
+
+        template = new Curl.Template( source );
+
+        //the template storage must outlive the source
+        source.close();
+
+        curl = template.create();
+
+        curl.on( 'end', function( status, body ) {
+
+            this.close();
+            template.close();
+
+            status.should.be.equal( 200 );
+            body.should.be.equal( 'yes' );
+            done();
+        });
+
+        curl.on( 'error', function( err ) {
+
+            this.close();
+            template.close();
+            done( err );
+        });
+
+        curl.perform();
+    });
+
+    it( 'should not share the upload of the source', function( done ) {
+
+        var source = new Curl(),
+            template, curl;
+
+        source.setOpts({
+            URL : url,
+            UPLOAD : true
+        });
+
+        source.setUploadStream( new Buffer( 'source' ) );
+
+        template = new Curl.Template( source );
+
+        source.close();
+
+        //without its own upload the transfer is aborted, the one of the source is gone
+        curl = template.create();
+
+        curl.on( 'end', function() {
+
+            this.close();
+            template.close();
+            done( new Error( 'The upload of the source was used.' ) );
+        });
+
+        curl.on( 'error', function() {
+
+            this.close();
+
+            curl = template.create();
+            template.close();
+
+            curl.setUploadStream( new Buffer( 'instance' ) );
+
+            curl.on( 'end', function( status, body ) {
+
+                this.close();
+
+                body.should.be.equal( 'instance' );
+                done();
+            });
+
+            curl.on( 'error', function( err ) {
+
+                this.close();
+                done( err );
+            });
+
+            curl.perform();
+        });
+
+        curl.perform();
+    });
+
+    it( 'should keep the instances working after being closed', function( done ) {
+
+        var source = new Curl(),
+            template, curls = [],
+            finished = 0,
+            total = 3,
+            i;
+
+        source.setOpt( 'HTTPHEADER', [ 'X-Template: many' ] );
+        source.enable( Curl.feature.NO_HEADER_STORAGE );
+
+        template = new Curl.Template( source );
+
+        for ( i = 0; i < total; i++ )
+            curls.push( template.create() );
+
+        template.close();
+
+        (function() {
+            template.create();
+        }).should.throw();
+
+        curls.forEach( function( curl ) {
+
+            curl.features.should.be.equal( Curl.feature.NO_HEADER_STORAGE );
+
+            curl.setOpt( 'URL', url );
+
+            curl.on( 'end', function( status, body ) {
+
+                this.close();
+
+                body.should.be.equal( 'many' );
+
+                if ( ++finished === total ) {
+
+                    source.close();
+                    done();
+                }
+            });
+
+            curl.on( 'error', function( err ) {
+
+                this.close();
+                done( err );
+            });
+
+            curl.perform();
+        });
+    });
+});
@@ -0,0 +1,101 @@
+var serverObj = require( './server' ),
+    should = require( 'should' ),
+    Curl   = require( '../lib/Curl' );
+
+var server = serverObj.server,
+    app    = serverObj.app;
+
+describe( 'Curl', function() {
+
+    var url;
+
+    before( function( done ) {
+
+        app.get( '/trace', function( req, res ) {
+
+            res.send( 'Hello World!' );
+        });
+
+        server.listen( serverObj.port, serverObj.host, function() {
+
+            url = server.address().address + ':' + server.address().port + '/trace';
+            done();
+        });
+    });
+
+    after( function() {
+
+        app._router.stack.pop();
+        server.close();
+    });
+
+    describe( 'setTrace()', function() {
+
+        it( 'should record the debug events', function( done ) {
+
+            var curl = new Curl();
+
+            curl.setOpt( 'URL', url );
+            curl.setTrace( { events : 64, payloadSize : 5 } );
+
+            curl.on( 'end', function() {
+
+                var trace = curl.getTrace(),
+                    types = trace.events.map( function( event ) { return event.type; } ),
+                    headerOut = trace.events[types.indexOf( Curl.info.debug.HEADER_OUT )],
+                    dataIn = trace.events[types.indexOf( Curl.info.debug.DATA_IN )];
+
+                curl.close();
+
+                types.should.containEql( Curl.info.debug.TEXT );
+
+                headerOut.data.should.be.equal( 'GET /' );
+                headerOut.size.should.be.above( 5 );
+
+                Buffer.isBuffer( dataIn.data ).should.be.true;
+                dataIn.data.toString().should.be.equal( 'Hello' );
+
+                trace.events[0].time.should.not.be.above( trace.events[trace.events.length - 1].time );
+
+                curl.getTrace().events.should.have.length( 0 );
+
+                done();
+            });
+
+            curl.on( 'error', function( err ) {
+
+                curl.close();
+                done( err );
+            });
+
+            curl.perform();
+        });
+
+        it( 'should drop the oldest events and set them on errors', function( done ) {
+
+            var curl = new Curl();
+
+            //nothing listens there
+            curl.setOpt( 'URL', server.address().address + ':1' );
+            curl.setTrace( { events : 1 } );
+
+            curl.on( 'end', function() {
+
+                curl.close();
+                done( Error( 'Request should fail' ) );
+            });
+
+            curl.on( 'error', function( err ) {
+
+                curl.close();
+
+                err.trace.events.should.have.length( 1 );
+                err.trace.dropped.should.be.above( 0 );
+
+                done();
+            });
+
+            curl.perform();
+        });
+    });
+});
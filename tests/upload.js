@@ -0,0 +1,152 @@
+var serverObj = require( './server' ),
+    should = require( 'should' ),
+    stream = require( 'stream' ),
+    Curl   = require( '../lib/Curl' );
+
+var server = serverObj.server,
+    app    = serverObj.app;
+
+describe( 'Curl', function() {
+
+    var url;
+
+    before( function( done ) {
+
+        app.put( '/upload', function( req, res ) {
+
+            var received = 0;
+
+            req.on( 'data', function( chunk ) {
+
+                received += chunk.length;
+            });
+
+            req.on( 'end', function() {
+
+                res.send( String( received ) );
+            });
+        });
+
+        server.listen( serverObj.port, serverObj.host, function() {
+
+            url = server.address().address + ':' + server.address().port + '/upload';
+            done();
+        });
+    });
+
+    after( function() {
+
+        app._router.stack.pop();
+        server.close();
+    });
+
+    describe( 'setUploadStream()', function() {
+
+        function createSource( chunks, chunkSize ) {
+
+            var source = new stream.Readable(),
+                sent = 0;
+
+            source._read = function() {
+
+                var chunk;
+
+                if ( sent++ === chunks )
+                    return this.push( null );
+
+                chunk = new Buffer( chunkSize );
+                chunk.fill( 'a' );
+
+                this.push( chunk );
+            };
+
+            return source;
+        }
+
+        function upload( curl, done, check ) {
+
+            curl.setOpt( 'URL', url );
+            curl.setOpt( 'UPLOAD', true );
+            curl.setOpt( 'HTTPHEADER', [ 'Content-Type: application/octet-stream' ] );
+
+            curl.on( 'end', function( status, body ) {
+
+                this.close();
+
+                status.should.be.equal( 200 );
+                check( body );
+                done();
+            });
+
+            curl.on( 'error', function( err ) {
+
+                this.close();
+                done( err );
+            });
+
+            curl.perform();
+        }
+
+        it( 'should upload a Buffer', function( done ) {
+
+            var curl = new Curl(),
+                body = new Buffer( 100000 );
+
+            body.fill( 'b' );
+
+            curl.setOpt( 'INFILESIZE', body.length );
+            curl.setUploadStream( body );
+
+            upload( curl, done, function( received ) {
+
+                received.should.be.equal( String( body.length ) );
+            });
+        });
+
+        it( 'should upload a stream bigger than the high water mark', function( done ) {
+
+            var curl = new Curl(),
+                chunks = 256,
+                chunkSize = 16384;
+
+            curl.setUploadStream( createSource( chunks, chunkSize ), 65536 );
+
+            upload( curl, done, function( received ) {
+
+                received.should.be.equal( String( chunks * chunkSize ) );
+            });
+        });
+
+        it( 'should abort the request when the stream fails', function( done ) {
+
+            var curl = new Curl(),
+                source = new stream.Readable();
+
+            source._read = function() {
+
+                process.nextTick( function() {
+                    source.emit( 'error', new Error( 'Source failed' ) );
+                });
+            };
+
+            curl.setOpt( 'URL', url );
+            curl.setOpt( 'UPLOAD', true );
+            curl.setUploadStream( source );
+
+            curl.on( 'end', function() {
+
+                this.close();
+                done( new Error( 'Request with failed upload succeeded.' ) );
+            });
+
+            curl.on( 'error', function( err ) {
+
+                this.close();
+                err.should.be.instanceOf( Error );
+                done();
+            });
+
+            curl.perform();
+        });
+    });
+});
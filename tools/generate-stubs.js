@@ -32,7 +32,7 @@ var optionsToIgnore = [
     'ERRORBUFFER',
     'STDERR',
     'COPYPOSTFIELDS',
-    'SHARE', //Share interface is not implemented, and is probably not going to be.
+    'SHARE', //Implemented manually, it receives a Curl.Share instance.
     'SSH_KEYFUNCTION', 'SSH_KEYDATA',
     //Options that are probably going to be implemented, sometime, later.
     //FTP OPTIONS
@@ -94,13 +94,20 @@ currentDate = currentDate.getDate() + "/"
 var curlHeaderContent = fs.readFileSync( curlHeaderFile, 'utf8' ),
     jsFilesData = {};
 
-generateFiles( curlHeaderContent, 'curlOptionsInteger', /CINIT\((\w+).*LONG/g, 'OPT', 'option' );
-generateFiles( curlHeaderContent, 'curlOptionsString', /CINIT\((\w+).*OBJECT/g, 'OPT', 'option' );
-generateFiles( curlHeaderContent, 'curlOptionsFunction', /CINIT\((\w+).*FUNCTION/g, 'OPT', 'option' );
+//options and infos lookup tables, filled by generateFiles
+var registries = {
+    options : { entries : {}, numbers : {}, prefix : 'OPT' },
+    infos : { entries : {}, numbers : {}, prefix : 'INFO' }
+};
 
-generateFiles( curlHeaderContent, 'curlInfosInteger', /CURLINFO_(\w+).*LONG/g, 'INFO', 'info' );
-generateFiles( curlHeaderContent, 'curlInfosString', /CURLINFO_(\w+).*STRING/g, 'INFO', 'info' );
-generateFiles( curlHeaderContent, 'curlInfosDouble', /CURLINFO_(\w+).*DOUBLE/g, 'INFO', 'info' );
+generateFiles( curlHeaderContent, 'curlOptionsInteger', /CINIT\((\w+).*LONG/g, 'OPT', 'option', 'options', 'INTEGER' );
+generateFiles( curlHeaderContent, 'curlOptionsString', /CINIT\((\w+).*OBJECT/g, 'OPT', 'option', 'options', 'STRING' );
+generateFiles( curlHeaderContent, 'curlOptionsFunction', /CINIT\((\w+).*FUNCTION/g, 'OPT', 'option', 'options', 'FUNCTION' );
+generateFiles( curlHeaderContent, 'curlOptionsOfft', /CINIT\((\w+).*OFF_T/g, 'OPT', 'option', 'options', 'OFFT' );
+
+generateFiles( curlHeaderContent, 'curlInfosInteger', /CURLINFO_(\w+).*LONG/g, 'INFO', 'info', 'infos', 'INTEGER' );
+generateFiles( curlHeaderContent, 'curlInfosString', /CURLINFO_(\w+).*STRING/g, 'INFO', 'info', 'infos', 'STRING' );
+generateFiles( curlHeaderContent, 'curlInfosDouble', /CURLINFO_(\w+).*DOUBLE/g, 'INFO', 'info', 'infos', 'DOUBLE' );
 
 generateFiles( curlHeaderContent, 'curlProtocols', /CURLPROTO_(\w+)/g, 'PROTO', 'protocol' );
 generateFiles( curlHeaderContent, 'curlPause', /CURLPAUSE_(\w+)/g, 'PAUSE', 'pause' );
@@ -108,8 +115,9 @@ generateFiles( curlHeaderContent, 'curlAuth', /CURLAUTH_(\w+)/g, 'AUTH', 'auth'
 generateFiles( curlHeaderContent, 'curlHttp', /CURL_HTTP_((?!VERSION_LAST)(\w+)),/g, '_HTTP', 'http' );
 
 generateSingleJavascriptFileForEachType();
+generateRegistryFile( curlHeaderContent );
 
-function generateFiles( scope, fileName, pattern, prefix, jsObject ) {
+function generateFiles( scope, fileName, pattern, prefix, jsObject, registry, type ) {
 
     var matches = [],
         match;
@@ -135,6 +143,13 @@ function generateFiles( scope, fileName, pattern, prefix, jsObject ) {
     generateHeaderFile( fileName + '.h', prefix, matches );
     prepareDataForJavascriptFile( jsObject, matches );
 
+    if ( registry ) {
+
+        matches.forEach( function( item ) {
+            registries[registry].entries[item] = type;
+        });
+    }
+
 }
 
 function generateHeaderFile( fileName, prefix, regexMatches ) {
@@ -189,3 +204,171 @@ function generateSingleJavascriptFileForEachType() {
     }
 
 }
+
+//The registry is what the addon uses to find an option/info from the value given by js.
+// Names are found using a perfect hash (hash and displace), and ids using
+// their number inside the option/info type (the id without the type offset).
+// This way both lookups are O(1), and no memory needs to be allocated.
+function generateRegistryFile( scope ) {
+
+    //Options and infos that are implemented manually in Curl.cc, keep in sync with the tables there.
+    var linkedListOptions = [
+            'HTTP200ALIASES', 'MAIL_RCPT', 'RESOLVE', 'HTTPPOST', 'HTTPHEADER',
+            'QUOTE', 'POSTQUOTE', 'PREQUOTE', 'TELNETOPTIONS'
+        ],
+        linkedListInfos = [ 'SSL_ENGINES', 'COOKIELIST' ],
+        optionPattern = /CINIT\((\w+),\s*\w+,\s*(\d+)\)/g,
+        infoPattern = /CURLINFO_(\w+)\s*=\s*CURLINFO_\w+\s*\+\s*(\d+)/g,
+        file = path.resolve( __dirname, '..', 'src', 'generated-stubs', 'curlRegistry.h' ),
+        toWrite,
+        match;
+
+    while ( match = optionPattern.exec( scope ) )
+        registries.options.numbers[match[1]] = parseInt( match[2], 10 );
+
+    while ( match = infoPattern.exec( scope ) )
+        registries.infos.numbers[match[1]] = parseInt( match[2], 10 );
+
+    linkedListOptions.forEach( function( item ) {
+        registries.options.entries[item] = 'LINKED_LIST';
+    });
+
+    registries.options.entries['SHARE'] = 'SHARE';
+
+    linkedListInfos.forEach( function( item ) {
+        registries.infos.entries[item] = 'LINKED_LIST';
+    });
+
+    toWrite = [
+        '// generated by ' + __filename + ' at ' + currentDate,
+        '#ifndef CURLREGISTRY_GENERATED_H',
+        '#define CURLREGISTRY_GENERATED_H'
+    ];
+
+    toWrite = toWrite.concat(
+        generateRegistryTable( 'curlOptionsRegistry', registries.options, 10000 ),
+        generateRegistryTable( 'curlInfosRegistry', registries.infos, 0x100000 )
+    );
+
+    toWrite.push( '#endif' );
+
+    fs.writeFileSync( file, toWrite.join( EOL ) );
+}
+
+function generateRegistryTable( name, registry, idModulo ) {
+
+    //options not available on the installed libcurl are left out.
+    var names = Object.keys( registry.entries ).filter( function( item ) {
+            return registry.numbers.hasOwnProperty( item );
+        }).sort(),
+        hash = buildPerfectHash( names ),
+        ids = [],
+        content = [];
+
+    names.forEach( function( item, index ) {
+
+        var number = registry.numbers[item] % idModulo;
+
+        while ( ids.length <= number )
+            ids.push( -1 );
+
+        ids[number] = index;
+
+        content.push( '\t{"' + item + '", CURL' + registry.prefix + '_' + item + ', CurlRegistry::' + registry.entries[item] + '},' );
+    });
+
+    return [
+        'static const CurlRegistry::Entry ' + name + 'Entries[] = {',
+        content.join( EOL ).slice( 0, -1 ),
+        '};',
+        'static const uint32_t ' + name + 'Displacements[] = {' + hash.displacements.join( ',' ) + '};',
+        'static const int16_t ' + name + 'Slots[] = {' + hash.slots.join( ',' ) + '};',
+        'static const int16_t ' + name + 'Ids[] = {' + ids.join( ',' ) + '};',
+        'static const CurlRegistry::Table ' + name + ' = {',
+        '\t' + name + 'Entries, ' + names.length + ',',
+        '\t' + name + 'Displacements, ' + hash.displacements.length + ',',
+        '\t' + name + 'Slots, ' + hash.slots.length + ',',
+        '\t' + name + 'Ids, ' + ids.length + ', ' + idModulo,
+        '};'
+    ];
+}
+
+//FNV-1a, must give the same result than CurlRegistry::Hash
+function hashName( name, seed ) {
+
+    var h = ( 2166136261 ^ seed ) >>> 0;
+
+    for ( var i = 0; i < name.length; i++ ) {
+
+        h = ( h ^ name.charCodeAt( i ) ) >>> 0;
+        //h * 16777619, without losing precision
+        h = ( h * 0x193 + ( ( h << 24 ) >>> 0 ) ) % 0x100000000;
+    }
+
+    return h;
+}
+
+//Hash and displace: names are split in buckets, then, starting from the biggest bucket,
+// a seed that puts all names of the bucket in free slots is searched.
+function buildPerfectHash( names ) {
+
+    var bucketsLength = Math.max( 1, Math.ceil( names.length / 4 ) ),
+        slotsLength = Math.max( 1, Math.ceil( names.length * 1.25 ) ),
+        buckets = [],
+        displacements = [],
+        slots = [],
+        i;
+
+    for ( i = 0; i < bucketsLength; i++ ) {
+        buckets.push( { index : i, items : [] } );
+        displacements.push( 0 );
+    }
+
+    for ( i = 0; i < slotsLength; i++ )
+        slots.push( -1 );
+
+    names.forEach( function( item, index ) {
+        buckets[hashName( item, 0 ) % bucketsLength].items.push( index );
+    });
+
+    buckets.sort( function( a, b ) {
+        return ( b.items.length - a.items.length ) || ( a.index - b.index );
+    });
+
+    buckets.forEach( function( bucket ) {
+
+        var seed, positions, j;
+
+        if ( !bucket.items.length )
+            return;
+
+        for ( seed = 1; ; seed++ ) {
+
+            if ( seed > 10000000 )
+                throw new Error( 'Could not build the perfect hash for the registry.' );
+
+            positions = [];
+
+            for ( j = 0; j < bucket.items.length; j++ ) {
+
+                var position = hashName( names[bucket.items[j]], seed ) % slotsLength;
+
+                if ( slots[position] !== -1 || positions.indexOf( position ) !== -1 )
+                    break;
+
+                positions.push( position );
+            }
+
+            if ( positions.length === bucket.items.length )
+                break;
+        }
+
+        displacements[bucket.index] = seed;
+
+        positions.forEach( function( position, index ) {
+            slots[position] = bucket.items[index];
+        });
+    });
+
+    return { displacements : displacements, slots : slots };
+}